@@ -1,58 +1,409 @@
 #include "BVH.h"
+#include "LBVH.h"
+#include "WideBVH.h"
+#include "parallel.h"
+#include "simd.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double msSince(clock_type::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+// Fills info[start, end) for objs[start, end); entries before start are left empty.
+std::vector<BVHPrimitiveInfo> primitiveInfo(const std::vector<std::shared_ptr<hittable>>& objs,
+                                            size_t start, size_t end, int threads)
+{
+    std::vector<BVHPrimitiveInfo> info(end);
+    parallel_for(start, end, 1024, [&](size_t i) {
+        info[i].box      = objs[i]->getBounds();
+        info[i].centroid = info[i].box.Centroid();
+        info[i].index    = static_cast<std::uint32_t>(i);
+    }, threads);
+    return info;
+}
+} // namespace
 
 BVHNode::BVHNode(std::vector<std::shared_ptr<hittable>>& objs,
-            size_t start, size_t end)// int max_leaf = 1
+            size_t start, size_t end, const BVHBuildOptions& opts)
+{
+    std::vector<BVHPrimitiveInfo> info = primitiveInfo(objs, start, end, opts.threads);
+    build(info, start, end, opts, &objs);
+    // 按 info 的最终顺序重排 objs[start, end)
+    const std::vector<std::shared_ptr<hittable>> original(objs.begin() + start, objs.begin() + end);
+    for (size_t i = start; i < end; ++i) objs[i] = original[info[i].index - start];
+}
+
+BVHNode::BVHNode(std::vector<BVHPrimitiveInfo>& info, size_t start, size_t end,
+                 const BVHBuildOptions& opts, const std::vector<std::shared_ptr<hittable>>* prims)
+{
+    build(info, start, end, opts, prims);
+}
+
+void BVHNode::build(std::vector<BVHPrimitiveInfo>& info, size_t start, size_t end,
+                    const BVHBuildOptions& opts, const std::vector<std::shared_ptr<hittable>>* objs)
 {
-    // 1) 统计当前节点的整体 AABB（所有物体并集）
-    bounds3 node_box = objs[start]->getBounds();
+    // 1) 统计当前节点的整体 AABB（所有物体并集），包围盒已预先缓存
+    bounds3 node_box = info[start].box;
     for (size_t i = start + 1; i < end; ++i)
-        node_box = Union(node_box, objs[i]->getBounds());
+        node_box = Union(node_box, info[i].box);
     box = node_box;
 
-    // 2) 判断是否做叶子
+    // 2) 判断是否做叶子：叶子保存 objs 中连续的一段 [start, end)
     const size_t span = end - start;
-    if (span <= 1) {
-        left  = objs[start];   // 叶子里只挂一个（最简单版本）
-        right = nullptr;
-        axis  = 0;             // 记录个值即可（调试/统计用）
-        return;                // 叶子构建结束
+    const size_t max_leaf = static_cast<size_t>(std::clamp(opts.max_leaf_size, 1, kBVHMaxLeafSize));
+    auto makeLeaf = [&]() {
+        prims       = objs;
+        first_prim  = start;
+        n_prims     = span;
+        axis        = 0;
+    };
+    const bool sah_leaves = opts.sah_leaves && opts.method == SplitMethod::SAH;
+    if (span <= 1 || (span <= max_leaf && !sah_leaves)) {
+        makeLeaf();
+        return;
     }
 
+    auto child = [&](size_t lo, size_t hi) {
+        return std::shared_ptr<BVHNode>(new BVHNode(info, lo, hi, opts, objs));
+    };
+
     // 3) 计算“质心 AABB”，用于选择最长轴
-    bounds3 centroid_box(objs[start]->getBounds().Centroid());
+    bounds3 centroid_box(info[start].centroid);
     for (size_t i = start + 1; i < end; ++i)
-        centroid_box = Union(centroid_box, objs[i]->getBounds().Centroid());
+        centroid_box = Union(centroid_box, info[i].centroid);
     axis = centroid_box.maxExtent();
 
-    // 4) 选择比较器（按质心在 axis 轴上的标量排序）
-    auto cmp = (axis == 0)
-        ? [](const std::shared_ptr<hittable>& a, const std::shared_ptr<hittable>& b){
-                return a->getBounds().Centroid().x() < b->getBounds().Centroid().x();
-            }
-        : (axis == 1)
-        ? [](const std::shared_ptr<hittable>& a, const std::shared_ptr<hittable>& b){
-                return a->getBounds().Centroid().y() < b->getBounds().Centroid().y();
-            }
-        : [](const std::shared_ptr<hittable>& a, const std::shared_ptr<hittable>& b){
-                return a->getBounds().Centroid().z() < b->getBounds().Centroid().z();
-            };
-    // 5) 选中位数位置并“局部重排”（不完全排序，线性期望时间）
+    // 3b) SAH：在三个轴上分桶评估代价，找不到有效划分时退回中位数
+    //     sah_leaves 时比较“建叶子”和“最优划分”的代价，叶子更便宜就停下
+    if (opts.method == SplitMethod::SAH) {
+        double split_cost = 0.0;
+        size_t split = splitSAH(info, start, end, centroid_box, opts.sah_bins, split_cost);
+        const double leaf_cost = kBVHIntersectCost * static_cast<double>(span);
+        if (sah_leaves && span <= max_leaf && (split == start || leaf_cost <= split_cost)) {
+            makeLeaf();
+            return;
+        }
+        if (split > start && split < end) {
+            left  = child(start, split);
+            right = child(split, end);
+            box = Union(left->getBounds(), right->getBounds());
+            return;
+        }
+    }
+
+    // 4) 选中位数位置并“局部重排”（不完全排序，线性期望时间），比较缓存的质心
+    const int a = axis;
     const size_t mid = start + span / 2;
-    std::nth_element(objs.begin() + start,
-                        objs.begin() + mid,
-                        objs.begin() + end, cmp);
+    std::nth_element(info.begin() + start,
+                        info.begin() + mid,
+                        info.begin() + end,
+                        [a](const BVHPrimitiveInfo& l, const BVHPrimitiveInfo& r) {
+                            return l.centroid[a] < r.centroid[a];
+                        });
 
-    // 6) 递归构建左右子树（[start, mid) 和 [mid, end)）
-    left  = std::make_shared<BVHNode>(objs, start, mid);
-    right = std::make_shared<BVHNode>(objs, mid,   end);
+    // 5) 递归构建左右子树（[start, mid) 和 [mid, end)）
+    left  = child(start, mid);
+    right = child(mid,   end);
 
-    // 7) （可选冗余）确保当前节点 AABB = 左右并集（通常已等于 node_box）
+    // 6) （可选冗余）确保当前节点 AABB = 左右并集（通常已等于 node_box）
     //    再做一次 Union 让逻辑更直观，也能防止未来改动时漏更新
     box = Union(left->getBounds(), right->getBounds());
 }
 
+size_t BVHNode::splitSAH(std::vector<BVHPrimitiveInfo>& info,
+                         size_t start, size_t end, const bounds3& centroid_box, int bins,
+                         double& best_cost)
+{
+    bins = std::clamp(bins, 2, 64);
+    const double parent_area = box.surface_area();
+    if (!(parent_area > 0.0)) return start;
+
+    struct Bin { bounds3 bounds; size_t count = 0; };
+    const vec3 cmin   = centroid_box.pMin;
+    const vec3 extent = centroid_box.diagonal();
+    auto binOf = [&](const point3& c, int a) {
+        int b = static_cast<int>(bins * ((c[a] - cmin[a]) / extent[a]));
+        return std::clamp(b, 0, bins - 1);
+    };
+
+    best_cost = std::numeric_limits<double>::infinity();
+    int    best_axis  = -1;
+    int    best_split = 0;   // 左侧包含桶 [0, best_split]
+    std::vector<Bin>    bin(static_cast<size_t>(bins));
+    std::vector<double> right_area(static_cast<size_t>(bins));
+    std::vector<size_t> right_count(static_cast<size_t>(bins));
+
+    for (int a = 0; a < 3; ++a) {
+        if (!(extent[a] > 0.0)) continue;
+        std::fill(bin.begin(), bin.end(), Bin{});
+        for (size_t i = start; i < end; ++i) {
+            Bin& dst = bin[static_cast<size_t>(binOf(info[i].centroid, a))];
+            dst.bounds = Union(dst.bounds, info[i].box);
+            ++dst.count;
+        }
+
+        // 从右往左扫，记录每个切分位置右侧的面积和数量
+        bounds3 acc; size_t n = 0;
+        for (int b = bins - 1; b > 0; --b) {
+            acc = Union(acc, bin[b].bounds);
+            n  += bin[b].count;
+            right_count[b] = n;
+            right_area[b]  = n ? acc.surface_area() : 0.0;
+        }
+        // 从左往右扫，计算 C = C_trav + (A_L N_L + A_R N_R) / A * C_isect
+        acc = bounds3(); n = 0;
+        for (int b = 0; b < bins - 1; ++b) {
+            acc = Union(acc, bin[b].bounds);
+            n  += bin[b].count;
+            if (n == 0 || right_count[b + 1] == 0) continue;
+            double cost = kBVHTraversalCost + kBVHIntersectCost *
+                (acc.surface_area() * n + right_area[b + 1] * right_count[b + 1]) / parent_area;
+            if (cost < best_cost) { best_cost = cost; best_axis = a; best_split = b; }
+        }
+    }
+    if (best_axis < 0) return start;
+
+    axis = best_axis;
+    auto mid = std::partition(info.begin() + start, info.begin() + end,
+        [&](const BVHPrimitiveInfo& p) {
+            return binOf(p.centroid, best_axis) <= best_split;
+        });
+    return static_cast<size_t>(mid - info.begin());
+}
+
+BVH::BVH() = default;
+BVH::~BVH() = default;
+
+BVH::BVH(const std::vector<std::shared_ptr<hittable>>& objects, const BVHBuildOptions& opts)
+    : options(opts)
+{
+    if (objects.empty()) return;
+    const auto t_start = clock_type::now();
+
+    auto t0 = clock_type::now();
+    std::vector<BVHPrimitiveInfo> info = primitiveInfo(objects, 0, objects.size(), opts.threads);
+    times.bounds_ms = msSince(t0);
+
+    ordered.resize(objects.size());
+    LinearBVH lin = buildLinear(std::move(info), opts, &times, &root, &ordered);
+    nodes  = std::move(lin.nodes);
+    order  = std::move(lin.order);
+    depth  = lin.depth;
+    bounds = lin.bounds;
+    finish(objects);
+    times.total_ms = msSince(t_start);
+}
+
+BVH::BVH(const std::vector<std::shared_ptr<hittable>>& objects, LinearBVH prebuilt, const BVHBuildOptions& opts)
+    : options(opts)
+{
+    if (objects.empty() || prebuilt.nodes.empty()) return;
+    const auto t_start = clock_type::now();
+    ordered.resize(objects.size());
+    nodes  = std::move(prebuilt.nodes);
+    order  = std::move(prebuilt.order);
+    depth  = prebuilt.depth;
+    bounds = prebuilt.bounds;
+    finish(objects);
+    times.total_ms = msSince(t_start);
+}
+
+void BVH::finish(const std::vector<std::shared_ptr<hittable>>& objects)
+{
+    auto t0 = clock_type::now();
+    if (options.soa_leaves) {
+        // 叶子内按类型排序：同类图元在各自的数组里连续，叶子范围本身不变
+        std::vector<std::uint8_t> kind(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i)
+            kind[i] = static_cast<std::uint8_t>(PrimitiveSoA::kindOf(objects[i].get()));
+        for (const LinearBVHNode& n : nodes) {
+            if (!n.isLeaf()) continue;
+            auto first = order.begin() + n.offset;
+            std::stable_sort(first, first + n.nPrimitives,
+                             [&](std::uint32_t a, std::uint32_t b) { return kind[a] < kind[b]; });
+        }
+    }
+    for (size_t i = 0; i < order.size(); ++i) ordered[i] = objects[order[i]];
+    primitives.reserve(ordered.size());
+    for (const auto& p : ordered) primitives.push_back(p.get());
+    if (options.soa_leaves) soa.build(primitives.data(), primitives.size());
+    times.flatten_ms += msSince(t0);
+
+    // 宽节点：把二叉树折叠成 4 叉或 8 叉
+    t0 = clock_type::now();
+    if (options.width == 4) { wide4 = std::make_unique<WideBVH<4>>(); wide4->build(nodes); }
+    else if (options.width == 8) { wide8 = std::make_unique<WideBVH<8>>(); wide8->build(nodes); }
+    times.flatten_ms += msSince(t0);
+}
+
+LinearBVH BVH::buildLinear(std::vector<BVHPrimitiveInfo> info, const BVHBuildOptions& opts,
+                           BVHBuildTimes* times)
+{
+    return buildLinear(std::move(info), opts, times, nullptr, nullptr);
+}
+
+LinearBVH BVH::buildLinear(std::vector<BVHPrimitiveInfo> info, const BVHBuildOptions& opts,
+                           BVHBuildTimes* times, std::shared_ptr<BVHNode>* root,
+                           const std::vector<std::shared_ptr<hittable>>* prims)
+{
+    if (opts.method == SplitMethod::LBVH || info.empty()) return buildLBVH(info, opts, times);
+
+    BVHBuildTimes local;
+    BVHBuildTimes& tm = times ? *times : local;
+    LinearBVH res;
+    auto t0 = clock_type::now();
+    auto tree = std::shared_ptr<BVHNode>(new BVHNode(info, 0, info.size(), opts, prims));
+    res.order.resize(info.size());
+    for (size_t i = 0; i < info.size(); ++i) res.order[i] = info[i].index;
+    tm.emit_ms += msSince(t0);
+
+    t0 = clock_type::now();
+    res.nodes.reserve(2 * info.size());
+    flattenNode(tree.get(), res.nodes, 1, res.depth);
+    res.bounds = tree->getBounds();
+    tm.flatten_ms += msSince(t0);
+    if (root) *root = std::move(tree);
+    return res;
+}
+
+int BVH::width() const
+{
+    return wide8 ? 8 : wide4 ? 4 : 2;
+}
+
+bool BVH::intersect_with_stats(const ray& r, interval ray_t, hit_info& h, BVHTraversalStats* stats) const
+{
+    const bool simd = simdEnabled();
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, interval& t) {
+        if (!soa.empty()) return soa.intersect_leaf(first, count, r, t, h, simd);
+        bool found = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            if (primitives[i]->intersect(r, t, h)) { found = true; t.max = h.t; }
+        }
+        return found;
+    };
+    if (wide4) return wide4->traverse(r, ray_t, leaf, stats);
+    if (wide8) return wide8->traverse(r, ray_t, leaf, stats);
+    if (nodes.empty()) return false;
+    return traverseLinearBVH(nodes.data(), depth, r, ray_t, leaf, stats);
+}
+
+bool BVH::occluded_with_stats(const ray& r, interval ray_t, BVHTraversalStats* stats) const
+{
+    const bool simd = simdEnabled();
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, interval& t) {
+        if (!soa.empty()) return soa.occluded_leaf(first, count, r, t, simd);
+        for (std::uint32_t i = first; i < first + count; ++i)
+            if (primitives[i]->occluded(r, t)) return true;
+        return false;
+    };
+    if (wide4) return wide4->traverse<true>(r, ray_t, leaf, stats);
+    if (wide8) return wide8->traverse<true>(r, ray_t, leaf, stats);
+    if (nodes.empty()) return false;
+    return traverseLinearBVH<true>(nodes.data(), depth, r, ray_t, leaf, stats);
+}
+
+double BVH::sah_cost() const
+{
+    if (nodes.empty()) return 0.0;
+    const double root_area = nodes[0].getBounds().surface_area();
+    if (!(root_area > 0.0)) return 0.0;
+
+    double cost = 0.0;
+    for (const LinearBVHNode& n : nodes) {
+        const double rel = n.getBounds().surface_area() / root_area;
+        cost += rel * (n.isLeaf() ? kBVHIntersectCost * n.nPrimitives : kBVHTraversalCost);
+    }
+    return cost;
+}
+
+std::uint32_t BVH::flattenNode(const BVHNode* n, std::vector<LinearBVHNode>& nodes, int depth, int& max_depth)
+{
+    max_depth = std::max(max_depth, depth);
+    const std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    LinearBVHNode ln{};
+    ln.setBounds(n->box);
+    if (n->isLeaf()) {
+        // 叶子的物体在 ordered 中本来就是连续的，直接沿用下标
+        ln.offset      = static_cast<std::uint32_t>(n->first_prim);
+        ln.nPrimitives = static_cast<std::uint16_t>(n->n_prims);
+    } else {
+        ln.axis = static_cast<std::uint8_t>(n->axis);
+        flattenNode(static_cast<const BVHNode*>(n->left.get()), nodes, depth + 1, max_depth);
+        ln.offset = flattenNode(static_cast<const BVHNode*>(n->right.get()), nodes, depth + 1, max_depth);
+    }
+    nodes[index] = ln;
+    return index;
+}
+
+BVHStats BVH::stats() const
+{
+    BVHStats st;
+    if (nodes.empty()) return st;
+    std::vector<std::pair<std::uint32_t, int>> stack{{0u, 1}};
+    while (!stack.empty()) {
+        auto [i, d] = stack.back(); stack.pop_back();
+        const LinearBVHNode& n = nodes[i];
+        ++st.nodes;
+        st.max_depth = std::max(st.max_depth, d);
+        if (n.isLeaf()) {
+            ++st.leaves;
+            st.primitives += n.nPrimitives;
+            ++st.leaf_fill[std::min<size_t>(n.nPrimitives, kBVHMaxLeafSize)];
+            continue;
+        }
+        ++st.interior;
+        stack.push_back({i + 1,    d + 1});
+        stack.push_back({n.offset, d + 1});
+    }
+    // make_shared puts the node next to its control block (two counters + vtable)
+    if (root)
+        st.tree_bytes = st.nodes * (sizeof(BVHNode) + 16) + ordered.size() * sizeof(std::shared_ptr<hittable>);
+    st.linear_bytes = nodes.size() * sizeof(LinearBVHNode) + primitives.size() * sizeof(const hittable*);
+    if (wide4) { st.wide_width = 4; st.wide_nodes = wide4->size(); st.wide_bytes = wide4->bytes(); }
+    if (wide8) { st.wide_width = 8; st.wide_nodes = wide8->size(); st.wide_bytes = wide8->bytes(); }
+    st.soa_bytes = soa.bytes();
+    return st;
+}
+
+void BVHStats::print(std::ostream& out) const
+{
+    out << "BVH: " << nodes << " nodes (" << interior << " interior, " << leaves << " leaves), "
+        << primitives << " primitives, depth " << max_depth << "\n";
+    out << "  leaf fill:";
+    for (int k = 1; k <= kBVHMaxLeafSize; ++k)
+        if (leaf_fill[k]) out << "  " << k << ":" << leaf_fill[k];
+    out << "\n  memory: ";
+    if (tree_bytes) out << "tree " << tree_bytes / 1024.0 << " KiB, ";
+    out << "flattened " << linear_bytes / 1024.0 << " KiB";
+    if (soa_bytes) out << ", primitive SoA " << soa_bytes / 1024.0 << " KiB";
+    out << "\n";
+    if (wide_width)
+        out << "  BVH" << wide_width << ": " << wide_nodes << " nodes, " << wide_bytes / 1024.0 << " KiB\n";
+}
+
+void BVHBuildTimes::print(std::ostream& out) const
+{
+    out << "  build ms:";
+    auto stage = [&](const char* name, double ms) { if (ms > 0.0) out << "  " << name << " " << ms; };
+    stage("bounds", bounds_ms);
+    stage("morton", morton_ms);
+    stage("sort", sort_ms);
+    stage("emit", emit_ms);
+    stage("refit", refit_ms);
+    stage("flatten", flatten_ms);
+    out << "  | total " << total_ms << "\n";
+}
+
 static inline bool aabb_entry_t(const bounds3& b, const ray& r,
-                                const interval& ray_t, double& t_enter_out)
+                                const interval& ray_t, real& t_enter_out)
 {
     vec3 invDir(1.0/r.direction().x(),
                 1.0/r.direction().y(),
@@ -67,8 +418,8 @@ static inline bool aabb_entry_t(const bounds3& b, const ray& r,
               std::max(t0v.y(), t1v.y()),
               std::max(t0v.z(), t1v.z()));
 
-    double t_enter = std::max(tmin.x(), std::max(tmin.y(), tmin.z()));
-    double t_exit  = std::min(tmax.x(), std::min(tmax.y(), tmax.z()));
+    real t_enter = std::max(tmin.x(), std::max(tmin.y(), tmin.z()));
+    real t_exit  = std::min(tmax.x(), std::min(tmax.y(), tmax.z()));
     t_enter = std::max(t_enter, ray_t.min);
     t_exit  = std::min(t_exit,  ray_t.max);
 
@@ -76,21 +427,23 @@ static inline bool aabb_entry_t(const bounds3& b, const ray& r,
     return (t_enter <= t_exit);
 }
 
-bool BVHNode::hit(const ray& r, interval ray_t, hit_record& rec) const
+bool BVHNode::intersect(const ray& r, interval ray_t, hit_info& h) const
 {
     vec3 invDir(1.0/r.direction().x(),
                 1.0/r.direction().y(),
                 1.0/r.direction().z());
     if (!box.intersectP(r, invDir, ray_t)) return false;
 
-    if (!right) 
+    if (isLeaf()) 
     {
-        hit_record tmp;
-        if (left->hit(r, ray_t, tmp)) { rec = tmp; return true; }
-        return false;
+        bool found = false;
+        for (size_t i = first_prim; i < first_prim + n_prims; ++i) {
+            if ((*prims)[i]->intersect(r, ray_t, h)) { found = true; ray_t.max = h.t; }
+        }
+        return found;
     }
 
-    double tL = 0.0, tR = 0.0;
+    real tL = 0, tR = 0;
     bool hitLbox = aabb_entry_t(left->getBounds(),  r, ray_t, tL);
     bool hitRbox = aabb_entry_t(right->getBounds(), r, ray_t, tR);
 
@@ -104,18 +457,24 @@ bool BVHNode::hit(const ray& r, interval ray_t, hit_record& rec) const
         secondChild = nullptr;
     }
 
-    hit_record r1;
-    bool h1 = firstChild->hit(r, ray_t, r1);
-    if (h1) ray_t.max = r1.t;
-    if (secondChild) {
-        hit_record r2;
-        bool h2 = secondChild->hit(r, ray_t, r2);
+    // h 只在命中时被写入，第二个孩子的区间已收紧到第一个的命中，所以写入的总是更近的
+    bool h1 = firstChild->intersect(r, ray_t, h);
+    if (h1) ray_t.max = h.t;
+    bool h2 = secondChild && secondChild->intersect(r, ray_t, h);
+    return h1 || h2;
+}
+bool BVHNode::occluded(const ray& r, interval ray_t) const
+{
+    vec3 invDir(1.0/r.direction().x(),
+                1.0/r.direction().y(),
+                1.0/r.direction().z());
+    if (!box.intersectP(r, invDir, ray_t)) return false;
 
-        // [H] 合并两个结果：返回最近的命中
-        if (h1 && h2) { rec = (r1.t < r2.t ? r1 : r2); return true; }
-        if (h2)       { rec = r2; return true; }
+    if (isLeaf()) {
+        for (size_t i = first_prim; i < first_prim + n_prims; ++i)
+            if ((*prims)[i]->occluded(r, ray_t)) return true;
+        return false;
     }
-
-    if (h1) { rec = r1; return true; }
-    return false;
-}
\ No newline at end of file
+    // 任意命中即可返回，不需要按远近排序
+    return left->occluded(r, ray_t) || right->occluded(r, ray_t);
+}
@@ -1,42 +1,356 @@
 #pragma once
 #include "hittable.h"
+#include "PrimitiveSoA.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <ostream>
 #include <vector>
 
+// How BVHNode chooses the split plane of an interior node.
+enum class SplitMethod {
+    MEDIAN, // object median of the longest centroid axis (nth_element)
+    SAH,    // binned surface area heuristic over all three axes
+    LBVH    // parallel Morton-code linear BVH (Karras 2012), see LBVH.h
+};
+
+constexpr int kBVHMaxLeafSize = 8;
+
+struct BVHBuildOptions {
+    SplitMethod method = SplitMethod::MEDIAN;
+    int sah_bins = 16;      // buckets per axis for SplitMethod::SAH, clamped to [2, 64]
+    int max_leaf_size = 1;  // primitives per leaf, clamped to [1, kBVHMaxLeafSize]
+    // With SAH / LBVH: stop splitting as soon as a leaf is cheaper than the best split
+    // (max_leaf_size is then only an upper bound). Ignored by the median builder.
+    bool sah_leaves = false;
+    // LBVH only
+    bool morton63 = false;  // 63-bit Morton codes (21 bits per axis) instead of 30-bit
+    bool treelets = false;  // treelet restructuring pass after the refit (Karras & Aila 2013)
+    int  threads  = 0;      // build threads, 0 = all cores
+    // Node width used for traversal: 2 keeps the binary LinearBVHNode tree, 4 or 8 collapse
+    // it into a WideBVH with SIMD box tests.
+    int  width    = 2;
+    // Sort each leaf by primitive kind and test spheres / quads / boxes from PrimitiveSoA
+    // arrays instead of through virtual calls. Traversal only: the tree does not change.
+    bool soa_leaves = true;
+};
+
+// Wall time of each build stage. Stages a builder does not have stay at zero.
+struct BVHBuildTimes {
+    double bounds_ms  = 0.0;  // primitive boxes and centroids
+    double morton_ms  = 0.0;
+    double sort_ms    = 0.0;
+    double emit_ms    = 0.0;  // hierarchy (recursive builders: the whole tree)
+    double refit_ms   = 0.0;  // bottom-up boxes and SAH costs, including treelets
+    double flatten_ms = 0.0;
+    double total_ms   = 0.0;
+    void print(std::ostream& out) const;
+};
+
+// Bounds and centroid of one primitive, computed once before the build so that split
+// selection and sorting never call getBounds() again.
+struct BVHPrimitiveInfo {
+    bounds3       box;
+    point3        centroid;
+    std::uint32_t index = 0;  // position in the caller's primitive array
+};
+
+struct BVHStats {
+    size_t nodes = 0, interior = 0, leaves = 0, primitives = 0;
+    int    max_depth = 0;
+    std::array<size_t, kBVHMaxLeafSize + 1> leaf_fill{};  // leaves holding k primitives
+    size_t tree_bytes = 0;    // BVHNode tree incl. shared_ptr control blocks
+    size_t linear_bytes = 0;  // flattened node array + primitive pointers
+    size_t wide_nodes = 0, wide_bytes = 0;  // BVH4/BVH8 copy, if built
+    int    wide_width = 0;
+    size_t soa_bytes = 0;                   // PrimitiveSoA copy of the leaf primitives
+    void print(std::ostream& out) const;
+};
+
+// Relative costs used by the SAH builder and by BVH::sah_cost().
+constexpr double kBVHTraversalCost = 1.0;
+constexpr double kBVHIntersectCost = 1.0;
+
+// Every slab test scales its far-plane distances by this (pbrt 3rd ed., 3.9.2). In float
+// the rounding error of (bound - o) * inv is as large as the boxes' own slack, so a ray
+// grazing a primitive on a box face could miss the box; 1 + 2 gamma(3) covers it. In
+// double the outward rounding of the float bounds already does, and the factor is 1.
+constexpr real kBoxExitScale = sizeof(real) == 4
+    ? real(1 + 2 * (3 * 0.5 * std::numeric_limits<float>::epsilon()) / (1 - 3 * 0.5 * std::numeric_limits<float>::epsilon()))
+    : real(1);
+
+// Precomputed per-ray data for box tests: the inverse direction is computed once per
+// ray instead of at every node.
+struct RayBoxQuery {
+    real o[3];
+    real inv[3];
+    int  neg[3];   // 1 if the direction is negative along that axis
+
+    explicit RayBoxQuery(const ray& r) {
+        for (int a = 0; a < 3; ++a) {
+            o[a]   = r.origin()[a];
+            inv[a] = real(1) / r.direction()[a];
+            neg[a] = inv[a] < 0;
+        }
+    }
+};
+
+// Flattened BVH node, 32 bytes so two fit in a cache line.
+// Bounds are floats rounded outwards, so the box test never misses a hit the double
+// precision box would have found; the test itself runs in `real`. Interior nodes store their first child directly after
+// themselves and `offset` points at the second child; leaves store their primitive range.
+struct alignas(32) LinearBVHNode {
+    float         bmin[3];
+    float         bmax[3];
+    std::uint32_t offset;      // interior: second child index, leaf: first primitive
+    std::uint16_t nPrimitives; // 0 for interior nodes
+    std::uint8_t  axis;        // split axis, decides which child is visited first
+    std::uint8_t  pad = 0;
+
+    bool isLeaf() const { return nPrimitives > 0; }
+    void setBounds(const bounds3& b) {
+        for (int a = 0; a < 3; ++a) {
+            bmin[a] = roundDown(b.pMin[a]);
+            bmax[a] = roundUp(b.pMax[a]);
+        }
+    }
+    bounds3 getBounds() const {
+        return bounds3(point3(bmin[0], bmin[1], bmin[2]), point3(bmax[0], bmax[1], bmax[2]));
+    }
+
+    // Slab test against [t_min, t_max]. Chooses near/far planes by direction sign, so a
+    // NaN from 0 * inf fails the comparisons and does not clip the interval.
+    bool intersect(const RayBoxQuery& q, real t_min, real t_max) const {
+        for (int a = 0; a < 3; ++a) {
+            const real lo = q.neg[a] ? bmax[a] : bmin[a];
+            const real hi = q.neg[a] ? bmin[a] : bmax[a];
+            const real t0 = (lo - q.o[a]) * q.inv[a];
+            const real t1 = (hi - q.o[a]) * q.inv[a] * kBoxExitScale;
+            if (t0 > t_min) t_min = t0;
+            if (t1 < t_max) t_max = t1;
+            if (t_min > t_max) return false;
+        }
+        return true;
+    }
+
+private:
+    static float roundDown(double d) {
+        float f = static_cast<float>(d);
+        return static_cast<double>(f) > d ? std::nextafter(f, -INFINITY) : f;
+    }
+    static float roundUp(double d) {
+        float f = static_cast<float>(d);
+        return static_cast<double>(f) < d ? std::nextafter(f, INFINITY) : f;
+    }
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must stay 32 bytes");
+
+// Depth limit of the fixed traversal stack; deeper trees fall back to a heap stack.
+constexpr int kBVHStackSize = 64;
+
+struct BVHFixedStack {
+    std::uint32_t data[kBVHStackSize];
+    int sp = 0;
+    void push(std::uint32_t v) { data[sp++] = v; }
+    std::uint32_t pop() { return data[--sp]; }
+    bool empty() const { return sp == 0; }
+};
+
+struct BVHDynamicStack {
+    std::vector<std::uint32_t> data;
+    void push(std::uint32_t v) { data.push_back(v); }
+    std::uint32_t pop() { std::uint32_t v = data.back(); data.pop_back(); return v; }
+    bool empty() const { return data.empty(); }
+};
+
+// Optional per-ray counters for the traversal benchmarks.
+struct BVHTraversalStats {
+    size_t nodes = 0;      // nodes fetched (one box test for BVH2, one N-wide test for BVH4/8)
+    size_t box_tests = 0;  // individual child boxes tested
+    size_t leaves = 0;     // leaf primitive ranges tested
+};
+
+// Iterative closest-hit traversal of a flattened BVH. `leaf(first, count, ray_t)` tests a
+// primitive range, returns true on a hit and shrinks ray_t.max to the hit distance so that
+// farther nodes are culled. Children are visited front to back along the split axis.
+// With AnyHit the traversal stops at the first leaf that reports a hit.
+template <bool AnyHit = false, typename Stack, typename LeafFn>
+inline bool traverseLinearBVH(Stack& stack, const LinearBVHNode* nodes, const ray& r, interval& ray_t,
+                              LeafFn&& leaf, BVHTraversalStats* stats = nullptr)
+{
+    const RayBoxQuery q(r);
+    std::uint32_t current = 0;
+    bool hit_any = false;
+    while (true) {
+        const LinearBVHNode& n = nodes[current];
+        if (stats) { ++stats->nodes; ++stats->box_tests; }
+        if (n.intersect(q, ray_t.min, ray_t.max)) {
+            if (n.isLeaf()) {
+                if (stats) ++stats->leaves;
+                if (leaf(n.offset, n.nPrimitives, ray_t)) {
+                    hit_any = true;
+                    if (AnyHit) break;
+                }
+                if (stack.empty()) break;
+                current = stack.pop();
+            } else if (q.neg[n.axis]) {
+                stack.push(current + 1);
+                current = n.offset;
+            } else {
+                stack.push(n.offset);
+                current = current + 1;
+            }
+        } else {
+            if (stack.empty()) break;
+            current = stack.pop();
+        }
+    }
+    return hit_any;
+}
+
+// Picks the fixed stack when the tree is shallow enough for it.
+template <bool AnyHit = false, typename LeafFn>
+inline bool traverseLinearBVH(const LinearBVHNode* nodes, int depth, const ray& r, interval& ray_t,
+                              LeafFn&& leaf, BVHTraversalStats* stats = nullptr)
+{
+    if (depth <= kBVHStackSize) {
+        BVHFixedStack stack;
+        return traverseLinearBVH<AnyHit>(stack, nodes, r, ray_t, leaf, stats);
+    }
+    BVHDynamicStack stack;
+    return traverseLinearBVH<AnyHit>(stack, nodes, r, ray_t, leaf, stats);
+}
+
 class BVHNode : public hittable
 {
 public:
     BVHNode() = default;
     BVHNode(std::vector<std::shared_ptr<hittable>>& objs,
-            size_t start, size_t end);
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override;
+            size_t start, size_t end, const BVHBuildOptions& opts = {});
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override;
+    bool occluded(const ray& r, interval ray_t) const override;
     bounds3 getBounds() const override { return box; }
 
 private:
+    friend class BVH;
+    // Builds over info[start, end), reordering info in place. Leaves refer to
+    // (*prims)[first_prim, ...), which the caller fills in info order afterwards.
+    BVHNode(std::vector<BVHPrimitiveInfo>& info, size_t start, size_t end, const BVHBuildOptions& opts,
+            const std::vector<std::shared_ptr<hittable>>* prims);
+    void build(std::vector<BVHPrimitiveInfo>& info, size_t start, size_t end, const BVHBuildOptions& opts,
+               const std::vector<std::shared_ptr<hittable>>* prims);
+    bool isLeaf() const { return n_prims > 0; }
+    // Chooses the split for [start, end) and partitions info around it. Returns the
+    // first index of the right child, or `start` if no useful split exists.
+    // `best_cost` receives the SAH cost of that split.
+    size_t splitSAH(std::vector<BVHPrimitiveInfo>& info,
+                    size_t start, size_t end, const bounds3& centroid_box, int bins,
+                    double& best_cost);
+
     std::shared_ptr<hittable> left;
     std::shared_ptr<hittable> right;
     bounds3 box;  
     int axis = 0; 
+    // Leaves only: the primitives are (*prims)[first_prim, first_prim + n_prims)
+    const std::vector<std::shared_ptr<hittable>>* prims = nullptr;
+    size_t first_prim = 0;
+    size_t n_prims = 0;
+};
+
+template <int N> class WideBVH;
+
+// Result of BVH::buildLinear: the flattened binary tree and the primitive order of its
+// leaves. A leaf covers [offset, offset + nPrimitives) of that order.
+struct LinearBVH {
+    std::vector<LinearBVHNode> nodes;
+    std::vector<std::uint32_t> order;  // leaf order -> BVHPrimitiveInfo::index
+    bounds3 bounds;
+    int depth = 0;
 };
 
 class BVH : public hittable {
 public:
-    BVH() = default;
-    explicit BVH(std::vector<std::shared_ptr<hittable>>& objects)
-    {
-        if (!objects.empty())
-            root = std::make_shared<BVHNode>(objects, 0, objects.size());
+    BVH();
+    // Builds over a private copy of `objects`, whose order then matches the leaves.
+    explicit BVH(const std::vector<std::shared_ptr<hittable>>& objects, const BVHBuildOptions& opts = {});
+    // Takes a tree that buildLinear() made over `objects` earlier (the scene cache), so
+    // only the 4/8-wide collapse runs. There is no BVHNode tree, as with the LBVH.
+    BVH(const std::vector<std::shared_ptr<hittable>>& objects, LinearBVH prebuilt, const BVHBuildOptions& opts);
+    ~BVH() override;
+    // Leaves point into `ordered`, so the BVH must stay where it was built.
+    BVH(const BVH&) = delete;
+    BVH& operator=(const BVH&) = delete;
+
+    // Runs the builder chosen by opts.method over `info` and flattens the result. For
+    // primitives that are not hittables (triangle_mesh keeps index triples); opts.width is
+    // ignored here.
+    static LinearBVH buildLinear(std::vector<BVHPrimitiveInfo> info, const BVHBuildOptions& opts,
+                                 BVHBuildTimes* times = nullptr);
+
+    // Iterative traversal of the flattened tree (binary, or the 4/8-wide collapse of it).
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override {
+        return intersect_with_stats(r, ray_t, h, nullptr);
+    }
+    bool intersect_with_stats(const ray& r, interval ray_t, hit_info& h, BVHTraversalStats* stats) const;
+
+    // Same traversal as intersect(), but it returns at the first primitive found inside ray_t.
+    bool occluded(const ray& r, interval ray_t) const override {
+        return occluded_with_stats(r, ray_t, nullptr);
     }
+    bool occluded_with_stats(const ray& r, interval ray_t, BVHTraversalStats* stats) const;
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+    // One traversal of the binary tree for the whole packet: nodes are first culled for all
+    // rays at once by interval arithmetic, then tested per ray (AVX2 when available).
+    // Packets whose rays point different ways are traced ray by ray.
+    std::uint32_t intersect_packet(const RayPacket& packet, hit_info* hits) const override {
+        return intersect_packet_with_stats(packet, hits, nullptr);
+    }
+    std::uint32_t intersect_packet_with_stats(const RayPacket& packet, hit_info* hits, BVHTraversalStats* stats) const;
+
+    // The original pointer-chasing traversal of the BVHNode tree (kept for comparison).
+    // Only the recursive builders keep that tree; the LBVH goes straight to linear nodes.
+    bool hit_recursive(const ray& r, interval ray_t, hit_record& rec) const {
         if (!root) return false;
         return root->hit(r, ray_t, rec);
     }
 
-    bounds3 getBounds() const override {
-        return root ? root->getBounds() : bounds3();
-    }
+    bounds3 getBounds() const override { return bounds; }
+
+    // Expected cost of a random ray under the surface area heuristic:
+    // sum over nodes of SA(node)/SA(root) * (C_trav for interior, C_isect * prims for leaves).
+    double sah_cost() const;
+    size_t node_count() const { return nodes.size(); }
+    BVHStats stats() const;
+    const BVHBuildOptions& build_options() const { return options; }
+    const BVHBuildTimes& build_times() const { return times; }
+    const std::vector<LinearBVHNode>& linear_nodes() const { return nodes; }
+    // Copy of the binary tree and its leaf order, as the BVH(objects, prebuilt) constructor takes it.
+    LinearBVH linear() const { return LinearBVH{nodes, order, bounds, depth}; }
+    int width() const;
 
 private:
-    std::shared_ptr<BVHNode> root;
-};
\ No newline at end of file
+    // Same as the public overload; MEDIAN / SAH also hand back the BVHNode tree, whose
+    // leaves refer to `prims` (filled in leaf order by the caller).
+    static LinearBVH buildLinear(std::vector<BVHPrimitiveInfo> info, const BVHBuildOptions& opts,
+                                 BVHBuildTimes* times, std::shared_ptr<BVHNode>* root,
+                                 const std::vector<std::shared_ptr<hittable>>* prims);
+    static std::uint32_t flattenNode(const BVHNode* n, std::vector<LinearBVHNode>& out, int depth, int& max_depth);
+    // Sorts leaves by kind (soa_leaves), fills ordered / primitives / soa from `order` and
+    // collapses to the configured width.
+    void finish(const std::vector<std::shared_ptr<hittable>>& objects);
+
+    std::vector<std::shared_ptr<hittable>> ordered;  // primitives in leaf order
+    std::shared_ptr<BVHNode> root;      // MEDIAN / SAH only
+    std::vector<LinearBVHNode> nodes;   // depth-first flattened tree
+    std::vector<std::uint32_t> order;   // leaf order -> index into the constructor's objects
+    std::vector<const hittable*> primitives;
+    PrimitiveSoA soa;                   // empty unless options.soa_leaves
+    bounds3 bounds;
+    int depth = 0;
+    BVHBuildOptions options;
+    BVHBuildTimes times;
+    std::unique_ptr<WideBVH<4>> wide4;
+    std::unique_ptr<WideBVH<8>> wide8;
+};
@@ -0,0 +1,80 @@
+#include "Checkpoint.h"
+#include <cstdio>
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr char          kMagic[8]  = {'S', 'R', 'T', 'C', 'K', 'P', 'T', '1'};
+constexpr std::uint32_t kByteOrder = 0x01020304u;
+
+struct Header {
+    char          magic[8];
+    std::uint32_t byte_order;
+    std::uint32_t level;
+    std::uint64_t scene_key;
+    std::uint64_t record_size;
+    std::uint64_t count;
+    std::uint64_t param_count;   // followed by param_count doubles, then the records
+};
+
+bool fail(std::string* reason, const char* why)
+{
+    if (reason) *reason = why;
+    return false;
+}
+} // namespace
+
+bool saveCheckpoint(const std::string& path, const RenderCheckpoint& ck,
+                    const void* records, size_t record_size, size_t count)
+{
+    Header h;
+    std::memset(&h, 0, sizeof h);
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.byte_order  = kByteOrder;
+    h.level       = ck.level;
+    h.scene_key   = ck.scene_key;
+    h.record_size = record_size;
+    h.count       = count;
+    h.param_count = ck.params.size();
+
+    const std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(&h, sizeof h, 1, f) == 1
+           && std::fwrite(ck.params.data(), sizeof(double), ck.params.size(), f) == ck.params.size()
+           && std::fwrite(records, record_size, count, f) == count
+           && std::fflush(f) == 0;
+#if defined(__unix__) || defined(__APPLE__)
+    ok = ok && fsync(fileno(f)) == 0;   // the data must be on disk before the rename is
+#endif
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) { std::remove(tmp.c_str()); return false; }
+#if defined(_WIN32)
+    std::remove(path.c_str());  // rename() does not replace an existing file on Windows
+#endif
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool loadCheckpoint(const std::string& path, RenderCheckpoint& ck,
+                    void* records, size_t record_size, size_t count, std::string* reason)
+{
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return fail(reason, "no checkpoint file");
+    struct Closer { std::FILE* f; ~Closer() { std::fclose(f); } } closer{f};
+
+    Header h;
+    if (std::fread(&h, sizeof h, 1, f) != 1 || std::memcmp(h.magic, kMagic, sizeof kMagic) != 0)
+        return fail(reason, "not a checkpoint");
+    if (h.byte_order != kByteOrder || h.record_size != record_size) return fail(reason, "written by another build");
+    if (h.scene_key != ck.scene_key) return fail(reason, "scene changed");
+    if (h.count != count || h.param_count != ck.params.size()) return fail(reason, "camera settings changed");
+    std::vector<double> params(ck.params.size());
+    if (std::fread(params.data(), sizeof(double), params.size(), f) != params.size()) return fail(reason, "truncated");
+    if (std::memcmp(params.data(), ck.params.data(), params.size() * sizeof(double)) != 0)
+        return fail(reason, "camera settings changed");
+    if (std::fread(records, record_size, count, f) != count || std::fgetc(f) != EOF) return fail(reason, "truncated");
+    ck.level = h.level;
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Accumulation buffer of a progressive render (rt::camera with pass_samples), saved between
+// passes so that a job killed part way resumes from its last pass instead of from zero.
+// The file holds the per-pixel records as raw bytes behind a header that names the scene
+// and the camera settings they were sampled with; loading fails on any difference and the
+// render starts over.
+struct RenderCheckpoint {
+    std::uint64_t       scene_key = 0;  // e.g. sceneContentHash() of the scene being rendered
+    std::vector<double> params;         // camera settings the samples depend on, compared exactly
+    std::uint32_t       level = 0;      // samples per pixel reached by every pixel still sampling
+};
+
+// Writes `count` records of `record_size` bytes to a temporary file, flushes it to disk and
+// renames it over `path`, so the previous checkpoint stays valid until the new one is whole.
+bool saveCheckpoint(const std::string& path, const RenderCheckpoint& ck,
+                    const void* records, size_t record_size, size_t count);
+
+// Reads `path` into `records` if its scene_key, params, record size and count match `ck`;
+// on success sets ck.level. On failure `records` may be partly overwritten and `reason`
+// says why.
+bool loadCheckpoint(const std::string& path, RenderCheckpoint& ck,
+                    void* records, size_t record_size, size_t count, std::string* reason = nullptr);
@@ -0,0 +1,266 @@
+#include "Denoiser.h"
+#include "parallel.h"
+#include "simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if RT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr float kB3[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+constexpr float kDepthEps = 1e-4f;
+constexpr float kLumEps   = 1e-6f;
+constexpr int   kBandRows = 16;
+
+// e^x for x <= 0: 2^round(x log2 e) from the exponent bits times a degree-5 Taylor
+// polynomial of 2^f, |f| <= 1/2 (relative error below 3e-6). Written op for op like the
+// AVX2 version so both give the same bits.
+inline float expNeg(float x)
+{
+    x = std::max(x, -80.0f);
+    const float t = x * 1.44269504f;
+    const float i = std::nearbyint(t);
+    const float f = (t - i) * 0.693147181f;   // 2^(t-i) = e^f
+    float p = 1.0f / 120;
+    p = p * f + 1.0f / 24;
+    p = p * f + 1.0f / 6;
+    p = p * f + 0.5f;
+    p = p * f + 1.0f;
+    p = p * f + 1.0f;
+    const std::int32_t bits = (static_cast<std::int32_t>(i) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+// Planes of one level: read-only inputs and the outputs of the pass.
+struct Level {
+    int w = 0, h = 0, step = 1, normal_pow = 7;
+    float sigma_z = 1.0f;
+    const float *r, *g, *b, *var, *lum, *inv_l;   // colour, its variance and luminance stop
+    const float *nx, *ny, *nz, *z, *gx, *gy;      // guides
+    float *out_r, *out_g, *out_b, *out_var;
+};
+
+void filterPixel(const Level& L, int x, int y)
+{
+    const std::size_t p = static_cast<std::size_t>(y) * L.w + x;
+    const float lp = L.lum[p], il = L.inv_l[p], zp = L.z[p], gxp = L.gx[p], gyp = L.gy[p];
+    const float nxp = L.nx[p], nyp = L.ny[p], nzp = L.nz[p];
+    const float wc = kB3[2] * kB3[2];
+    float sw = wc, sr = wc * L.r[p], sg = wc * L.g[p], sb = wc * L.b[p], sv = wc * wc * L.var[p];
+    for (int ky = 0; ky < 5; ++ky) {
+        const int qy = y + (ky - 2) * L.step;
+        if (qy < 0 || qy >= L.h) continue;
+        const float oy = static_cast<float>((ky - 2) * L.step);
+        for (int kx = 0; kx < 5; ++kx) {
+            const int qx = x + (kx - 2) * L.step;
+            if ((kx == 2 && ky == 2) || qx < 0 || qx >= L.w) continue;
+            const float ox = static_cast<float>((kx - 2) * L.step);
+            const std::size_t q = static_cast<std::size_t>(qy) * L.w + qx;
+            float dn = std::max(nxp * L.nx[q] + nyp * L.ny[q] + nzp * L.nz[q], 0.0f);
+            for (int k = 0; k < L.normal_pow; ++k) dn = dn * dn;
+            const float az = std::fabs(zp - L.z[q]) / (L.sigma_z * std::fabs(gxp * ox + gyp * oy) + kDepthEps);
+            const float al = std::fabs(lp - L.lum[q]) * il;
+            const float w  = kB3[kx] * kB3[ky] * dn * expNeg(-(az + al));
+            sw += w;
+            sr += w * L.r[q];
+            sg += w * L.g[q];
+            sb += w * L.b[q];
+            sv += w * w * L.var[q];
+        }
+    }
+    const float inv = 1.0f / sw;
+    L.out_r[p] = sr * inv;
+    L.out_g[p] = sg * inv;
+    L.out_b[p] = sb * inv;
+    L.out_var[p] = sv * inv * inv;
+}
+
+#if RT_X86_SIMD
+RT_TARGET_AVX2_EXACT __m256 expNeg8(__m256 x)
+{
+    x = _mm256_max_ps(x, _mm256_set1_ps(-80.0f));
+    const __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f));
+    const __m256 i = _mm256_round_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 f = _mm256_mul_ps(_mm256_sub_ps(t, i), _mm256_set1_ps(0.693147181f));
+    __m256 p = _mm256_set1_ps(1.0f / 120);
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f / 24));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f / 6));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.5f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+    const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(i), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+// filterPixel for x0, x0 + 1 ... x0 + 7 of row y, whose taps all lie inside the row.
+RT_TARGET_AVX2_EXACT void filterPixels8(const Level& L, int x0, int y)
+{
+    const std::size_t p = static_cast<std::size_t>(y) * L.w + x0;
+    const __m256 lp = _mm256_loadu_ps(L.lum + p), il = _mm256_loadu_ps(L.inv_l + p);
+    const __m256 zp = _mm256_loadu_ps(L.z + p), gxp = _mm256_loadu_ps(L.gx + p), gyp = _mm256_loadu_ps(L.gy + p);
+    const __m256 nxp = _mm256_loadu_ps(L.nx + p), nyp = _mm256_loadu_ps(L.ny + p), nzp = _mm256_loadu_ps(L.nz + p);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sigma_z = _mm256_set1_ps(L.sigma_z), depth_eps = _mm256_set1_ps(kDepthEps);
+    const __m256 wc = _mm256_set1_ps(kB3[2] * kB3[2]);
+    __m256 sw = wc;
+    __m256 sr = _mm256_mul_ps(wc, _mm256_loadu_ps(L.r + p));
+    __m256 sg = _mm256_mul_ps(wc, _mm256_loadu_ps(L.g + p));
+    __m256 sb = _mm256_mul_ps(wc, _mm256_loadu_ps(L.b + p));
+    __m256 sv = _mm256_mul_ps(_mm256_mul_ps(wc, wc), _mm256_loadu_ps(L.var + p));
+    for (int ky = 0; ky < 5; ++ky) {
+        const int qy = y + (ky - 2) * L.step;
+        if (qy < 0 || qy >= L.h) continue;
+        const __m256 oy = _mm256_set1_ps(static_cast<float>((ky - 2) * L.step));
+        for (int kx = 0; kx < 5; ++kx) {
+            if (kx == 2 && ky == 2) continue;
+            const __m256 ox = _mm256_set1_ps(static_cast<float>((kx - 2) * L.step));
+            const std::size_t q = static_cast<std::size_t>(qy) * L.w + x0 + (kx - 2) * L.step;
+            __m256 dn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nxp, _mm256_loadu_ps(L.nx + q)),
+                                                    _mm256_mul_ps(nyp, _mm256_loadu_ps(L.ny + q))),
+                                      _mm256_mul_ps(nzp, _mm256_loadu_ps(L.nz + q)));
+            dn = _mm256_max_ps(dn, zero);
+            for (int k = 0; k < L.normal_pow; ++k) dn = _mm256_mul_ps(dn, dn);
+            const __m256 grad = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(gxp, ox), _mm256_mul_ps(gyp, oy)), abs_mask);
+            const __m256 az = _mm256_div_ps(_mm256_and_ps(_mm256_sub_ps(zp, _mm256_loadu_ps(L.z + q)), abs_mask),
+                                            _mm256_add_ps(_mm256_mul_ps(sigma_z, grad), depth_eps));
+            const __m256 al = _mm256_mul_ps(_mm256_and_ps(_mm256_sub_ps(lp, _mm256_loadu_ps(L.lum + q)), abs_mask), il);
+            const __m256 e  = expNeg8(_mm256_sub_ps(zero, _mm256_add_ps(az, al)));
+            const __m256 w  = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(kB3[kx] * kB3[ky]), dn), e);
+            sw = _mm256_add_ps(sw, w);
+            sr = _mm256_add_ps(sr, _mm256_mul_ps(w, _mm256_loadu_ps(L.r + q)));
+            sg = _mm256_add_ps(sg, _mm256_mul_ps(w, _mm256_loadu_ps(L.g + q)));
+            sb = _mm256_add_ps(sb, _mm256_mul_ps(w, _mm256_loadu_ps(L.b + q)));
+            sv = _mm256_add_ps(sv, _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_loadu_ps(L.var + q)));
+        }
+    }
+    const __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), sw);
+    _mm256_storeu_ps(L.out_r + p, _mm256_mul_ps(sr, inv));
+    _mm256_storeu_ps(L.out_g + p, _mm256_mul_ps(sg, inv));
+    _mm256_storeu_ps(L.out_b + p, _mm256_mul_ps(sb, inv));
+    _mm256_storeu_ps(L.out_var + p, _mm256_mul_ps(_mm256_mul_ps(sv, inv), inv));
+}
+#endif
+
+void filterRow(const Level& L, int y, bool simd)
+{
+    int x = 0;
+#if RT_X86_SIMD
+    if (simd) {
+        // pixels whose 5 taps stay inside the row go 8 at a time, the borders one by one
+        const int lo = std::min(2 * L.step, L.w), hi = L.w - 2 * L.step;
+        for (; x < lo; ++x) filterPixel(L, x, y);
+        for (; x + 8 <= hi; x += 8) filterPixels8(L, x, y);
+    }
+#else
+    (void)simd;
+#endif
+    for (; x < L.w; ++x) filterPixel(L, x, y);
+}
+
+inline float luminance(float r, float g, float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+// Depth change per pixel: the smaller of the one-sided differences, so the step across a
+// silhouette does not widen the depth stop of the pixels next to it.
+inline float depthSlope(const float* z, std::size_t p, int i, int extent, std::ptrdiff_t stride)
+{
+    const float fwd = i + 1 < extent ? z[p + stride] - z[p] : 0.0f;
+    const float bwd = i > 0          ? z[p] - z[p - stride] : 0.0f;
+    if (i + 1 >= extent) return bwd;
+    if (i == 0) return fwd;
+    return std::fabs(fwd) < std::fabs(bwd) ? fwd : bwd;
+}
+
+} // namespace
+
+Image denoise(const Image& noisy, const RenderLayers& f, const DenoiseOptions& opt, DenoiseStats* stats)
+{
+    using clock = std::chrono::steady_clock;
+    const auto t0 = clock::now();
+    const int w = noisy.width(), h = noisy.height();
+    const std::size_t n = static_cast<std::size_t>(w) * h;
+    Image out(w, h);
+    if (n == 0 || f.width != w || f.height != h) return noisy;
+
+    // Planes: colour (optionally divided by albedo) and variance, ping-ponged between
+    // levels, plus the guides, which stay fixed.
+    std::vector<float> r[2], g[2], b[2], var[2];
+    for (int k = 0; k < 2; ++k) { r[k].resize(n); g[k].resize(n); b[k].resize(n); var[k].resize(n); }
+    std::vector<float> nx(n), ny(n), nz(n), gx(n), gy(n), lum(n), inv_l(n), demod(3 * n, 1.0f);
+    for (std::size_t p = 0; p < n; ++p) {
+        const int x = static_cast<int>(p % w), y = static_cast<int>(p / w);
+        const color& c = noisy.at(x, y);
+        if (opt.demodulate)
+            for (int k = 0; k < 3; ++k) demod[3 * p + k] = std::max(f.albedo[3 * p + k], 1e-3f);
+        const float* a = &demod[3 * p];
+        r[0][p] = static_cast<float>(c.x()) / a[0];
+        g[0][p] = static_cast<float>(c.y()) / a[1];
+        b[0][p] = static_cast<float>(c.z()) / a[2];
+        const float la = luminance(a[0], a[1], a[2]);
+        var[0][p] = f.variance[p] / (la * la);
+        nx[p] = f.normal[3 * p]; ny[p] = f.normal[3 * p + 1]; nz[p] = f.normal[3 * p + 2];
+        gx[p] = depthSlope(f.depth.data(), p, x, w, 1);
+        gy[p] = depthSlope(f.depth.data(), p, y, h, w);
+    }
+    int normal_pow = 0;
+    while (normal_pow < 10 && float(2 << normal_pow) <= opt.sigma_normal * 1.5f) ++normal_pow;
+
+    const std::size_t bands = static_cast<std::size_t>((h + kBandRows - 1) / kBandRows);
+    const bool simd = opt.simd && simdEnabled();
+    const auto t1 = clock::now();
+    int cur = 0;
+    for (int it = 0; it < opt.iterations; ++it) {
+        // luminance stop of every pixel from its variance blurred 3x3, as in SVGF
+        WorkStealingScheduler::run(opt.threads, bands, [&](std::size_t band, int) {
+            const int y0 = static_cast<int>(band) * kBandRows, y1 = std::min(y0 + kBandRows, h);
+            const float* v = var[cur].data();
+            for (int y = y0; y < y1; ++y)
+                for (int x = 0; x < w; ++x) {
+                    const std::size_t p = static_cast<std::size_t>(y) * w + x;
+                    float sum = 0.0f, sk = 0.0f;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        if (y + dy < 0 || y + dy >= h) continue;
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            if (x + dx < 0 || x + dx >= w) continue;
+                            const float k = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                            sum += k * v[p + static_cast<std::ptrdiff_t>(dy) * w + dx];
+                            sk  += k;
+                        }
+                    }
+                    lum[p]   = luminance(r[cur][p], g[cur][p], b[cur][p]);
+                    inv_l[p] = 1.0f / (opt.sigma_luminance * std::sqrt(sum / sk) + kLumEps);
+                }
+        });
+
+        Level L;
+        L.w = w; L.h = h; L.step = 1 << it; L.normal_pow = normal_pow; L.sigma_z = opt.sigma_depth;
+        L.r = r[cur].data(); L.g = g[cur].data(); L.b = b[cur].data(); L.var = var[cur].data();
+        L.lum = lum.data(); L.inv_l = inv_l.data();
+        L.nx = nx.data(); L.ny = ny.data(); L.nz = nz.data(); L.z = f.depth.data(); L.gx = gx.data(); L.gy = gy.data();
+        L.out_r = r[1 - cur].data(); L.out_g = g[1 - cur].data(); L.out_b = b[1 - cur].data();
+        L.out_var = var[1 - cur].data();
+        WorkStealingScheduler::run(opt.threads, bands, [&](std::size_t band, int) {
+            const int y0 = static_cast<int>(band) * kBandRows, y1 = std::min(y0 + kBandRows, h);
+            for (int y = y0; y < y1; ++y) filterRow(L, y, simd);
+        });
+        cur = 1 - cur;
+    }
+
+    for (std::size_t p = 0; p < n; ++p) {
+        const float* a = &demod[3 * p];
+        out.at(static_cast<int>(p % w), static_cast<int>(p / w)) =
+            color(r[cur][p] * a[0], g[cur][p] * a[1], b[cur][p] * a[2]);
+    }
+    if (stats) {
+        stats->setup_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        stats->ms       = std::chrono::duration<double, std::milli>(clock::now() - t1).count();
+    }
+    return out;
+}
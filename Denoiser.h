@@ -0,0 +1,27 @@
+#pragma once
+#include "color.h"
+#include "RenderLayers.h"
+
+struct DenoiseOptions {
+    int    iterations      = 5;      // à-trous levels; level i spaces its taps 2^i pixels apart
+    float  sigma_luminance = 4.0f;   // luminance stop, in standard deviations of the pixel mean
+    float  sigma_normal    = 128.0f; // exponent on the normals' dot product (rounded to a power of 2)
+    float  sigma_depth     = 1.0f;   // depth stop, relative to the depth change along the tap offset
+    bool   demodulate      = true;   // filter colour / albedo, so texture detail is kept as is
+    int    threads         = 0;      // 0 = one worker per hardware thread
+    bool   simd            = true;   // AVX2 kernel when simdEnabled(); the result is identical
+};
+
+struct DenoiseStats {
+    double ms = 0.0;   // filter time, without the feature and plane setup
+    double setup_ms = 0.0;
+};
+
+// Edge-avoiding à-trous wavelet filter in the style of SVGF (Schied et al. 2017), spatial
+// part only: iterations of a 5x5 B3-spline kernel whose taps are weighted down across
+// normal, depth and luminance edges, the luminance stop scaled by the filtered variance of
+// each pixel. The guides are the normal, albedo, depth and variance layers of the render.
+// Rows are split across threads; the AVX2 kernel does 8 pixels of a row at once
+// and rounds like the scalar one, so the output does not depend on either.
+Image denoise(const Image& noisy, const RenderLayers& layers, const DenoiseOptions& opt = {},
+              DenoiseStats* stats = nullptr);
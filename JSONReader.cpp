@@ -1,10 +1,133 @@
 #include "JSONReader.h"
 #include <fstream>
+#include <stdexcept>
 using json = nlohmann::json;
 
+namespace {
+// SAX consumer that hands each top-level section to its handler. Elements of array
+// sections are built into a small json value one at a time and passed on as they close;
+// sections without a handler are skipped without building anything.
+class SceneSax final : public nlohmann::json_sax<json> {
+public:
+    using Handlers = std::unordered_map<std::string, std::function<void(const json&, Scene&)>>;
+    SceneSax(const Handlers& handlers, Scene& scene, const std::string& filename)
+        : handlers_(handlers), scene_(scene), filename_(filename) {}
+
+    bool null() override                                     { return scalar(nullptr); }
+    bool boolean(bool v) override                            { return scalar(v); }
+    bool number_integer(number_integer_t v) override         { return scalar(v); }
+    bool number_unsigned(number_unsigned_t v) override       { return scalar(v); }
+    bool number_float(number_float_t v, const string_t&) override { return scalar(v); }
+    bool string(string_t& v) override                        { return scalar(std::move(v)); }
+    bool binary(binary_t& v) override                        { return scalar(json::binary(std::move(v))); }
+    bool start_object(std::size_t) override                  { return open(json::value_t::object); }
+    bool start_array(std::size_t) override                   { return open(json::value_t::array); }
+    bool end_object() override                               { return close(); }
+    bool end_array() override                                { return close(); }
+
+    bool key(string_t& k) override
+    {
+        if (!stack_.empty()) key_ = std::move(k);
+        else if (depth_ == 1 && !skip_) {
+            auto it = handlers_.find(k);
+            section_ = it == handlers_.end() ? nullptr : &it->second;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        throw std::runtime_error("Cannot parse JSON " + filename_ + ": " + ex.what());
+    }
+
+private:
+    // depth_ counts open containers: 1 inside the top-level object, 2 inside a section
+    // value, 3 inside an element of an array section.
+    bool scalar(json v)
+    {
+        if (!stack_.empty()) { append(std::move(v)); return true; }
+        if (skip_) return true;
+        if (depth_ == 1 && section_) (*section_)(v, scene_);
+        else if (depth_ == 2 && elements_) emit(std::move(v));
+        return true;
+    }
+
+    bool open(json::value_t t)
+    {
+        ++depth_;
+        if (!stack_.empty()) {
+            json& top = *stack_.back();
+            if (top.is_array()) { top.push_back(json(t)); stack_.push_back(&top.back()); }
+            else stack_.push_back(&(top[key_] = json(t)));
+            return true;
+        }
+        if (skip_) return true;
+        if (depth_ == 1) {
+            if (t != json::value_t::object) skipFrom(1);   // load() ignores non-object roots too
+        } else if (depth_ == 2) {
+            if (!section_) skipFrom(2);
+            else if (t == json::value_t::array) elements_ = true;
+            else begin(t, true);
+        } else if (depth_ == 3 && elements_) {
+            begin(t, false);
+        }
+        return true;
+    }
+
+    bool close()
+    {
+        --depth_;
+        if (!stack_.empty()) {
+            stack_.pop_back();
+            if (stack_.empty()) {
+                if (whole_) { whole_ = false; (*section_)(value_, scene_); }
+                else emit(std::move(value_));
+            }
+            return true;
+        }
+        if (skip_ && depth_ < skip_depth_) skip_ = false;
+        if (depth_ == 1) elements_ = false;
+        return true;
+    }
+
+    void skipFrom(int depth) { skip_ = true; skip_depth_ = depth; }
+    void begin(json::value_t t, bool whole)
+    {
+        value_ = json(t);
+        stack_.assign(1, &value_);
+        whole_ = whole;
+    }
+    void append(json v)
+    {
+        json& top = *stack_.back();
+        if (top.is_array()) top.push_back(std::move(v));
+        else top[key_] = std::move(v);
+    }
+    void emit(json element)
+    {
+        batch_ = json::array();
+        batch_.push_back(std::move(element));
+        (*section_)(batch_, scene_);
+    }
+
+    const Handlers& handlers_;
+    Scene& scene_;
+    const std::string& filename_;
+    const std::function<void(const json&, Scene&)>* section_ = nullptr;
+    int  depth_ = 0;
+    bool skip_ = false;
+    int  skip_depth_ = 0;
+    bool elements_ = false;   // inside an array section
+    bool whole_ = false;      // building a non-array section value
+    json value_, batch_;
+    std::vector<json*> stack_;  // containers of value_ still open
+    std::string key_;
+};
+} // namespace
+
 static vec3 makeVec3(const json& j)
 {
-    return {j.at(0).get<double>(), j.at(1).get<double>(), j.at(2).get<double>()};
+    return {j.at(0).get<real>(), j.at(1).get<real>(), j.at(2).get<real>()};
 }
 
 JSONReader::JSONReader() { registerDefaultHandlers(); }
@@ -15,6 +138,19 @@ void JSONReader::registerHandler(const std::string& section, SectionHandler hand
 }
 
 Scene JSONReader::loadFromFile(const std::string& filename) const
+{
+    std::vector<char> buffer(1 << 20);
+    std::ifstream ifs;
+    ifs.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    ifs.open(filename, std::ios::binary);
+    if (!ifs) throw std::runtime_error("Cannot open JSON: " + filename);
+    Scene scene{};
+    SceneSax sax(handlers_, scene, filename);
+    json::sax_parse(ifs, &sax);
+    return scene;
+}
+
+Scene JSONReader::loadFromFileDOM(const std::string& filename) const
 {
     std::ifstream ifs(filename);
     if (!ifs) throw std::runtime_error("Cannot open JSON: " + filename);
@@ -109,5 +245,15 @@ void JSONReader::registerDefaultHandlers()
             scene.planes.push_back(std::move(p));
         }
     });
+
+    registerHandler("meshes", [](const json& arr, Scene& scene) {
+        if (!arr.is_array()) return;
+        for (const auto& mj : arr) {
+            Mesh m;
+            if (mj.contains("name")) m.name = mj["name"].get<std::string>();
+            if (mj.contains("file")) m.file = mj["file"].get<std::string>();
+            scene.meshes.push_back(std::move(m));
+        }
+    });
     //TODO: Add support to more shapes or objects form blender
 }
\ No newline at end of file
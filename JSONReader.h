@@ -10,13 +10,20 @@
 using namespace bd;//I.E. Blender data
 class JSONReader {
 private:
+    // Called with the value of a top-level key. Array sections are streamed: the handler
+    // runs once per element with a one-element array, so it must append to the scene
+    // rather than replace. Other values are passed whole.
     using SectionHandler = std::function<void(const nlohmann::json&, Scene&)>;
     std::unordered_map<std::string, SectionHandler> handlers_;
     void registerDefaultHandlers();
 
 public:
     JSONReader();
+    // Streams the file through nlohmann's SAX parser: only the array element being read is
+    // ever held as a json value, so memory follows the Scene, not the file's DOM.
     Scene loadFromFile(const std::string& filename) const;
+    // Parses the whole file into a DOM first and then runs load(); kept for `bench json`.
+    Scene loadFromFileDOM(const std::string& filename) const;
     Scene load(const nlohmann::json& j) const;
 
     void registerHandler(const std::string& section, SectionHandler handler);
@@ -0,0 +1,493 @@
+#include "LBVH.h"
+#include "parallel.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double msSince(clock_type::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+constexpr std::uint32_t kInvalid = std::numeric_limits<std::uint32_t>::max();
+constexpr int kTreeletLeaves = 7;     // 2^7 subsets per treelet DP
+constexpr size_t kGrain = 4096;       // primitives per parallel_for task
+
+inline int clz64(std::uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    return _BitScanReverse64(&idx, x) ? 63 - static_cast<int>(idx) : 64;
+#else
+    return x ? __builtin_clzll(x) : 64;
+#endif
+}
+
+inline int ctz32(std::uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// Inserts two zero bits between the low 10 bits of x.
+inline std::uint64_t spread10(std::uint64_t x)
+{
+    x &= 0x3ff;
+    x = (x | x << 16) & 0x30000ff;
+    x = (x | x << 8)  & 0x300f00f;
+    x = (x | x << 4)  & 0x30c30c3;
+    x = (x | x << 2)  & 0x9249249;
+    return x;
+}
+
+// Inserts two zero bits between the low 21 bits of x.
+inline std::uint64_t spread21(std::uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+// p is the centroid mapped to [0,1]^3
+inline std::uint64_t mortonCode(const vec3& p, bool wide)
+{
+    const double scale = wide ? 2097151.0 : 1023.0;
+    std::uint64_t q[3];
+    for (int a = 0; a < 3; ++a)
+        q[a] = static_cast<std::uint64_t>(std::clamp(p[a] * scale, 0.0, scale));
+    if (wide) return spread21(q[0]) << 2 | spread21(q[1]) << 1 | spread21(q[2]);
+    return spread10(q[0]) << 2 | spread10(q[1]) << 1 | spread10(q[2]);
+}
+
+// LSD radix sort of (key, value) pairs, 8 bits per pass. Every chunk counts its digits,
+// the histograms are turned into per-chunk output offsets, then every chunk scatters its
+// own elements, which keeps the sort stable. Passes where all keys share the digit are skipped.
+void radixSort(std::vector<std::uint64_t>& keys, std::vector<std::uint32_t>& values,
+               int key_bits, int threads)
+{
+    const size_t n = keys.size();
+    const size_t chunks = std::max<size_t>(1, std::min<size_t>(
+        static_cast<size_t>(resolve_thread_count(threads)), n / (4 * kGrain)));
+    std::vector<std::uint64_t> keys2(n);
+    std::vector<std::uint32_t> values2(n);
+    std::vector<std::array<size_t, 256>> hist(chunks);
+    auto chunkBegin = [&](size_t c) { return n * c / chunks; };
+
+    for (int shift = 0; shift < key_bits; shift += 8) {
+        WorkStealingScheduler::run(threads, chunks, [&](size_t c, int) {
+            hist[c].fill(0);
+            for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i)
+                ++hist[c][(keys[i] >> shift) & 0xff];
+        });
+        bool trivial = false;
+        size_t running = 0;
+        for (size_t d = 0; d < 256; ++d) {
+            size_t digit_total = 0;
+            for (size_t c = 0; c < chunks; ++c) {
+                const size_t k = hist[c][d];
+                hist[c][d] = running;
+                running += k;
+                digit_total += k;
+            }
+            if (digit_total == n) trivial = true;
+        }
+        if (trivial) continue;
+        WorkStealingScheduler::run(threads, chunks, [&](size_t c, int) {
+            auto& offset = hist[c];
+            for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i) {
+                const size_t dst = offset[(keys[i] >> shift) & 0xff]++;
+                keys2[dst]   = keys[i];
+                values2[dst] = values[i];
+            }
+        });
+        keys.swap(keys2);
+        values.swap(values2);
+    }
+}
+
+// Binary radix tree over the sorted keys. Internal nodes are [0, n-1), leaf k is n-1+k,
+// the root is internal node 0.
+struct RadixTree {
+    size_t n = 0;
+    std::vector<std::uint32_t> left, right, parent;
+    std::vector<bounds3>       box;
+    std::vector<double>        cost;    // SAH cost in area units (not divided by the root area)
+    std::vector<std::uint32_t> count;   // primitives below the node
+    std::vector<std::uint32_t> flat;    // LinearBVHNode count of the subtree after collapsing
+    std::vector<std::uint32_t> prim;    // leaf k -> BVHPrimitiveInfo::index
+
+    std::uint32_t leaf(size_t k) const { return static_cast<std::uint32_t>(n - 1 + k); }
+    bool isLeaf(std::uint32_t id) const { return id >= n - 1; }
+};
+
+struct Builder {
+    const std::vector<BVHPrimitiveInfo>& info;
+    const BVHBuildOptions& opts;
+    size_t max_leaf;
+    bool   sah_leaves;
+    std::vector<std::uint64_t> keys;
+    std::vector<std::uint32_t> sorted;   // leaf k -> index into info
+    RadixTree t;
+
+    Builder(const std::vector<BVHPrimitiveInfo>& i, const BVHBuildOptions& o)
+        : info(i), opts(o),
+          max_leaf(static_cast<size_t>(std::clamp(o.max_leaf_size, 1, kBVHMaxLeafSize))),
+          sah_leaves(o.sah_leaves) {}
+
+    void computeMortonCodes()
+    {
+        const size_t n = info.size();
+        const size_t chunks = (n + kGrain - 1) / kGrain;
+        std::vector<bounds3> partial(chunks);
+        parallel_for(0, chunks, 1, [&](size_t c) {
+            bounds3 b;
+            for (size_t i = c * kGrain; i < std::min(n, (c + 1) * kGrain); ++i) b = Union(b, info[i].centroid);
+            partial[c] = b;
+        }, opts.threads);
+        bounds3 centroid_box;
+        for (const bounds3& b : partial) centroid_box = Union(centroid_box, b);
+
+        keys.resize(n);
+        sorted.resize(n);
+        parallel_for(0, n, kGrain, [&](size_t i) {
+            keys[i]   = mortonCode(centroid_box.offset(info[i].centroid), opts.morton63);
+            sorted[i] = static_cast<std::uint32_t>(i);
+        }, opts.threads);
+    }
+
+    // Length of the common prefix of keys i and j, -1 outside the array. Equal keys fall
+    // back to the indices so that every key stays unique (Karras, section 4).
+    int delta(std::int64_t i, std::int64_t j) const
+    {
+        if (j < 0 || j >= static_cast<std::int64_t>(keys.size())) return -1;
+        const std::uint64_t a = keys[static_cast<size_t>(i)], b = keys[static_cast<size_t>(j)];
+        if (a != b) return clz64(a ^ b);
+        return 64 + clz64(static_cast<std::uint64_t>(i ^ j)) - 32;
+    }
+
+    // Karras, algorithm 1: every internal node finds its range and split independently.
+    void emitHierarchy()
+    {
+        const size_t n = keys.size();
+        t.n = n;
+        t.left.assign(n - 1, kInvalid);
+        t.right.assign(n - 1, kInvalid);
+        t.parent.assign(2 * n - 1, kInvalid);
+        parallel_for(0, n - 1, kGrain, [&](size_t idx) {
+            const std::int64_t i = static_cast<std::int64_t>(idx);
+            const std::int64_t d = delta(i, i + 1) - delta(i, i - 1) > 0 ? 1 : -1;
+
+            // 范围的另一端：先指数扩张上界，再二分
+            const int d_min = delta(i, i - d);
+            std::int64_t l_max = 2;
+            while (delta(i, i + l_max * d) > d_min) l_max *= 2;
+            std::int64_t l = 0;
+            for (std::int64_t step = l_max / 2; step >= 1; step /= 2)
+                if (delta(i, i + (l + step) * d) > d_min) l += step;
+            const std::int64_t j = i + l * d;
+
+            // 分割点：范围内与 i 公共前缀比整个范围更长的最后一个位置
+            const int d_node = delta(i, j);
+            std::int64_t s = 0, step = l;
+            do {
+                step = (step + 1) / 2;
+                if (delta(i, i + (s + step) * d) > d_node) s += step;
+            } while (step > 1);
+            const std::int64_t gamma = i + s * d + std::min<std::int64_t>(d, 0);
+
+            const std::uint32_t lc = std::min(i, j) == gamma     ? t.leaf(static_cast<size_t>(gamma))
+                                                                 : static_cast<std::uint32_t>(gamma);
+            const std::uint32_t rc = std::max(i, j) == gamma + 1 ? t.leaf(static_cast<size_t>(gamma + 1))
+                                                                 : static_cast<std::uint32_t>(gamma + 1);
+            t.left[idx]  = lc;
+            t.right[idx] = rc;
+            t.parent[lc] = static_cast<std::uint32_t>(idx);
+            t.parent[rc] = static_cast<std::uint32_t>(idx);
+        }, opts.threads);
+    }
+
+    bool collapses(std::uint32_t id, double split_cost) const
+    {
+        if (t.count[id] > max_leaf) return false;
+        if (!sah_leaves) return true;
+        return kBVHIntersectCost * t.count[id] * t.box[id].surface_area() <= split_cost;
+    }
+
+    // Box, count, cost and flattened size of an internal node from its children.
+    void combine(std::uint32_t id)
+    {
+        const std::uint32_t l = t.left[id], r = t.right[id];
+        t.box[id]   = Union(t.box[l], t.box[r]);
+        t.count[id] = t.count[l] + t.count[r];
+        const double split_cost = kBVHTraversalCost * t.box[id].surface_area() + t.cost[l] + t.cost[r];
+        if (collapses(id, split_cost)) {
+            t.cost[id] = std::min(split_cost, kBVHIntersectCost * t.count[id] * t.box[id].surface_area());
+            t.flat[id] = 1;
+        } else {
+            t.cost[id] = split_cost;
+            t.flat[id] = 1 + t.flat[l] + t.flat[r];
+        }
+    }
+
+    // Karras & Aila 2013: grow a treelet of up to 7 leaves below `root` (always expanding
+    // the largest-area leaf), find the cheapest topology over those leaves by dynamic
+    // programming over subsets, and rebuild the treelet in place if it is cheaper.
+    void optimizeTreelet(std::uint32_t root)
+    {
+        std::array<std::uint32_t, kTreeletLeaves> leaves{};
+        std::array<std::uint32_t, kTreeletLeaves - 1> internals{};
+        int nl = 0, ni = 0;
+        internals[ni++] = root;
+        leaves[nl++] = t.left[root];
+        leaves[nl++] = t.right[root];
+        while (nl < kTreeletLeaves) {
+            int best = -1;
+            double best_area = -1.0;
+            for (int k = 0; k < nl; ++k) {
+                if (t.isLeaf(leaves[k])) continue;
+                const double a = t.box[leaves[k]].surface_area();
+                if (a > best_area) { best_area = a; best = k; }
+            }
+            if (best < 0) break;
+            const std::uint32_t x = leaves[best];
+            internals[ni++] = x;
+            leaves[best]   = t.left[x];
+            leaves[nl++]   = t.right[x];
+        }
+        if (nl < 3) return;
+
+        const std::uint32_t full = (1u << nl) - 1;
+        std::array<bounds3, 1u << kTreeletLeaves>       sub_box;
+        std::array<double, 1u << kTreeletLeaves>        sub_cost;
+        std::array<std::uint32_t, 1u << kTreeletLeaves> partition{};
+        for (std::uint32_t s = 1; s <= full; ++s) {
+            const int low = ctz32(s);
+            const std::uint32_t rest = s & (s - 1);
+            sub_box[s] = rest ? Union(sub_box[rest], t.box[leaves[low]]) : t.box[leaves[low]];
+            if (!rest) { sub_cost[s] = t.cost[leaves[low]]; continue; }
+            // 只枚举包含最低位的子集，左右对称的划分只算一次
+            double best = std::numeric_limits<double>::infinity();
+            const std::uint32_t low_bit = s & (~s + 1);
+            for (std::uint32_t p = (s - 1) & s; p; p = (p - 1) & s) {
+                if (!(p & low_bit)) continue;
+                const double c = sub_cost[p] + sub_cost[s ^ p];
+                if (c < best) { best = c; partition[s] = p; }
+            }
+            sub_cost[s] = kBVHTraversalCost * sub_box[s].surface_area() + best;
+        }
+        if (!(sub_cost[full] < t.cost[root] * (1.0 - 1e-9))) return;
+
+        int next = 1;
+        auto rebuild = [&](auto&& self, std::uint32_t s, std::uint32_t node) -> void {
+            const std::uint32_t side[2] = {partition[s], s ^ partition[s]};
+            std::uint32_t child[2];
+            for (int c = 0; c < 2; ++c) {
+                if (!(side[c] & (side[c] - 1))) {
+                    child[c] = leaves[ctz32(side[c])];
+                } else {
+                    child[c] = internals[next++];
+                    self(self, side[c], child[c]);
+                }
+                t.parent[child[c]] = node;
+            }
+            t.left[node]  = child[0];
+            t.right[node] = child[1];
+            combine(node);
+        };
+        rebuild(rebuild, full, root);
+    }
+
+    // One thread per leaf walks towards the root; the second thread to reach a node
+    // finishes it, the first one stops there.
+    void refit()
+    {
+        const size_t n = keys.size();
+        t.box.resize(2 * n - 1);
+        t.cost.resize(2 * n - 1);
+        t.count.resize(2 * n - 1);
+        t.flat.resize(2 * n - 1);
+        t.prim.resize(n);
+        parallel_for(0, n, kGrain, [&](size_t k) {
+            const std::uint32_t id = t.leaf(k);
+            t.prim[k]   = info[sorted[k]].index;
+            t.box[id]   = info[sorted[k]].box;
+            t.count[id] = 1;
+            t.cost[id]  = kBVHIntersectCost * t.box[id].surface_area();
+            t.flat[id]  = 1;
+        }, opts.threads);
+
+        std::unique_ptr<std::atomic<std::uint32_t>[]> visits(new std::atomic<std::uint32_t>[n - 1]);
+        for (size_t i = 0; i + 1 < n; ++i) visits[i].store(0, std::memory_order_relaxed);
+        parallel_for(0, n, kGrain, [&](size_t k) {
+            std::uint32_t node = t.parent[t.leaf(k)];
+            while (node != kInvalid) {
+                if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) return;
+                combine(node);
+                if (opts.treelets && t.count[node] >= static_cast<std::uint32_t>(kTreeletLeaves))
+                    optimizeTreelet(node);
+                node = t.parent[node];
+            }
+        }, opts.threads);
+    }
+
+    struct Job { std::uint32_t id, pos, prim; int depth; };
+
+    // Writes the subtree of job.id at nodes[job.pos]; its primitives go to order[job.prim...].
+    // Returns the depth reached.
+    int flattenSubtree(const Job& job, std::vector<LinearBVHNode>& nodes, std::vector<std::uint32_t>& order) const
+    {
+        int max_depth = job.depth;
+        std::vector<Job> stack{job};
+        while (!stack.empty()) {
+            Job j = stack.back(); stack.pop_back();
+            max_depth = std::max(max_depth, j.depth);
+            Job kids[2];
+            if (writeNode(j, nodes, order, kids)) {
+                stack.push_back(kids[1]);
+                stack.push_back(kids[0]);
+            }
+        }
+        return max_depth;
+    }
+
+    // Emits one LinearBVHNode. Returns false for leaves; for interior nodes `kids` receives
+    // the two child jobs, nearer-along-axis child first.
+    bool writeNode(const Job& j, std::vector<LinearBVHNode>& nodes, std::vector<std::uint32_t>& order,
+                   Job kids[2]) const
+    {
+        LinearBVHNode ln{};
+        ln.setBounds(t.box[j.id]);
+        if (t.isLeaf(j.id) || t.flat[j.id] == 1) {
+            // 折叠成叶子：按深度优先顺序收集子树中的图元
+            std::uint32_t written = 0;
+            std::uint32_t pending[2 * kBVHMaxLeafSize];
+            int sp = 0;
+            pending[sp++] = j.id;
+            while (sp) {
+                const std::uint32_t id = pending[--sp];
+                if (t.isLeaf(id)) {
+                    order[j.prim + written++] = t.prim[id - (t.n - 1)];
+                } else {
+                    pending[sp++] = t.right[id];
+                    pending[sp++] = t.left[id];
+                }
+            }
+            ln.offset      = j.prim;
+            ln.nPrimitives = static_cast<std::uint16_t>(written);
+            nodes[j.pos] = ln;
+            return false;
+        }
+
+        std::uint32_t a = t.left[j.id], b = t.right[j.id];
+        const vec3 sep = t.box[b].Centroid() - t.box[a].Centroid();
+        int axis = 0;
+        for (int k = 1; k < 3; ++k)
+            if (std::abs(sep[k]) > std::abs(sep[axis])) axis = k;
+        if (sep[axis] < 0) std::swap(a, b);
+
+        kids[0] = {a, j.pos + 1,              j.prim,              j.depth + 1};
+        kids[1] = {b, j.pos + 1 + t.flat[a],  j.prim + t.count[a], j.depth + 1};
+        ln.axis   = static_cast<std::uint8_t>(axis);
+        ln.offset = kids[1].pos;
+        nodes[j.pos] = ln;
+        return true;
+    }
+
+    // Subtree sizes are known from the refit, so every subtree knows where it goes: the top
+    // of the tree is expanded serially until there are enough subtrees, which are then
+    // written in parallel.
+    int flatten(std::vector<LinearBVHNode>& nodes, std::vector<std::uint32_t>& order) const
+    {
+        nodes.resize(t.flat[0]);
+        order.resize(info.size());
+        const size_t target = 16 * static_cast<size_t>(resolve_thread_count(opts.threads));
+        std::vector<Job> frontier{{0u, 0u, 0u, 1}};
+        std::vector<Job> next;
+        int max_depth = 1;
+        while (frontier.size() < target) {
+            next.clear();
+            bool expanded = false;
+            for (const Job& j : frontier) {
+                Job kids[2];
+                if (t.flat[j.id] > 1 && writeNode(j, nodes, order, kids)) {
+                    next.push_back(kids[0]);
+                    next.push_back(kids[1]);
+                    expanded = true;
+                } else {
+                    next.push_back(j);
+                }
+            }
+            frontier.swap(next);
+            if (!expanded) break;
+        }
+        std::vector<int> depth(frontier.size());
+        parallel_for(0, frontier.size(), 1, [&](size_t k) {
+            depth[k] = flattenSubtree(frontier[k], nodes, order);
+        }, opts.threads);
+        for (int d : depth) max_depth = std::max(max_depth, d);
+        return max_depth;
+    }
+};
+} // namespace
+
+LinearBVH buildLBVH(const std::vector<BVHPrimitiveInfo>& info, const BVHBuildOptions& opts,
+                    BVHBuildTimes* times)
+{
+    LinearBVH res;
+    if (info.empty()) return res;
+    if (info.size() == 1) {
+        LinearBVHNode ln{};
+        ln.setBounds(info[0].box);
+        ln.offset = 0;
+        ln.nPrimitives = 1;
+        res.nodes.push_back(ln);
+        res.order.push_back(info[0].index);
+        res.bounds = info[0].box;
+        res.depth = 1;
+        return res;
+    }
+
+    BVHBuildTimes local;
+    BVHBuildTimes& tm = times ? *times : local;
+    Builder b(info, opts);
+
+    auto t0 = clock_type::now();
+    b.computeMortonCodes();
+    tm.morton_ms += msSince(t0);
+
+    t0 = clock_type::now();
+    radixSort(b.keys, b.sorted, opts.morton63 ? 63 : 30, opts.threads);
+    tm.sort_ms += msSince(t0);
+
+    t0 = clock_type::now();
+    b.emitHierarchy();
+    tm.emit_ms += msSince(t0);
+
+    t0 = clock_type::now();
+    b.refit();
+    tm.refit_ms += msSince(t0);
+
+    t0 = clock_type::now();
+    res.depth  = b.flatten(res.nodes, res.order);
+    res.bounds = b.t.box[0];
+    tm.flatten_ms += msSince(t0);
+    return res;
+}
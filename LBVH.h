@@ -0,0 +1,17 @@
+#pragma once
+#include "BVH.h"
+#include <cstdint>
+#include <vector>
+
+// Linear BVH builder (Karras 2012, "Maximizing Parallelism in the Construction of BVHs,
+// Octrees, and k-d Trees"). Every stage is a flat loop over primitives or nodes:
+//   1. Morton code of each centroid inside the centroid bounds (30 or 63 bits)
+//   2. parallel LSD radix sort of (code, primitive) pairs
+//   3. hierarchy emit: each internal node finds its own key range and split, independently
+//   4. bottom-up refit of boxes and SAH costs, one thread per leaf, atomics at the joins
+//   5. optional treelet restructuring (Karras & Aila 2013) during the refit
+//   6. depth-first flatten into LinearBVHNode, collapsing small subtrees into leaves
+// `info` needs box and centroid per primitive. Uses opts.max_leaf_size, opts.sah_leaves,
+// opts.morton63, opts.treelets and opts.threads; stage times are added to `times`.
+LinearBVH buildLBVH(const std::vector<BVHPrimitiveInfo>& info, const BVHBuildOptions& opts,
+                     BVHBuildTimes* times = nullptr);
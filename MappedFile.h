@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return ok_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    // Drops the whole pages inside [p, p + n) from the working set once they are parsed,
+    // so resident memory does not grow by the file size. Touching them again refaults
+    // them from the page cache.
+    void release(const char* p, size_t n) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool ok_ = false;
+#if defined(_WIN32)
+    void* file_ = nullptr;     // HANDLE
+    void* mapping_ = nullptr;  // HANDLE
+#else
+    int fd_ = -1;
+#endif
+};
@@ -0,0 +1,361 @@
+#include "OBJLoader.h"
+#include "MappedFile.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double msSince(clock_type::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+// ---------------------------------------------------------------- scanning
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char* skipBlanks(const char* p, const char* e)
+{
+    while (p < e && isBlank(*p)) ++p;
+    return p;
+}
+
+// End of the line starting at p: the '\n' (or e), with a trailing comment cut off.
+inline const char* lineEnd(const char* p, const char* e, const char*& next)
+{
+    const void* nl = std::memchr(p, '\n', static_cast<size_t>(e - p));
+    const char* le = nl ? static_cast<const char*>(nl) : e;
+    next = nl ? le + 1 : e;
+    const void* hash = std::memchr(p, '#', static_cast<size_t>(le - p));
+    return hash ? static_cast<const char*>(hash) : le;
+}
+
+constexpr double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// [sign] digits [. digits] [e [sign] digits]. Mantissas below 2^53 and powers of ten up
+// to 1e22 are exact doubles, so the usual OBJ numbers (< 16 significant digits) round
+// exactly like strtod; longer ones may be off by an ulp.
+inline const char* parseDouble(const char* p, const char* e, double& out)
+{
+    bool neg = false;
+    if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    std::uint64_t mant = 0;
+    int digits = 0, exp10 = 0;
+    for (; p < e && isDigit(*p); ++p) {
+        if (digits < 19) { mant = mant * 10 + static_cast<unsigned>(*p - '0'); if (mant) ++digits; }
+        else ++exp10;
+    }
+    if (p < e && *p == '.') {
+        for (++p; p < e && isDigit(*p); ++p) {
+            if (digits < 19) { mant = mant * 10 + static_cast<unsigned>(*p - '0'); if (mant) ++digits; --exp10; }
+        }
+    }
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool eneg = false;
+        if (p < e && (*p == '-' || *p == '+')) eneg = *p++ == '-';
+        int x = 0;
+        for (; p < e && isDigit(*p); ++p) x = std::min(x * 10 + (*p - '0'), 9999);
+        exp10 += eneg ? -x : x;
+    }
+    double v = static_cast<double>(mant);
+    if (exp10 < 0) v = -exp10 <= 22 ? v / kPow10[-exp10] : v * std::pow(10.0, exp10);
+    else if (exp10 > 0) v = exp10 <= 22 ? v * kPow10[exp10] : v * std::pow(10.0, exp10);
+    out = neg ? -v : v;
+    return p;
+}
+
+// [sign] digits. More than 18 significant digits would overflow `long`: the digits are
+// still consumed, but the value is marked not ok.
+inline const char* parseInt(const char* p, const char* e, long& out, bool& ok)
+{
+    bool neg = false;
+    if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    long v = 0;
+    int digits = 0;
+    ok = p < e && isDigit(*p);
+    for (; p < e && isDigit(*p); ++p) {
+        if (digits < 18) { v = v * 10 + (*p - '0'); if (v) ++digits; }
+        else ok = false;
+    }
+    out = neg ? -v : v;
+    return p;
+}
+
+enum class Record { None, Vertex, Normal, Texcoord, Face };
+
+// Classifies the line at [p, le) and returns the first character after the keyword.
+inline Record classify(const char*& p, const char* le)
+{
+    p = skipBlanks(p, le);
+    if (le - p < 2) return Record::None;
+    Record r = Record::None;
+    int len = 1;
+    if (p[0] == 'v') {
+        if (isBlank(p[1])) r = Record::Vertex;
+        else if (le - p >= 3 && isBlank(p[2])) {
+            if (p[1] == 'n') { r = Record::Normal;   len = 2; }
+            if (p[1] == 't') { r = Record::Texcoord; len = 2; }
+        }
+    } else if (p[0] == 'f' && isBlank(p[1])) {
+        r = Record::Face;
+    }
+    p += len;
+    return r;
+}
+
+// Number of vertices of a face, and whether every one of them has a texcoord / normal.
+inline size_t scanFace(const char* p, const char* le, bool& has_t, bool& has_n)
+{
+    size_t n = 0;
+    while (true) {
+        p = skipBlanks(p, le);
+        if (p >= le) return n;
+        ++n;
+        const char* tok = p;
+        while (p < le && !isBlank(*p)) ++p;
+        const char* s1 = static_cast<const char*>(std::memchr(tok, '/', static_cast<size_t>(p - tok)));
+        const char* s2 = s1 ? static_cast<const char*>(std::memchr(s1 + 1, '/', static_cast<size_t>(p - s1 - 1))) : nullptr;
+        has_t = has_t && s1 && s1 + 1 < p && s1[1] != '/';
+        has_n = has_n && s2 && s2 + 1 < p;
+    }
+}
+
+// One slice of the file, cut at line boundaries. The counts come from the first pass,
+// the *0 offsets (prefix sums over the chunks before) tell the second pass where to write.
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end   = nullptr;
+    size_t v = 0, vn = 0, vt = 0, tris = 0;
+    size_t v0 = 0, vn0 = 0, vt0 = 0, tri0 = 0;
+    bool   all_t = true, all_n = true;  // every face has texcoord / normal indices
+    size_t bad = 0;   // face indices that were missing or out of range
+};
+
+void countChunk(Chunk& c)
+{
+    for (const char* p = c.begin; p < c.end;) {
+        const char* next;
+        const char* le = lineEnd(p, c.end, next);
+        switch (classify(p, le)) {
+        case Record::Vertex:   ++c.v;  break;
+        case Record::Normal:   ++c.vn; break;
+        case Record::Texcoord: ++c.vt; break;
+        case Record::Face: {
+            bool has_t = true, has_n = true;
+            const size_t k = scanFace(p, le, has_t, has_n);
+            if (k < 3) break;
+            c.tris += k - 2;
+            c.all_t = c.all_t && has_t;
+            c.all_n = c.all_n && has_n;
+            break;
+        }
+        default: break;
+        }
+        p = next;
+    }
+}
+
+void parseChunk(Chunk& c, OBJData& out, size_t nv, size_t nt, size_t nn)
+{
+    size_t v = c.v0, vn = c.vn0, vt = c.vt0, tri = c.tri0;
+    const bool with_t = !out.faceTexs.empty(), with_n = !out.faceNorms.empty();
+    std::vector<int> fv, ft, fn;
+    // OBJ 索引从 1 开始，负数表示相对于当前已读到的最后一个元素；0 不是合法索引
+    auto resolve = [&](long i, size_t so_far, size_t total, bool ok) {
+        long r = i > 0 ? i - 1 : static_cast<long>(so_far) + i;
+        if (!ok || i == 0 || r < 0 || static_cast<size_t>(r) >= total) { ++c.bad; return 0; }
+        return static_cast<int>(r);
+    };
+    for (const char* p = c.begin; p < c.end;) {
+        const char* next;
+        const char* le = lineEnd(p, c.end, next);
+        switch (classify(p, le)) {
+        case Record::Vertex: {
+            double x[3] = {0, 0, 0};
+            for (double& d : x) p = parseDouble(skipBlanks(p, le), le, d);
+            out.verts[v++] = point3(x[0], x[1], x[2]);
+            break;
+        }
+        case Record::Normal: {
+            double x[3] = {0, 0, 0};
+            for (double& d : x) p = parseDouble(skipBlanks(p, le), le, d);
+            out.norms[vn++] = vec3(x[0], x[1], x[2]);
+            break;
+        }
+        case Record::Texcoord: {
+            double uv[2] = {0, 0};
+            for (double& d : uv) p = parseDouble(skipBlanks(p, le), le, d);
+            out.tex[vt++] = point2(static_cast<float>(uv[0]), 1.0f - static_cast<float>(uv[1]));
+            break;
+        }
+        case Record::Face: {
+            fv.clear(); ft.clear(); fn.clear();
+            while (true) {
+                p = skipBlanks(p, le);
+                if (p >= le) break;
+                // v, v/t, v//n or v/t/n
+                long i = 0, t = 0, n = 0;
+                bool ok_v = false, ok_t = false, ok_n = false;
+                p = parseInt(p, le, i, ok_v);
+                if (p < le && *p == '/') {
+                    ++p;
+                    if (p < le && *p != '/') p = parseInt(p, le, t, ok_t);
+                    if (p < le && *p == '/') p = parseInt(p + 1, le, n, ok_n);
+                }
+                while (p < le && !isBlank(*p)) ++p;
+                fv.push_back(resolve(i, v, nv, ok_v));
+                if (with_t) ft.push_back(resolve(t, vt, nt, ok_t));
+                if (with_n) fn.push_back(resolve(n, vn, nn, ok_n));
+            }
+            if (fv.size() < 3) break;
+            // 多边形按扇形三角化：(0, k, k+1)
+            for (size_t k = 1; k + 1 < fv.size(); ++k, ++tri) {
+                const size_t o = 3 * tri;
+                out.faceVerts[o] = fv[0]; out.faceVerts[o + 1] = fv[k]; out.faceVerts[o + 2] = fv[k + 1];
+                if (with_t) { out.faceTexs[o]  = ft[0]; out.faceTexs[o + 1]  = ft[k]; out.faceTexs[o + 2]  = ft[k + 1]; }
+                if (with_n) { out.faceNorms[o] = fn[0]; out.faceNorms[o + 1] = fn[k]; out.faceNorms[o + 2] = fn[k + 1]; }
+            }
+            break;
+        }
+        default: break;
+        }
+        p = next;
+    }
+}
+} // namespace
+
+bool loadOBJ(const std::string& filename, OBJData& out, int threads, OBJLoadStats* stats)
+{
+    OBJLoadStats local;
+    OBJLoadStats& st = stats ? *stats : local;
+    const auto t_start = clock_type::now();
+    out = OBJData{};
+
+    auto t0 = clock_type::now();
+    MappedFile file(filename);
+    if (!file.ok()) return false;
+    st.bytes = file.size();
+    st.map_ms = msSince(t0);
+    if (file.size() == 0) { st.total_ms = msSince(t_start); return true; }
+
+    // 按 1 MB 切块，每块的起点挪到下一个换行之后
+    constexpr size_t kChunkBytes = size_t(1) << 20;
+    const char* data = file.data();
+    const char* end  = data + file.size();
+    const size_t n_chunks = std::max<size_t>(1, file.size() / kChunkBytes);
+    std::vector<Chunk> chunks;
+    chunks.reserve(n_chunks);
+    const char* begin = data;
+    for (size_t k = 1; k <= n_chunks && begin < end; ++k) {
+        const char* cut = k == n_chunks ? end : data + file.size() * k / n_chunks;
+        if (cut < begin) continue;
+        if (cut < end) {
+            const void* nl = std::memchr(cut, '\n', static_cast<size_t>(end - cut));
+            cut = nl ? static_cast<const char*>(nl) + 1 : end;
+        }
+        Chunk c;
+        c.begin = begin;
+        c.end   = cut;
+        chunks.push_back(c);
+        begin = cut;
+    }
+    st.chunks = chunks.size();
+
+    t0 = clock_type::now();
+    parallel_for(0, chunks.size(), 1, [&](size_t k) {
+        countChunk(chunks[k]);
+        file.release(chunks[k].begin, static_cast<size_t>(chunks[k].end - chunks[k].begin));
+    }, threads);
+    size_t nv = 0, nn = 0, nt = 0, ntri = 0;
+    bool all_t = true, all_n = true;
+    for (Chunk& c : chunks) {
+        c.v0 = nv; c.vn0 = nn; c.vt0 = nt; c.tri0 = ntri;
+        nv += c.v; nn += c.vn; nt += c.vt; ntri += c.tris;
+        all_t = all_t && c.all_t;
+        all_n = all_n && c.all_n;
+    }
+    out.verts.resize(nv);
+    out.norms.resize(nn);
+    out.tex.resize(nt);
+    out.faceVerts.resize(3 * ntri);
+    // 只有每个面都带纹理坐标 / 法线时才分配对应的索引数组
+    if (all_t && nt > 0) out.faceTexs.resize(3 * ntri);
+    if (all_n && nn > 0) out.faceNorms.resize(3 * ntri);
+    st.count_ms = msSince(t0);
+
+    t0 = clock_type::now();
+    parallel_for(0, chunks.size(), 1, [&](size_t k) {
+        parseChunk(chunks[k], out, nv, nt, nn);
+        file.release(chunks[k].begin, static_cast<size_t>(chunks[k].end - chunks[k].begin));
+    }, threads);
+    size_t bad = 0;
+    for (const Chunk& c : chunks) bad += c.bad;
+    if (bad) std::cerr << "Warning: " << bad << " invalid face indices in " << filename << " (set to 0)\n";
+    st.parse_ms = msSince(t0);
+    st.total_ms = msSince(t_start);
+    return true;
+}
+
+bool loadOBJLegacy(const std::string& filename, OBJData& out)
+{
+    out = OBJData{};
+    std::ifstream in;
+    in.open(filename);
+    if(in.fail()) return false;
+    std::string line;
+    while(!in.eof())
+    {
+        std::getline(in, line);
+        std::istringstream iss(line);
+        char trash;
+        if(!line.compare(0, 2, "v "))
+        {
+            iss >> trash;
+            point3 v{0, 0, 0};
+            for(int i : {0, 1, 2}) iss >> v[i];
+            out.verts.push_back(v);
+        }
+        else if(!line.compare(0, 3, "vn "))
+        {
+            iss >> trash >> trash;
+            point3 v{0, 0, 0};
+            for(int i : {0, 1, 2}) iss >> v[i];
+            out.norms.push_back(v);
+        }
+        else if(!line.compare(0, 3, "vt "))
+        {
+            iss >> trash >> trash;
+            point2 v{};
+            for(int i : {0, 1}) iss >> v[i];
+            out.tex.push_back({v[0], 1 - v[1]});
+        }
+        else if(!line.compare(0, 2, "f "))
+        {
+            int v, t, n, count{0};
+            iss >> trash;
+            while(iss >> v >> trash >> t >> trash >> n)
+            {
+                out.faceVerts.push_back(--v);
+                out.faceTexs.push_back(--t);
+                out.faceNorms.push_back(--n);
+                ++count;
+            }
+            if (3!=count)
+            {
+                std::cerr << "Error: the obj file is supposed to be triangulated" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
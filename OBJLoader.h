@@ -0,0 +1,35 @@
+#pragma once
+#include "vec3.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Geometry of a Wavefront OBJ file. The face arrays hold three zero-based indices per
+// triangle (polygons are fan-triangulated). faceTexs / faceNorms are parallel to
+// faceVerts, or empty when not every face references a texcoord / normal.
+struct OBJData {
+    std::vector<point3> verts;
+    std::vector<vec3>   norms;
+    std::vector<point2> tex;     // v is flipped (1 - v), as the TGA textures expect
+    std::vector<int>    faceVerts;
+    std::vector<int>    faceTexs;
+    std::vector<int>    faceNorms;
+};
+
+struct OBJLoadStats {
+    size_t bytes  = 0;
+    size_t chunks = 0;
+    double map_ms = 0.0, count_ms = 0.0, parse_ms = 0.0, total_ms = 0.0;
+    double mb_per_s() const { return total_ms > 0.0 ? bytes / 1048576.0 / (total_ms * 1e-3) : 0.0; }
+};
+
+// Memory-maps the file, cuts it into chunks at line boundaries and parses them in
+// parallel in two passes: the first counts the records of each chunk so that every
+// output array is allocated once at its final size, the second parses numbers with a
+// hand-written scanner straight into each chunk's slice. Negative (relative) indices are
+// resolved. Returns false if the file cannot be opened.
+bool loadOBJ(const std::string& filename, OBJData& out, int threads = 0, OBJLoadStats* stats = nullptr);
+
+// The original std::getline / istringstream parser (triangulated "f v/t/n" faces only),
+// kept for comparison in `bench obj`.
+bool loadOBJLegacy(const std::string& filename, OBJData& out);
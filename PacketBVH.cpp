@@ -0,0 +1,140 @@
+// Packet traversal of the flattened binary BVH (BVH::intersect_packet).
+#include "PacketBVH.h"
+#include "simd.h"
+#include <algorithm>
+#if RT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+// Per-ray slab test of the rays in `mask`, same arithmetic as LinearBVHNode::intersect.
+unsigned packetIntersectScalar(const LinearBVHNode& n, const RayPacket& p, const int neg[3],
+                               const real* tmax, unsigned mask)
+{
+    unsigned hit = 0;
+    for (int k = 0; k < p.size; ++k) {
+        if (!(mask >> k & 1)) continue;
+        real t0 = p.tmin[k], t1 = tmax[k];
+        for (int a = 0; a < 3; ++a) {
+            const real lo = neg[a] ? n.bmax[a] : n.bmin[a];
+            const real hi = neg[a] ? n.bmin[a] : n.bmax[a];
+            const real s0 = (lo - p.o[a][k]) * p.inv[a][k];
+            const real s1 = (hi - p.o[a][k]) * p.inv[a][k] * kBoxExitScale;
+            if (s0 > t0) t0 = s0;
+            if (s1 < t1) t1 = s1;
+        }
+        if (t0 <= t1) hit |= 1u << k;
+    }
+    return hit;
+}
+
+#if RT_X86_SIMD && SOFTRT_FLOAT
+// Eight lanes at a time; lanes outside `mask` are computed and then dropped.
+RT_TARGET_AVX2 unsigned packetIntersectAVX2(const LinearBVHNode& n, const RayPacket& p, const int neg[3],
+                                            const real* tmax, unsigned mask)
+{
+    unsigned hit = 0;
+    const __m256 scale = _mm256_set1_ps(kBoxExitScale);
+    for (int g = 0; g < p.size; g += 8) {
+        if (!(mask >> g & 0xff)) continue;
+        __m256 t0 = _mm256_load_ps(p.tmin + g);
+        __m256 t1 = _mm256_loadu_ps(tmax + g);
+        for (int a = 0; a < 3; ++a) {
+            const __m256 lo  = _mm256_set1_ps(neg[a] ? n.bmax[a] : n.bmin[a]);
+            const __m256 hi  = _mm256_set1_ps(neg[a] ? n.bmin[a] : n.bmax[a]);
+            const __m256 o   = _mm256_load_ps(p.o[a] + g);
+            const __m256 inv = _mm256_load_ps(p.inv[a] + g);
+            t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(lo, o), inv), t0);
+            t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(hi, o), inv), scale), t1);
+        }
+        hit |= static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ))) << g;
+    }
+    return hit & mask;
+}
+#elif RT_X86_SIMD
+// Four lanes at a time; lanes outside `mask` are computed and then dropped.
+RT_TARGET_AVX2 unsigned packetIntersectAVX2(const LinearBVHNode& n, const RayPacket& p, const int neg[3],
+                                            const real* tmax, unsigned mask)
+{
+    unsigned hit = 0;
+    for (int g = 0; g < p.size; g += 4) {
+        if (!(mask >> g & 0xf)) continue;
+        __m256d t0 = _mm256_load_pd(p.tmin + g);
+        __m256d t1 = _mm256_loadu_pd(tmax + g);
+        for (int a = 0; a < 3; ++a) {
+            const __m256d lo  = _mm256_set1_pd(neg[a] ? n.bmax[a] : n.bmin[a]);
+            const __m256d hi  = _mm256_set1_pd(neg[a] ? n.bmin[a] : n.bmax[a]);
+            const __m256d o   = _mm256_load_pd(p.o[a] + g);
+            const __m256d inv = _mm256_load_pd(p.inv[a] + g);
+            t0 = _mm256_max_pd(_mm256_mul_pd(_mm256_sub_pd(lo, o), inv), t0);
+            t1 = _mm256_min_pd(_mm256_mul_pd(_mm256_sub_pd(hi, o), inv), t1);
+        }
+        hit |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(t0, t1, _CMP_LE_OQ))) << g;
+    }
+    return hit & mask;
+}
+#else
+unsigned packetIntersectAVX2(const LinearBVHNode& n, const RayPacket& p, const int neg[3],
+                             const real* tmax, unsigned mask)
+{
+    return packetIntersectScalar(n, p, neg, tmax, mask);
+}
+#endif
+} // namespace
+
+unsigned packetIntersect(const LinearBVHNode& n, const RayPacket& p, const int neg[3],
+                         const real* tmax, unsigned mask, bool simd)
+{
+    return simd ? packetIntersectAVX2(n, p, neg, tmax, mask) : packetIntersectScalar(n, p, neg, tmax, mask);
+}
+
+std::uint32_t BVH::intersect_packet_with_stats(const RayPacket& packet, hit_info* hits,
+                                               BVHTraversalStats* stats) const
+{
+    if (nodes.empty() || !packet.active) return 0;
+    // 方向不一致（已发散）的包没有统一的远近顺序：退回逐条光线追踪
+    if (!packet.coherent()) return hittable::intersect_packet(packet, hits);
+
+    const bool simd = simdEnabled();
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, std::uint32_t mask, real* tmax) {
+        std::uint32_t hit = 0;
+        const std::uint32_t end = first + count;
+        for (std::uint32_t i = first, n; i < end; i += n) {
+            if (!soa.empty() && soa.kind(i) != PrimitiveSoA::Other) {
+                // 同类图元连成一段（球体走批量内核），逐条光线测试
+                n = soa.run(i, end);
+                for (int k = 0; k < packet.size; ++k) {
+                    if (!(mask >> k & 1)) continue;
+                    interval t(packet.tmin[k], tmax[k]);
+                    if (soa.intersect_run(i, n, packet.get(k), t, hits[k], simd)) {
+                        tmax[k] = hits[k].t;
+                        hit |= 1u << k;
+                    }
+                }
+                continue;
+            }
+            n = 1;
+            const hittable* prim = primitives[i];
+            if (prim->traces_packets()) {
+                // 聚合体（如实例的顶层 BVH）：整包交给它自己的包遍历
+                RayPacket sub = packet;
+                sub.active = mask;
+                std::copy(tmax, tmax + kMaxPacketSize, sub.tmax);
+                const std::uint32_t h = prim->intersect_packet(sub, hits);
+                for (int k = 0; k < packet.size; ++k)
+                    if (h >> k & 1) tmax[k] = hits[k].t;
+                hit |= h;
+                continue;
+            }
+            for (int k = 0; k < packet.size; ++k) {
+                if (!(mask >> k & 1)) continue;
+                if (prim->intersect(packet.get(k), interval(packet.tmin[k], tmax[k]), hits[k])) {
+                    tmax[k] = hits[k].t;
+                    hit |= 1u << k;
+                }
+            }
+        }
+        return hit;
+    };
+    return traversePacketBVH(nodes.data(), depth, packet, leaf, stats);
+}
@@ -0,0 +1,124 @@
+#pragma once
+// Packet traversal of a flattened binary BVH, shared by BVH::intersect_packet and the top level
+// of instance_bvh.
+#include "BVH.h"
+#include "packet.h"
+#include "simd.h"
+#include <algorithm>
+#include <vector>
+
+// Bounds of origin and inverse direction over the active rays of a coherent packet.
+struct PacketInterval {
+    real o_lo[3], o_hi[3];
+    real inv_lo[3], inv_hi[3];
+    int  neg[3];
+    real t_lo;   // smallest tmin
+};
+
+inline PacketInterval packetInterval(const RayPacket& p)
+{
+    PacketInterval ia;
+    ia.t_lo = infinity;
+    for (int a = 0; a < 3; ++a) {
+        ia.o_lo[a] = ia.inv_lo[a] = infinity;
+        ia.o_hi[a] = ia.inv_hi[a] = -infinity;
+    }
+    for (int k = 0; k < p.size; ++k) {
+        if (!(p.active >> k & 1)) continue;
+        for (int a = 0; a < 3; ++a) {
+            ia.o_lo[a]   = std::min(ia.o_lo[a], p.o[a][k]);
+            ia.o_hi[a]   = std::max(ia.o_hi[a], p.o[a][k]);
+            ia.inv_lo[a] = std::min(ia.inv_lo[a], p.inv[a][k]);
+            ia.inv_hi[a] = std::max(ia.inv_hi[a], p.inv[a][k]);
+        }
+        ia.t_lo = std::min(ia.t_lo, p.tmin[k]);
+    }
+    for (int a = 0; a < 3; ++a) ia.neg[a] = ia.inv_hi[a] < 0;
+    return ia;
+}
+
+// Whole-packet slab test by interval arithmetic: every ray's entry distance is at least
+// the smallest corner product on the near plane and its exit at most the largest on the
+// far plane. Rounding is monotonic, so the bounds also hold for the rounded per-ray values
+// and the test never culls a node one of the rays would have entered.
+inline bool packetIntervalHit(const LinearBVHNode& n, const PacketInterval& ia, real t_hi)
+{
+    auto min4 = [](real a, real b, real c, real d) { return std::min(std::min(a, b), std::min(c, d)); };
+    auto max4 = [](real a, real b, real c, real d) { return std::max(std::max(a, b), std::max(c, d)); };
+    real t0 = ia.t_lo, t1 = t_hi;
+    for (int a = 0; a < 3; ++a) {
+        const real lo = ia.neg[a] ? n.bmax[a] : n.bmin[a];
+        const real hi = ia.neg[a] ? n.bmin[a] : n.bmax[a];
+        t0 = std::max(t0, min4((lo - ia.o_hi[a]) * ia.inv_lo[a], (lo - ia.o_hi[a]) * ia.inv_hi[a],
+                               (lo - ia.o_lo[a]) * ia.inv_lo[a], (lo - ia.o_lo[a]) * ia.inv_hi[a]));
+        t1 = std::min(t1, max4((hi - ia.o_hi[a]) * ia.inv_lo[a], (hi - ia.o_hi[a]) * ia.inv_hi[a],
+                               (hi - ia.o_lo[a]) * ia.inv_lo[a], (hi - ia.o_lo[a]) * ia.inv_hi[a]) * kBoxExitScale);
+        if (t0 > t1) return false;
+    }
+    return true;
+}
+
+// Per-ray slab test of the rays in `mask` against one node (AVX2 when `simd`), same
+// arithmetic as LinearBVHNode::intersect. Returns the rays that enter it.
+unsigned packetIntersect(const LinearBVHNode& n, const RayPacket& p, const int neg[3],
+                         const real* tmax, unsigned mask, bool simd);
+
+// One traversal of the binary tree for a coherent packet: nodes are first culled for all
+// rays at once by interval arithmetic, then tested per ray. `leaf(first, count, mask, tmax)`
+// tests the rays in `mask` against a primitive range, lowers tmax[k] for every ray k that
+// hits and returns the mask of those rays. Returns the mask of rays that hit anything.
+template <typename LeafFn>
+std::uint32_t traversePacketBVH(const LinearBVHNode* nodes, int depth, const RayPacket& packet,
+                                LeafFn&& leaf, BVHTraversalStats* stats = nullptr)
+{
+    const PacketInterval ia = packetInterval(packet);
+    alignas(32) real tmax[kMaxPacketSize];
+    std::copy(packet.tmax, packet.tmax + kMaxPacketSize, tmax);
+    auto activeMax = [&] {
+        real m = -infinity;
+        for (int k = 0; k < packet.size; ++k)
+            if (packet.active >> k & 1) m = std::max(m, tmax[k]);
+        return m;
+    };
+    real t_hi = activeMax();
+    const bool simd = simdEnabled();
+
+    struct Entry { std::uint32_t node; std::uint32_t mask; };
+    Entry fixed[kBVHStackSize];
+    std::vector<Entry> heap;
+    Entry* stack = fixed;
+    if (depth > kBVHStackSize) {
+        heap.resize(static_cast<size_t>(depth));
+        stack = heap.data();
+    }
+
+    int sp = 0;
+    std::uint32_t current = 0;
+    std::uint32_t mask = packet.active;
+    std::uint32_t hits = 0;
+    while (true) {
+        const LinearBVHNode& n = nodes[current];
+        unsigned m = 0;
+        if (stats) ++stats->nodes;
+        if (packetIntervalHit(n, ia, t_hi)) {
+            if (stats) stats->box_tests += static_cast<size_t>(laneCount(mask));
+            m = packetIntersect(n, packet, ia.neg, tmax, mask, simd);
+        }
+        if (m && n.isLeaf()) {
+            if (stats) ++stats->leaves;
+            hits |= leaf(n.offset, static_cast<std::uint32_t>(n.nPrimitives), static_cast<std::uint32_t>(m), tmax);
+            t_hi = activeMax();
+        } else if (m) {
+            // 同一个包的方向符号一致，所以远近顺序对每条光线都相同
+            mask = m;
+            if (ia.neg[n.axis]) { stack[sp++] = {current + 1, m}; current = n.offset; }
+            else                { stack[sp++] = {n.offset, m};    current = current + 1; }
+            continue;
+        }
+        if (sp == 0) break;
+        --sp;
+        current = stack[sp].node;
+        mask    = stack[sp].mask;
+    }
+    return hits;
+}
@@ -0,0 +1,203 @@
+#include "PrimitiveSoA.h"
+#include "cube.h"
+#include "plane.h"
+#include "simd.h"
+#include "sphere.h"
+#include <cassert>
+#if RT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+void SphereSoA::add(const rt::sphere& s)
+{
+    cx.push_back(s.center.x());
+    cy.push_back(s.center.y());
+    cz.push_back(s.center.z());
+    radius.push_back(s.radius);
+}
+
+#if RT_X86_SIMD && SOFTRT_FLOAT
+// Single precision: eight spheres per step, otherwise as the double kernel below.
+RT_TARGET_AVX2_EXACT bool SphereSoA::intersectAVX2(std::uint32_t first, std::uint32_t n, const ray& r,
+                                                   interval ray_t, real& t, std::uint32_t& which) const
+{
+    const vec3 d = r.direction();
+    const __m256 a    = _mm256_set1_ps(dot(d, d));
+    const __m256 dx   = _mm256_set1_ps(d.x()), dy = _mm256_set1_ps(d.y()), dz = _mm256_set1_ps(d.z());
+    const __m256 ox   = _mm256_set1_ps(r.origin().x()), oy = _mm256_set1_ps(r.origin().y()),
+                 oz   = _mm256_set1_ps(r.origin().z());
+    const __m256 tmin = _mm256_set1_ps(ray_t.min);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256  best   = _mm256_set1_ps(ray_t.max);
+    __m256i best_k = _mm256_set1_epi32(-1);
+    __m256i k      = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    assert(n % kLanes == 0);
+    for (std::uint32_t g = 0; g < n; g += 8) {
+        const std::uint32_t i = first + g;
+        const __m256 cxv = _mm256_loadu_ps(&cx[i]);
+        const __m256 cyv = _mm256_loadu_ps(&cy[i]);
+        const __m256 czv = _mm256_loadu_ps(&cz[i]);
+        const __m256 rv  = _mm256_loadu_ps(&radius[i]);
+        const __m256 mx = _mm256_sub_ps(ox, cxv);
+        const __m256 my = _mm256_sub_ps(oy, cyv);
+        const __m256 mz = _mm256_sub_ps(oz, czv);
+        const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mx, dx), _mm256_mul_ps(my, dy)),
+                                       _mm256_mul_ps(mz, dz));
+        const __m256 mm = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mx, mx), _mm256_mul_ps(my, my)),
+                                        _mm256_mul_ps(mz, mz));
+        const __m256 c = _mm256_sub_ps(mm, _mm256_mul_ps(rv, rv));
+        const __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+        const __m256 valid = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+        if (_mm256_movemask_ps(valid)) {
+            const __m256 s  = _mm256_sqrt_ps(disc);
+            const __m256 nb = _mm256_xor_ps(b, sign);
+            const __m256 t0 = _mm256_div_ps(_mm256_sub_ps(nb, s), a);
+            const __m256 t1 = _mm256_div_ps(_mm256_add_ps(nb, s), a);
+            const __m256 in0 = _mm256_and_ps(_mm256_cmp_ps(tmin, t0, _CMP_LT_OQ), _mm256_cmp_ps(t0, best, _CMP_LT_OQ));
+            const __m256 tt  = _mm256_blendv_ps(t1, t0, in0);
+            const __m256 hit = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(tmin, tt, _CMP_LT_OQ),
+                                                                  _mm256_cmp_ps(tt, best, _CMP_LT_OQ)));
+            best   = _mm256_blendv_ps(best, tt, hit);
+            best_k = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_k), _mm256_castsi256_ps(k), hit));
+        }
+        k = _mm256_add_epi32(k, _mm256_set1_epi32(8));
+    }
+
+    alignas(32) float bt[8];
+    alignas(32) std::int32_t bk[8];
+    _mm256_store_ps(bt, best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(bk), best_k);
+    int lane_hit = -1;
+    for (int l = 0; l < 8; ++l)
+        if (bk[l] >= 0 && (lane_hit < 0 || bt[l] < bt[lane_hit] || (bt[l] == bt[lane_hit] && bk[l] < bk[lane_hit])))
+            lane_hit = l;
+    if (lane_hit < 0) return false;
+    t = bt[lane_hit];
+    which = static_cast<std::uint32_t>(bk[lane_hit]);
+    return true;
+}
+#elif RT_X86_SIMD
+// Four spheres per step, each lane with the exact operation order of rt::intersect_sphere
+// (no FMA). Every lane keeps its own closest root; the lanes are reduced at the end, ties
+// going to the lower sphere, which is what the sequential loop returns.
+RT_TARGET_AVX2_EXACT bool SphereSoA::intersectAVX2(std::uint32_t first, std::uint32_t n, const ray& r,
+                                                   interval ray_t, real& t, std::uint32_t& which) const
+{
+    const vec3 d = r.direction();
+    const double a_s = dot(d, d);
+    const __m256d a    = _mm256_set1_pd(a_s);
+    const __m256d dx   = _mm256_set1_pd(d.x()), dy = _mm256_set1_pd(d.y()), dz = _mm256_set1_pd(d.z());
+    const __m256d ox   = _mm256_set1_pd(r.origin().x()), oy = _mm256_set1_pd(r.origin().y()),
+                  oz   = _mm256_set1_pd(r.origin().z());
+    const __m256d tmin = _mm256_set1_pd(ray_t.min);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d best = _mm256_set1_pd(ray_t.max);
+    __m256d best_k = _mm256_set1_pd(-1.0);
+    __m256d k = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+
+    assert(n % kLanes == 0);
+    for (std::uint32_t g = 0; g < n; g += 4) {
+        const std::uint32_t i = first + g;
+        const __m256d cxv = _mm256_loadu_pd(&cx[i]);
+        const __m256d cyv = _mm256_loadu_pd(&cy[i]);
+        const __m256d czv = _mm256_loadu_pd(&cz[i]);
+        const __m256d rv  = _mm256_loadu_pd(&radius[i]);
+        const __m256d mx = _mm256_sub_pd(ox, cxv);
+        const __m256d my = _mm256_sub_pd(oy, cyv);
+        const __m256d mz = _mm256_sub_pd(oz, czv);
+        const __m256d b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(mx, dx), _mm256_mul_pd(my, dy)),
+                                        _mm256_mul_pd(mz, dz));
+        const __m256d mm = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(mx, mx), _mm256_mul_pd(my, my)),
+                                         _mm256_mul_pd(mz, mz));
+        const __m256d c = _mm256_sub_pd(mm, _mm256_mul_pd(rv, rv));
+        // b² + (-a)·c rounds the same as b² - a·c
+        const __m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(a, c));
+        const __m256d valid = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+        if (_mm256_movemask_pd(valid)) {
+            const __m256d s = _mm256_sqrt_pd(disc);
+            const __m256d nb = _mm256_xor_pd(b, sign);
+            const __m256d t0 = _mm256_div_pd(_mm256_sub_pd(nb, s), a);
+            const __m256d t1 = _mm256_div_pd(_mm256_add_pd(nb, s), a);
+            // far root only where the near one is outside (tmin, tmax)
+            const __m256d in0 = _mm256_and_pd(_mm256_cmp_pd(tmin, t0, _CMP_LT_OQ), _mm256_cmp_pd(t0, best, _CMP_LT_OQ));
+            const __m256d tt  = _mm256_blendv_pd(t1, t0, in0);
+            const __m256d hit = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(tmin, tt, _CMP_LT_OQ),
+                                                                   _mm256_cmp_pd(tt, best, _CMP_LT_OQ)));
+            best   = _mm256_blendv_pd(best, tt, hit);
+            best_k = _mm256_blendv_pd(best_k, k, hit);
+        }
+        k = _mm256_add_pd(k, four);
+    }
+
+    alignas(32) double bt[4], bk[4];
+    _mm256_store_pd(bt, best);
+    _mm256_store_pd(bk, best_k);
+    int lane = -1;
+    for (int l = 0; l < 4; ++l)
+        if (bk[l] >= 0.0 && (lane < 0 || bt[l] < bt[lane] || (bt[l] == bt[lane] && bk[l] < bk[lane]))) lane = l;
+    if (lane < 0) return false;
+    t = bt[lane];
+    which = static_cast<std::uint32_t>(bk[lane]);
+    return true;
+}
+#else
+bool SphereSoA::intersectAVX2(std::uint32_t first, std::uint32_t n, const ray& r, interval ray_t,
+                              real& t, std::uint32_t& which) const
+{
+    return intersect(first, n, r, ray_t, t, which, false);
+}
+#endif
+
+PrimitiveSoA::Kind PrimitiveSoA::kindOf(const hittable* p)
+{
+    if (dynamic_cast<const rt::sphere*>(p)) return Sphere;
+    if (auto q = dynamic_cast<const rt::plane*>(p)) return q->parallelogram ? Quad : Other;
+    if (dynamic_cast<const rt::cube*>(p)) return Box;
+    return Other;
+}
+
+void PrimitiveSoA::build(const hittable* const* primitives, size_t n)
+{
+    *this = PrimitiveSoA();
+    prims = primitives;
+    refs.resize(n);
+    bool any = false;
+    for (size_t i = 0; i < n; ++i) {
+        const hittable* p = primitives[i];
+        const Kind kind = kindOf(p);
+        std::uint32_t index = 0;
+        switch (kind) {
+        case Sphere:
+            index = spheres.size();
+            spheres.add(*static_cast<const rt::sphere*>(p));
+            break;
+        case Quad: {
+            auto q = static_cast<const rt::plane*>(p);
+            index = static_cast<std::uint32_t>(quads.size());
+            quads.push_back({q->v0, q->e1, q->e2, q->n, q->w});
+            break;
+        }
+        case Box: {
+            auto b = static_cast<const rt::cube*>(p);
+            index = static_cast<std::uint32_t>(boxes.size());
+            boxes.push_back({b->center, b->to_local, b->half});
+            break;
+        }
+        default: break;
+        }
+        any = any || kind != Other;
+        refs[i] = static_cast<std::uint32_t>(kind) << kKindShift | index;
+    }
+    // 没有可以展开的图元时不走分派，叶子直接调用虚函数
+    if (!any) *this = PrimitiveSoA();
+}
+
+size_t PrimitiveSoA::bytes() const
+{
+    return refs.size() * sizeof(std::uint32_t) + spheres.bytes()
+         + quads.size() * sizeof(QuadRec) + boxes.size() * sizeof(BoxRec);
+}
@@ -0,0 +1,201 @@
+#pragma once
+// Type-sorted copy of the analytic primitives of a BVH's leaves. Each leaf slot refers to
+// (kind, index) in one per-kind array, and the leaf loop dispatches on the kind with a
+// switch, so spheres, parallelogram quads and oriented boxes are tested without a virtual
+// call or a pointer chase into the object. Everything else (meshes, instance BVHs,
+// non-planar quads) stays a hittable* and goes through intersect() as before.
+#include "hittable.h"
+#include "intersect_kernels.h"
+#include <cstdint>
+#include <vector>
+
+namespace rt { class sphere; }
+
+// Sphere centres and radii, one array per coordinate, tested 4 (double) or 8 (float) at a
+// time with AVX2.
+class SphereSoA {
+public:
+    static constexpr std::uint32_t kLanes = sizeof(real) == 4 ? 8 : 4;
+
+    void add(const rt::sphere& s);
+    void clear() { cx.clear(); cy.clear(); cz.clear(); radius.clear(); }
+    std::uint32_t size() const { return static_cast<std::uint32_t>(radius.size()); }
+    size_t bytes() const { return 4 * radius.size() * sizeof(real); }
+
+    // Closest hit among spheres [first, first + n) inside ray_t: its distance and its
+    // offset from `first`. Same result, bit for bit, as calling rt::intersect_sphere on
+    // each in turn and shrinking ray_t.max. With `simd`, whole groups of kLanes go through
+    // the AVX2 kernel and the remaining one to kLanes-1 spheres through the scalar loop: a
+    // masked group that is mostly empty costs as much as a full one and loses to scalar.
+    bool intersect(std::uint32_t first, std::uint32_t n, const ray& r, interval ray_t,
+                   real& t, std::uint32_t& which, bool simd) const
+    {
+        bool found = false;
+        std::uint32_t k = 0;
+        if (simd && n >= kLanes) {
+            k = n - n % kLanes;
+            if (intersectAVX2(first, k, r, ray_t, t, which)) { found = true; ray_t.max = t; }
+        }
+        for (; k < n; ++k) {
+            const std::uint32_t i = first + k;
+            if (rt::intersect_sphere(point3(cx[i], cy[i], cz[i]), radius[i], r, ray_t, t)) {
+                found = true; which = k; ray_t.max = t;
+            }
+        }
+        if (found) t = ray_t.max;
+        return found;
+    }
+
+    bool intersect(std::uint32_t i, const ray& r, interval ray_t, real& t) const
+    {
+        return rt::intersect_sphere(point3(cx[i], cy[i], cz[i]), radius[i], r, ray_t, t);
+    }
+
+private:
+    // `n` is a whole number of lane groups (kLanes each); intersect() runs the rest.
+    bool intersectAVX2(std::uint32_t first, std::uint32_t n, const ray& r, interval ray_t,
+                       real& t, std::uint32_t& which) const;
+
+    std::vector<real> cx, cy, cz, radius;
+};
+
+class PrimitiveSoA {
+public:
+    enum Kind : std::uint32_t { Other = 0, Sphere = 1, Quad = 2, Box = 3 };
+
+    // Kind a primitive is stored as. BVH::finish sorts every leaf range by it, so a leaf's
+    // spheres (quads, boxes) are consecutive in their arrays.
+    static Kind kindOf(const hittable* p);
+
+    // `prims` in leaf order; the pointer is kept for the Other slots and for hit_info::prim,
+    // so the array must outlive this object. Stays empty if no primitive has a kind.
+    void build(const hittable* const* prims, size_t n);
+    bool empty() const { return refs.empty(); }
+    size_t bytes() const;
+
+    // Same contract as hittable::intersect / occluded for slot i.
+    bool intersect(std::uint32_t i, const ray& r, interval ray_t, hit_info& h) const
+    {
+        const std::uint32_t ref = refs[i];
+        const std::uint32_t k = ref & kIndexMask;
+        real t;
+        switch (ref >> kKindShift) {
+        case Sphere:
+            if (!spheres.intersect(k, r, ray_t, t)) return false;
+            break;
+        case Quad: {
+            const QuadRec& q = quads[k];
+            real u, v;
+            if (!rt::intersect_parallelogram(q.p0, q.e1, q.e2, q.n, q.w, r, ray_t, t, u, v)) return false;
+            h.u = u; h.v = v; h.id = 0;
+            break;
+        }
+        case Box: {
+            const BoxRec& b = boxes[k];
+            std::uint32_t face;
+            if (!rt::intersect_box(b.center, b.to_local, b.half, r, ray_t, t, face)) return false;
+            h.id = face;
+            break;
+        }
+        default:
+            return prims[i]->intersect(r, ray_t, h);
+        }
+        h.t    = t;
+        h.prim = prims[i];
+        return true;
+    }
+
+    bool occluded(std::uint32_t i, const ray& r, interval ray_t) const
+    {
+        const std::uint32_t ref = refs[i];
+        const std::uint32_t k = ref & kIndexMask;
+        real t, u, v;
+        std::uint32_t face;
+        switch (ref >> kKindShift) {
+        case Sphere: return spheres.intersect(k, r, ray_t, t);
+        case Quad: {
+            const QuadRec& q = quads[k];
+            return rt::intersect_parallelogram(q.p0, q.e1, q.e2, q.n, q.w, r, ray_t, t, u, v);
+        }
+        case Box: {
+            const BoxRec& b = boxes[k];
+            return rt::intersect_box(b.center, b.to_local, b.half, r, ray_t, t, face);
+        }
+        default: return prims[i]->occluded(r, ray_t);
+        }
+    }
+
+    // Number of slots from i up to `end` that hold the same kind as slot i. Leaves are
+    // sorted by kind, so a leaf is at most one run of each.
+    std::uint32_t run(std::uint32_t i, std::uint32_t end) const
+    {
+        const std::uint32_t kind = refs[i] >> kKindShift;
+        std::uint32_t j = i + 1;
+        while (j < end && refs[j] >> kKindShift == kind) ++j;
+        return j - i;
+    }
+
+    // Closest hit over the run [i, i + n) from run(), lowering ray_t.max at every hit.
+    // Runs of spheres go through the batched SphereSoA kernel.
+    bool intersect_run(std::uint32_t i, std::uint32_t n, const ray& r, interval& ray_t, hit_info& h, bool simd) const
+    {
+        if (refs[i] >> kKindShift == Sphere) {
+            real t;
+            std::uint32_t which;
+            if (!spheres.intersect(refs[i] & kIndexMask, n, r, ray_t, t, which, simd)) return false;
+            h.t = t;
+            h.prim = prims[i + which];
+            ray_t.max = t;
+            return true;
+        }
+        bool found = false;
+        for (std::uint32_t j = i; j < i + n; ++j)
+            if (intersect(j, r, ray_t, h)) { found = true; ray_t.max = h.t; }
+        return found;
+    }
+
+    // Closest hit over slots [first, first + count), lowering ray_t.max at every hit.
+    bool intersect_leaf(std::uint32_t first, std::uint32_t count, const ray& r, interval& ray_t, hit_info& h,
+                        bool simd) const
+    {
+        bool found = false;
+        for (std::uint32_t i = first, n; i < first + count; i += n) {
+            n = run(i, first + count);
+            found |= intersect_run(i, n, r, ray_t, h, simd);
+        }
+        return found;
+    }
+
+    bool occluded_leaf(std::uint32_t first, std::uint32_t count, const ray& r, interval ray_t, bool simd) const
+    {
+        for (std::uint32_t i = first, n; i < first + count; i += n) {
+            n = run(i, first + count);
+            if (refs[i] >> kKindShift == Sphere) {
+                real t;
+                std::uint32_t which;
+                if (spheres.intersect(refs[i] & kIndexMask, n, r, ray_t, t, which, simd)) return true;
+                continue;
+            }
+            for (std::uint32_t j = i; j < i + n; ++j)
+                if (occluded(j, r, ray_t)) return true;
+        }
+        return false;
+    }
+
+    Kind kind(std::uint32_t i) const { return static_cast<Kind>(refs[i] >> kKindShift); }
+
+private:
+    static constexpr std::uint32_t kKindShift = 30;
+    static constexpr std::uint32_t kIndexMask = (1u << kKindShift) - 1;
+
+    // Quads and boxes are read whole by one ray test, so they are packed per record;
+    // spheres, the common case, are split into coordinate arrays (SphereSoA).
+    struct QuadRec { point3 p0; vec3 e1, e2, n, w; };
+    struct BoxRec  { point3 center; mat3 to_local; real half; };
+
+    std::vector<std::uint32_t> refs;   // per leaf slot: kind << 30 | index in that kind's arrays
+    const hittable* const* prims = nullptr;
+    SphereSoA spheres;
+    std::vector<QuadRec> quads;
+    std::vector<BoxRec>  boxes;
+};
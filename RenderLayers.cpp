@@ -0,0 +1,167 @@
+#include "RenderLayers.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+void RenderLayers::resize(int w, int h)
+{
+    const std::size_t n = static_cast<std::size_t>(w) * h;
+    width = w;
+    height = h;
+    normal.assign(3 * n, 0.0f);
+    albedo.assign(3 * n, 0.0f);
+    depth.assign(n, 0.0f);
+    variance.assign(n, 0.0f);
+    object_id.assign(n, 0u);
+    samples.assign(n, 0.0f);
+}
+
+namespace {
+
+// One EXR channel: 4-byte values read with a stride from a layer, or a component of the
+// beauty image when `base` is null.
+struct Channel {
+    std::string name;
+    int type;             // 0 = UINT, 2 = FLOAT
+    const void* base;     // first value of the first pixel
+    int stride;           // values between pixels; the component for the beauty
+};
+
+template <class T> void put(std::string& out, T v)
+{
+    char b[sizeof(T)];
+    std::memcpy(b, &v, sizeof(T));   // little-endian, as EXR wants; so is every platform we build on
+    out.append(b, sizeof(T));
+}
+
+void attribute(std::string& out, const char* name, const char* type, const std::string& value)
+{
+    out += name; out += '\0';
+    out += type; out += '\0';
+    put<std::int32_t>(out, static_cast<std::int32_t>(value.size()));
+    out += value;
+}
+
+std::string box2i(int w, int h)
+{
+    std::string v;
+    put<std::int32_t>(v, 0); put<std::int32_t>(v, 0);
+    put<std::int32_t>(v, w - 1); put<std::int32_t>(v, h - 1);
+    return v;
+}
+
+// FNV-style hash of an ID to a saturated colour, black for 0.
+color idColor(std::uint32_t id)
+{
+    if (id == 0) return color(0, 0, 0);
+    std::uint32_t h = 2166136261u;
+    for (int k = 0; k < 4; ++k) h = (h ^ (id >> (8 * k) & 0xffu)) * 16777619u;
+    return color(0.2 + 0.8 * (h & 0xff) / 255.0, 0.2 + 0.8 * (h >> 8 & 0xff) / 255.0, 0.2 + 0.8 * (h >> 16 & 0xff) / 255.0);
+}
+
+Image plane(const RenderLayers& l, const std::vector<float>& v, int comps)
+{
+    Image img(l.width, l.height);
+    for (int y = 0; y < l.height; ++y)
+        for (int x = 0; x < l.width; ++x) {
+            const float* p = &v[(static_cast<std::size_t>(y) * l.width + x) * comps];
+            img.at(x, y) = comps == 3 ? color(p[0], p[1], p[2]) : color(p[0], p[0], p[0]);
+        }
+    return img;
+}
+
+} // namespace
+
+ImageWriteStats writeLayersEXR(const std::string& path, const Image& beauty, const RenderLayers& l)
+{
+    using clock = std::chrono::steady_clock;
+    ImageWriteStats st;
+    const int w = beauty.width(), h = beauty.height();
+    if (l.width != w || l.height != h || w <= 0 || h <= 0) return st;
+    const auto t0 = clock::now();
+
+    std::vector<Channel> channels = {
+        {"R", 2, nullptr, 0}, {"G", 2, nullptr, 1}, {"B", 2, nullptr, 2},
+        {"Z", 2, l.depth.data(), 1},
+        {"albedo.R", 2, l.albedo.data(), 3}, {"albedo.G", 2, l.albedo.data() + 1, 3},
+        {"albedo.B", 2, l.albedo.data() + 2, 3},
+        {"normal.X", 2, l.normal.data(), 3}, {"normal.Y", 2, l.normal.data() + 1, 3},
+        {"normal.Z", 2, l.normal.data() + 2, 3},
+        {"object.id", 0, l.object_id.data(), 1},
+        {"samples.Y", 2, l.samples.data(), 1},
+        {"variance.Y", 2, l.variance.data(), 1},
+    };
+    // readers expect the channel list, and so each scanline's data, sorted by name
+    std::sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) { return a.name < b.name; });
+
+    std::string head;
+    put<std::uint32_t>(head, 20000630u);   // magic
+    put<std::uint32_t>(head, 2u);          // version 2, single-part scanline
+    std::string chlist;
+    for (const Channel& c : channels) {
+        chlist += c.name; chlist += '\0';
+        put<std::int32_t>(chlist, c.type);
+        put<std::uint32_t>(chlist, 0u);    // pLinear and reserved
+        put<std::int32_t>(chlist, 1); put<std::int32_t>(chlist, 1);
+    }
+    chlist += '\0';
+    attribute(head, "channels", "chlist", chlist);
+    attribute(head, "compression", "compression", std::string(1, '\0'));
+    attribute(head, "dataWindow", "box2i", box2i(w, h));
+    attribute(head, "displayWindow", "box2i", box2i(w, h));
+    attribute(head, "lineOrder", "lineOrder", std::string(1, '\0'));
+    std::string one;
+    put<float>(one, 1.0f);
+    attribute(head, "pixelAspectRatio", "float", one);
+    std::string center;
+    put<float>(center, 0.0f); put<float>(center, 0.0f);
+    attribute(head, "screenWindowCenter", "v2f", center);
+    attribute(head, "screenWindowWidth", "float", one);
+    head += '\0';
+
+    // offset table, then one block per scanline: y, byte count, each channel's row in turn
+    const std::size_t line_bytes = channels.size() * 4 * static_cast<std::size_t>(w);
+    const std::size_t first = head.size() + 8 * static_cast<std::size_t>(h);
+    for (int y = 0; y < h; ++y) put<std::uint64_t>(head, first + static_cast<std::size_t>(y) * (8 + line_bytes));
+    std::string body;
+    body.reserve(static_cast<std::size_t>(h) * (8 + line_bytes));
+    for (int y = 0; y < h; ++y) {
+        put<std::int32_t>(body, y);
+        put<std::int32_t>(body, static_cast<std::int32_t>(line_bytes));
+        const std::size_t row = static_cast<std::size_t>(y) * w;
+        for (const Channel& c : channels)
+            for (int x = 0; x < w; ++x) {
+                const std::size_t i = (row + x) * c.stride;
+                if (!c.base) put<float>(body, static_cast<float>(beauty.pixels()[row + x][c.stride]));
+                else if (c.type == 0) put<std::uint32_t>(body, static_cast<const std::uint32_t*>(c.base)[i]);
+                else put<float>(body, static_cast<const float*>(c.base)[i]);
+            }
+    }
+    st.encode_ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+    const auto t1 = clock::now();
+    std::ofstream out(path, std::ios::binary);
+    if (out) {
+        out.write(head.data(), static_cast<std::streamsize>(head.size()));
+        out.write(body.data(), static_cast<std::streamsize>(body.size()));
+        st.ok = out.good();
+    }
+    st.write_ms = std::chrono::duration<double, std::milli>(clock::now() - t1).count();
+    st.bytes    = head.size() + body.size();
+    return st;
+}
+
+bool writeLayerFiles(const std::string& prefix, const RenderLayers& l)
+{
+    bool ok = plane(l, l.albedo, 3).write(prefix + ".albedo.pfm").ok;
+    ok &= plane(l, l.normal, 3).write(prefix + ".normal.pfm").ok;
+    ok &= plane(l, l.depth, 1).write(prefix + ".depth.pfm").ok;
+    ok &= plane(l, l.variance, 1).write(prefix + ".variance.pfm").ok;
+    ok &= plane(l, l.samples, 1).write(prefix + ".samples.pfm").ok;
+    Image ids(l.width, l.height);
+    for (int y = 0; y < l.height; ++y)
+        for (int x = 0; x < l.width; ++x) ids.at(x, y) = idColor(l.object_id[static_cast<std::size_t>(y) * l.width + x]);
+    ok &= ids.write(prefix + ".id.ppm").ok;
+    return ok;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "color.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-pixel buffers rt::camera fills next to the beauty image in the same pass
+// (camera::layers): the first hit of every camera sample is already traced for the beauty,
+// so they cost no extra traversal. Normal, albedo and depth are means over the pixel's
+// samples, so an edge pixel holds a blend of both sides; the object ID is that of the
+// pixel's first sample.
+struct RenderLayers {
+    int width = 0, height = 0;
+    std::vector<float> normal;    // 3 per pixel, shading normal; 0 for a sample that missed
+    std::vector<float> albedo;    // 3 per pixel, material reflectance; 1 for a miss
+    std::vector<float> depth;     // distance along the view axis; 0 for a miss
+    std::vector<float> variance;  // variance of the pixel's mean luminance, 0 below 2 samples
+    std::vector<std::uint32_t> object_id;  // hittable::object_of(), 0 for a miss
+    std::vector<float> samples;   // camera samples taken
+
+    void resize(int w, int h);
+};
+
+// Beauty and every layer as one multi-layer OpenEXR file (uncompressed scanlines, 32-bit
+// float channels R G B, Z, albedo.{R,G,B}, normal.{X,Y,Z}, samples.Y, variance.Y and a
+// 32-bit unsigned object.id), which compositors read as named layers.
+ImageWriteStats writeLayersEXR(const std::string& path, const Image& beauty, const RenderLayers& layers);
+
+// The layers side by side: <prefix>.albedo.pfm, .normal.pfm, .depth.pfm, .variance.pfm and
+// .samples.pfm (linear floats; depth, variance and samples in all three channels), and
+// <prefix>.id.ppm with a colour hashed from each object ID. False if a file failed.
+bool writeLayerFiles(const std::string& prefix, const RenderLayers& layers);
@@ -0,0 +1,534 @@
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include "hittable_list.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double msSince(clock_type::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+constexpr char          kMagic[8]  = {'S', 'R', 'T', 'S', 'C', 'E', 'N', 'E'};
+constexpr std::uint32_t kByteOrder = 0x01020304u;
+constexpr std::uint64_t kEndMarker = 0x444e454548434143ull;  // "CACHEEND"
+
+// ---------------------------------------------------------------- hashing
+// 64-bit hash over 8-byte words (MurmurHash3 mixing), fast enough to key the cache on
+// the full content of multi-hundred-MB OBJ files.
+class Hasher {
+public:
+    void add(const void* data, size_t n)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (; n >= 8; p += 8, n -= 8) {
+            std::uint64_t w;
+            std::memcpy(&w, p, 8);
+            mix(w);
+        }
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, p, n);
+        mix(tail ^ (static_cast<std::uint64_t>(n) << 56));
+    }
+    template <typename T> void add(const T& v)
+    {
+        static_assert(std::is_arithmetic<T>::value, "hash plain values only");
+        add(&v, sizeof v);
+    }
+    void add(const std::string& s) { add(static_cast<std::uint64_t>(s.size())); add(s.data(), s.size()); }
+
+    std::uint64_t value() const
+    {
+        std::uint64_t h = h_;
+        h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    void mix(std::uint64_t w)
+    {
+        w *= 0x87c37b91114253d5ull;
+        w  = rotl(w, 31);
+        w *= 0x4cf5ad432745937full;
+        h_ ^= w;
+        h_  = rotl(h_, 27) * 5 + 0x52dce729;
+    }
+    std::uint64_t h_ = 0x9e3779b97f4a7c15ull;
+};
+
+void hashFile(Hasher& h, const std::string& path)
+{
+    h.add(path);
+    MappedFile f(path);
+    if (!f.ok()) { h.add(std::uint64_t(~0ull)); return; }  // missing: hash differs once it appears
+    h.add(static_cast<std::uint64_t>(f.size()));
+    h.add(f.data(), f.size());
+}
+
+std::uint64_t contentHash(const std::string& json_path, const std::vector<std::string>& deps)
+{
+    Hasher h;
+    hashFile(h, json_path);
+    for (const auto& d : deps) hashFile(h, d);
+    return h.value();
+}
+
+std::uint64_t optionsKey(const BVHBuildOptions* bvh, bool instance_cubes)
+{
+    Hasher h;
+    h.add(instance_cubes);
+    h.add(bvh != nullptr);
+    if (bvh) {
+        h.add(static_cast<int>(bvh->method));
+        h.add(bvh->sah_bins);
+        h.add(bvh->max_leaf_size);
+        h.add(bvh->sah_leaves);
+        h.add(bvh->morton63);
+        h.add(bvh->treelets);
+    }
+    return h.value();
+}
+
+// ---------------------------------------------------------------- records
+// Fixed-size mirrors of the bd:: structs. Strings are (offset, size) into one table.
+struct StrRef  { std::uint32_t offset, size; };
+
+struct Header {
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t real_size;      // sizeof(real): mesh and BVH arrays are stored as built
+    std::uint32_t pad;
+    std::uint64_t content_hash;
+    std::uint64_t options_key;
+};
+
+struct MetaRec   { std::int32_t frame, pad; double unit_scale_length; };
+struct CameraRec {
+    StrRef name;
+    double location[3], gaze[3], up[3];
+    double focal_mm, sensor_w_mm, sensor_h_mm;
+    std::int32_t film_x, film_y;
+};
+struct LightRec  { StrRef name; double location[3]; double radiant_intensity; };
+struct SphereRec { StrRef name; double location[3]; double radius; };
+struct CubeRec   { StrRef name; double translation[3], rotation[3]; double scale_1d; };
+struct PlaneRec  {
+    StrRef name, texture;
+    double corners[4][3];
+    double uv_scale[2], uv_offset[2];
+    std::uint32_t n_corners, pad;
+};
+struct MeshRec   { StrRef name, file; };
+struct TreeRec   { std::int32_t present, depth; double bounds[6]; };
+
+void put(double* dst, const vec3& v) { dst[0] = v.x(); dst[1] = v.y(); dst[2] = v.z(); }
+vec3 get3(const double* s) { return vec3(s[0], s[1], s[2]); }
+void put(double* dst, const bounds3& b) { put(dst, b.pMin); put(dst + 3, b.pMax); }
+bounds3 getBounds(const double* s)
+{
+    bounds3 b;
+    b.pMin = get3(s);
+    b.pMax = get3(s + 3);
+    return b;
+}
+
+template <typename T> T zeroed()
+{
+    static_assert(std::is_trivially_copyable<T>::value, "cache records are copied as bytes");
+    T v;
+    std::memset(&v, 0, sizeof v);
+    return v;
+}
+
+// ---------------------------------------------------------------- file layout
+// Every value and array starts on an 8-byte boundary; an array is [u64 count][u64 element
+// size][elements].
+class Writer {
+public:
+    explicit Writer(const std::string& path) : out_(path, std::ios::binary) {}
+    bool ok() const { return static_cast<bool>(out_); }
+
+    template <typename T> void value(const T& v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cache values are copied as bytes");
+        raw(&v, sizeof v);
+        pad();
+    }
+    template <typename T> void array(const T* p, size_t n)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cache arrays are copied as bytes");
+        const std::uint64_t head[2] = {n, sizeof(T)};
+        raw(head, sizeof head);
+        raw(p, n * sizeof(T));
+        pad();
+    }
+    template <typename T> void array(const std::vector<T>& v) { array(v.data(), v.size()); }
+    void close() { out_.close(); }
+
+private:
+    void raw(const void* p, size_t n)
+    {
+        out_.write(static_cast<const char*>(p), static_cast<std::streamsize>(n));
+        pos_ += n;
+    }
+    void pad()
+    {
+        static const char zeros[8] = {};
+        raw(zeros, (8 - pos_ % 8) % 8);
+    }
+    std::ofstream out_;
+    std::uint64_t pos_ = 0;
+};
+
+class Reader {
+public:
+    Reader(const char* data, size_t size) : base_(data), p_(data), end_(data + size) {}
+    bool ok() const { return ok_; }
+    bool atEnd() const { return p_ == end_; }
+
+    template <typename T> bool value(T& v)
+    {
+        return raw(&v, sizeof v) && align();
+    }
+    template <typename T> bool array(std::vector<T>& v)
+    {
+        std::uint64_t head[2];
+        if (!raw(head, sizeof head)) return false;
+        if (head[1] != sizeof(T) || head[0] > static_cast<std::uint64_t>(end_ - p_) / sizeof(T)) return ok_ = false;
+        v.resize(static_cast<size_t>(head[0]));
+        return raw(v.data(), v.size() * sizeof(T)) && align();
+    }
+
+private:
+    bool raw(void* dst, size_t n)
+    {
+        if (!ok_ || static_cast<size_t>(end_ - p_) < n) return ok_ = false;
+        if (n) std::memcpy(dst, p_, n);
+        p_ += n;
+        return true;
+    }
+    bool align()
+    {
+        const size_t skip = (8 - static_cast<size_t>(p_ - base_) % 8) % 8;
+        if (static_cast<size_t>(end_ - p_) < skip) return ok_ = false;
+        p_ += skip;
+        return true;
+    }
+    const char* base_;
+    const char* p_;
+    const char* end_;
+    bool ok_ = true;
+};
+
+std::vector<std::string> splitPaths(const std::vector<char>& blob)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (size_t i = 0; i < blob.size(); ++i)
+        if (blob[i] == '\0') { out.emplace_back(blob.data() + start, i - start); start = i + 1; }
+    return out;
+}
+
+bool readMesh(Reader& in, rt::triangle_mesh_data& d)
+{
+    TreeRec tree;
+    return in.array(d.positions) && in.array(d.normals) && in.array(d.uvs)
+        && in.array(d.indices) && in.array(d.normal_indices) && in.array(d.uv_indices)
+        && in.array(d.nodes) && in.value(tree)
+        && ((d.bounds = getBounds(tree.bounds)), true);
+}
+
+// Structural checks so that a damaged file cannot send traversal out of bounds: every
+// child index inside the node array and past its parent (the depth-first layout), no node
+// reached twice, leaves inside the primitive range. The depth that sizes the traversal
+// stack is recomputed here (root = 1, as BVH::flattenNode counts it) rather than read.
+bool validTree(const std::vector<LinearBVHNode>& nodes, size_t prims, int& depth)
+{
+    depth = 0;
+    if (nodes.empty()) return true;
+    std::vector<char> seen(nodes.size(), 0);
+    std::vector<std::pair<std::uint32_t, int>> todo{{0u, 1}};
+    while (!todo.empty()) {
+        const auto [i, d] = todo.back();
+        todo.pop_back();
+        if (seen[i]) return false;
+        seen[i] = 1;
+        depth = std::max(depth, d);
+        const LinearBVHNode& n = nodes[i];
+        if (n.isLeaf()) {
+            if (size_t(n.offset) + n.nPrimitives > prims) return false;
+            continue;
+        }
+        if (size_t(i) + 1 >= nodes.size() || n.offset <= i + 1 || n.offset >= nodes.size()) return false;
+        todo.push_back({i + 1, d + 1});
+        todo.push_back({n.offset, d + 1});
+    }
+    return true;
+}
+
+// Every index triple inside the buffer it indexes; normal and UV indices either absent or
+// one per position index.
+bool validIndices(const std::vector<std::uint32_t>& idx, size_t n_vertices, size_t n_expected)
+{
+    if (idx.size() != n_expected) return false;
+    for (std::uint32_t i : idx)
+        if (i >= n_vertices) return false;
+    return true;
+}
+
+bool validMesh(const rt::triangle_mesh_data& d)
+{
+    const size_t n = d.indices.size();
+    return n % 3 == 0 && validIndices(d.indices, d.positions.size(), n)
+        && (d.normal_indices.empty() || validIndices(d.normal_indices, d.normals.size(), n))
+        && (d.uv_indices.empty() || validIndices(d.uv_indices, d.uvs.size(), n));
+}
+} // namespace
+
+std::vector<std::string> sceneDependencies(const bd::Scene& scene)
+{
+    std::vector<std::string> deps;
+    for (const auto& m : scene.meshes) deps.push_back(m.file);
+    for (const auto& p : scene.planes)
+        if (!p.texture.empty()) deps.push_back(p.texture);
+    return deps;
+}
+
+bool saveSceneCache(const std::string& cache_path, const std::string& json_path,
+                    const bd::Scene& scene, const hittable_list& world, const BVHBuildOptions* bvh)
+{
+    const std::vector<std::string> deps = sceneDependencies(scene);
+
+    std::vector<char> dep_blob;
+    for (const auto& d : deps) { dep_blob.insert(dep_blob.end(), d.begin(), d.end()); dep_blob.push_back('\0'); }
+
+    std::vector<char> strings;
+    auto str = [&](const std::string& s) {
+        StrRef r{static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(s.size())};
+        strings.insert(strings.end(), s.begin(), s.end());
+        return r;
+    };
+
+    MetaRec meta = zeroed<MetaRec>();
+    meta.frame = scene.meta.frame;
+    meta.unit_scale_length = scene.meta.unit_scale_length;
+
+    std::vector<CameraRec> cameras;
+    for (const auto& c : scene.cameras) {
+        CameraRec r = zeroed<CameraRec>();
+        r.name = str(c.name);
+        put(r.location, c.location); put(r.gaze, c.gaze); put(r.up, c.up);
+        r.focal_mm = c.focal_mm; r.sensor_w_mm = c.sensor_w_mm; r.sensor_h_mm = c.sensor_h_mm;
+        r.film_x = c.film_x; r.film_y = c.film_y;
+        cameras.push_back(r);
+    }
+    std::vector<LightRec> lights;
+    for (const auto& l : scene.point_lights) {
+        LightRec r = zeroed<LightRec>();
+        r.name = str(l.name);
+        put(r.location, l.location);
+        r.radiant_intensity = l.radiant_intensity;
+        lights.push_back(r);
+    }
+    std::vector<SphereRec> spheres;
+    for (const auto& s : scene.spheres) {
+        SphereRec r = zeroed<SphereRec>();
+        r.name = str(s.name);
+        put(r.location, s.location);
+        r.radius = s.radius;
+        spheres.push_back(r);
+    }
+    std::vector<CubeRec> cubes;
+    for (const auto& c : scene.cubes) {
+        CubeRec r = zeroed<CubeRec>();
+        r.name = str(c.name);
+        put(r.translation, c.translation); put(r.rotation, c.rotation_euler_xyz_rad);
+        r.scale_1d = c.scale_1d;
+        cubes.push_back(r);
+    }
+    std::vector<PlaneRec> planes;
+    for (const auto& p : scene.planes) {
+        PlaneRec r = zeroed<PlaneRec>();
+        r.name = str(p.name);
+        r.texture = str(p.texture);
+        r.n_corners = static_cast<std::uint32_t>(std::min<size_t>(p.corners.size(), 4));
+        for (std::uint32_t i = 0; i < r.n_corners; ++i) put(r.corners[i], p.corners[i]);
+        r.uv_scale[0]  = p.uv_scale.x();  r.uv_scale[1]  = p.uv_scale.y();
+        r.uv_offset[0] = p.uv_offset.x(); r.uv_offset[1] = p.uv_offset.y();
+        planes.push_back(r);
+    }
+    std::vector<MeshRec> meshes;
+    for (const auto& m : scene.meshes) meshes.push_back(MeshRec{str(m.name), str(m.file)});
+
+    Header h = zeroed<Header>();
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.version      = kSceneCacheVersion;
+    h.byte_order   = kByteOrder;
+    h.real_size    = sizeof(real);
+    h.content_hash = contentHash(json_path, deps);
+    h.options_key  = optionsKey(bvh, world.instance_cubes);
+
+    const std::string tmp = cache_path + ".tmp";
+    {
+        Writer out(tmp);
+        if (!out.ok()) return false;
+        out.value(h);
+        out.array(dep_blob);
+        out.array(strings);
+        out.value(meta);
+        out.array(cameras);
+        out.array(lights);
+        out.array(spheres);
+        out.array(cubes);
+        out.array(planes);
+        out.array(meshes);
+        for (size_t i = 0; i < scene.meshes.size(); ++i) {
+            const rt::triangle_mesh* mesh = i < world.meshes.size() ? world.meshes[i].get() : nullptr;
+            const rt::triangle_mesh_data d = mesh ? mesh->data() : rt::triangle_mesh_data{};
+            TreeRec tree = zeroed<TreeRec>();
+            tree.present = mesh != nullptr;
+            tree.depth   = d.depth;
+            put(tree.bounds, d.bounds);
+            out.array(d.positions); out.array(d.normals); out.array(d.uvs);
+            out.array(d.indices); out.array(d.normal_indices); out.array(d.uv_indices);
+            out.array(d.nodes);
+            out.value(tree);
+        }
+        const LinearBVH lin = (bvh && world.bvh) ? world.bvh->linear() : LinearBVH{};
+        TreeRec tree = zeroed<TreeRec>();
+        tree.present = !lin.nodes.empty();
+        tree.depth   = lin.depth;
+        put(tree.bounds, lin.bounds);
+        out.array(lin.nodes);
+        out.array(lin.order);
+        out.value(tree);
+        out.value(kEndMarker);
+        out.close();
+        if (!out.ok()) { std::remove(tmp.c_str()); return false; }
+    }
+#if defined(_WIN32)
+    std::remove(cache_path.c_str());  // rename() does not replace an existing file on Windows
+#endif
+    return std::rename(tmp.c_str(), cache_path.c_str()) == 0;
+}
+
+std::uint64_t sceneContentHash(const std::string& json_path, const bd::Scene& scene)
+{
+    return contentHash(json_path, sceneDependencies(scene));
+}
+
+bool loadSceneCache(const std::string& cache_path, const std::string& json_path,
+                    const BVHBuildOptions* bvh, bool instance_cubes,
+                    SceneCacheData& out, SceneCacheStats* stats)
+{
+    const auto t_start = clock_type::now();
+    SceneCacheStats local;
+    SceneCacheStats& st = stats ? *stats : local;
+    st = SceneCacheStats{};
+    auto fail = [&](const char* why) {
+        st.reason  = why;
+        st.load_ms = msSince(t_start);
+        return false;
+    };
+
+    MappedFile file(cache_path);
+    if (!file.ok()) return fail("no cache file");
+    st.bytes = file.size();
+    Reader in(file.data(), file.size());
+
+    Header h;
+    if (!in.value(h) || std::memcmp(h.magic, kMagic, sizeof kMagic) != 0) return fail("not a scene cache");
+    if (h.version != kSceneCacheVersion || h.byte_order != kByteOrder) return fail("format version differs");
+    if (h.real_size != sizeof(real)) return fail("built for another scalar type");
+    if (h.options_key != optionsKey(bvh, instance_cubes)) return fail("BVH or instancing options differ");
+
+    std::vector<char> dep_blob;
+    if (!in.array(dep_blob)) return fail("truncated");
+    auto t0 = clock_type::now();
+    const std::uint64_t hash = contentHash(json_path, splitPaths(dep_blob));
+    st.hash_ms = msSince(t0);
+    if (hash != h.content_hash) return fail("scene or referenced files changed");
+
+    std::vector<char> strings;
+    MetaRec meta;
+    std::vector<CameraRec> cameras;
+    std::vector<LightRec>  lights;
+    std::vector<SphereRec> spheres;
+    std::vector<CubeRec>   cubes;
+    std::vector<PlaneRec>  planes;
+    std::vector<MeshRec>   meshes;
+    if (!(in.array(strings) && in.value(meta) && in.array(cameras) && in.array(lights) && in.array(spheres)
+          && in.array(cubes) && in.array(planes) && in.array(meshes)))
+        return fail("truncated");
+
+    bool strings_ok = true;
+    auto str = [&](StrRef r) {
+        if (size_t(r.offset) + r.size > strings.size()) { strings_ok = false; return std::string(); }
+        return std::string(strings.data() + r.offset, r.size);
+    };
+
+    SceneCacheData data;
+    bd::Scene& scene = data.scene;
+    scene.meta.frame = meta.frame;
+    scene.meta.unit_scale_length = meta.unit_scale_length;
+    for (const auto& r : cameras) {
+        bd::Camera c;
+        c.name = str(r.name);
+        c.location = get3(r.location); c.gaze = get3(r.gaze); c.up = get3(r.up);
+        c.focal_mm = r.focal_mm; c.sensor_w_mm = r.sensor_w_mm; c.sensor_h_mm = r.sensor_h_mm;
+        c.film_x = r.film_x; c.film_y = r.film_y;
+        scene.cameras.push_back(std::move(c));
+    }
+    for (const auto& r : lights)
+        scene.point_lights.push_back(bd::PointLight{str(r.name), get3(r.location), r.radiant_intensity});
+    for (const auto& r : spheres)
+        scene.spheres.push_back(bd::Sphere{str(r.name), get3(r.location), r.radius});
+    for (const auto& r : cubes)
+        scene.cubes.push_back(bd::Cube{str(r.name), get3(r.translation), get3(r.rotation), r.scale_1d});
+    for (const auto& r : planes) {
+        bd::Plane p;
+        p.name = str(r.name);
+        p.texture = str(r.texture);
+        for (std::uint32_t i = 0; i < std::min<std::uint32_t>(r.n_corners, 4); ++i) p.corners.push_back(get3(r.corners[i]));
+        p.uv_scale  = vec2(float(r.uv_scale[0]), float(r.uv_scale[1]));
+        p.uv_offset = vec2(float(r.uv_offset[0]), float(r.uv_offset[1]));
+        scene.planes.push_back(std::move(p));
+    }
+    for (const auto& r : meshes) scene.meshes.push_back(bd::Mesh{str(r.name), str(r.file)});
+    if (!strings_ok) return fail("bad string table");
+
+    data.meshes.resize(meshes.size());
+    for (auto& d : data.meshes) {
+        if (!readMesh(in, d)) return fail("truncated");
+        if (!validMesh(d)) return fail("bad mesh indices");
+        if (!validTree(d.nodes, d.indices.size() / 3, d.depth)) return fail("bad mesh BVH");
+    }
+
+    TreeRec tree;
+    if (!(in.array(data.bvh.nodes) && in.array(data.bvh.order) && in.value(tree))) return fail("truncated");
+    data.has_bvh    = tree.present != 0;
+    data.bvh.bounds = getBounds(tree.bounds);
+    const size_t n_objects = data.bvh.order.size();
+    for (std::uint32_t i : data.bvh.order)
+        if (i >= n_objects) return fail("bad scene BVH");
+    if (!validTree(data.bvh.nodes, n_objects, data.bvh.depth)) return fail("bad scene BVH");
+
+    std::uint64_t end_marker = 0;
+    if (!in.value(end_marker) || end_marker != kEndMarker || !in.atEnd()) return fail("truncated");
+
+    out = std::move(data);
+    st.hit = true;
+    st.load_ms = msSince(t_start);
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "BVH.h"
+#include "scene.h"
+#include "triangle_mesh.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class hittable_list;
+
+// Binary scene cache: the bd:: structs of a scene as flat arrays of fixed-size records,
+// every mesh after triangle_mesh has built it, and the scene BVH in its flattened form.
+// The file is keyed by a content hash of the JSON and of every file it references (mesh
+// OBJs, plane textures) plus the BVH options, and is read through mmap: each array is one
+// memcpy, nothing is parsed. Any mismatch in format version, scalar type (SOFTRT_FLOAT),
+// hash or options makes the load fail and the caller falls back to the JSON path.
+constexpr std::uint32_t kSceneCacheVersion = 2;
+
+struct SceneCacheData {
+    bd::Scene scene;
+    std::vector<rt::triangle_mesh_data> meshes;  // parallel to scene.meshes, empty if skipped
+    bool has_bvh = false;
+    LinearBVH bvh;                               // over the objects in hittable_list::loadScene order
+};
+
+struct SceneCacheStats {
+    bool   hit = false;
+    std::string reason;    // why the cache was not used
+    size_t bytes = 0;
+    double hash_ms = 0.0;  // hashing the JSON and the files it references
+    double load_ms = 0.0;  // whole loadSceneCache call, hash included
+};
+
+// Files a scene reads besides its JSON, in a fixed order.
+std::vector<std::string> sceneDependencies(const bd::Scene& scene);
+
+// Hash of the JSON and of every file in sceneDependencies(scene): the key the cache is
+// stored under, also used to tie render checkpoints to their scene.
+std::uint64_t sceneContentHash(const std::string& json_path, const bd::Scene& scene);
+
+// `bvh` is the build configuration the caller would use, or null when it renders without
+// a BVH. Options that only affect traversal (width, threads) are not part of the key.
+// `instance_cubes` is hittable_list::instance_cubes, which changes the object list the
+// scene BVH is built over.
+bool loadSceneCache(const std::string& cache_path, const std::string& json_path,
+                    const BVHBuildOptions* bvh, bool instance_cubes,
+                    SceneCacheData& out, SceneCacheStats* stats = nullptr);
+
+// Writes `world` (as loadScene built it from `scene`) to cache_path, through a temporary
+// file that is renamed into place. Returns false if the file cannot be written.
+bool saveSceneCache(const std::string& cache_path, const std::string& json_path,
+                    const bd::Scene& scene, const hittable_list& world, const BVHBuildOptions* bvh);
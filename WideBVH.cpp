@@ -0,0 +1,179 @@
+#include "WideBVH.h"
+#include <algorithm>
+#if RT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+template <int N>
+void WideBVH<N>::build(const std::vector<LinearBVHNode>& binary)
+{
+    nodes.clear();
+    max_depth = 0;
+    if (binary.empty()) return;
+    if (binary[0].isLeaf()) {
+        // 整棵树只有一个叶子：根节点只放这一个孩子
+        Node root{};
+        for (int a = 0; a < 3; ++a) {
+            root.bmin[a][0] = binary[0].bmin[a];
+            root.bmax[a][0] = binary[0].bmax[a];
+        }
+        root.child[0] = binary[0].offset;
+        root.count[0] = static_cast<std::uint8_t>(binary[0].nPrimitives);
+        root.valid    = 1;
+        nodes.push_back(root);
+        max_depth = 1;
+        return;
+    }
+    collapse(binary, 0, 1);
+}
+
+template <int N>
+std::uint32_t WideBVH<N>::collapse(const std::vector<LinearBVHNode>& binary, std::uint32_t index, int depth)
+{
+    max_depth = std::max(max_depth, depth);
+    const std::uint32_t self = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    // 反复展开面积最大的内部孩子，直到凑满 N 个
+    std::uint32_t kids[N] = {index + 1, binary[index].offset};
+    int nk = 2;
+    while (nk < N) {
+        int best = -1;
+        double best_area = -1.0;
+        for (int k = 0; k < nk; ++k) {
+            const LinearBVHNode& c = binary[kids[k]];
+            if (c.isLeaf()) continue;
+            const double area = c.getBounds().surface_area();
+            if (area > best_area) { best_area = area; best = k; }
+        }
+        if (best < 0) break;
+        const std::uint32_t x = kids[best];
+        kids[best]  = x + 1;
+        kids[nk++]  = binary[x].offset;
+    }
+
+    Node n{};
+    for (int k = 0; k < nk; ++k) {
+        const LinearBVHNode& c = binary[kids[k]];
+        for (int a = 0; a < 3; ++a) {
+            n.bmin[a][k] = c.bmin[a];
+            n.bmax[a][k] = c.bmax[a];
+        }
+        n.valid |= static_cast<std::uint8_t>(1u << k);
+        if (c.isLeaf()) {
+            n.child[k] = c.offset;
+            n.count[k] = static_cast<std::uint8_t>(c.nPrimitives);
+        } else {
+            n.child[k] = collapse(binary, kids[k], depth + 1);
+            n.count[k] = 0;
+        }
+    }
+    nodes[self] = n;
+    return self;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+
+#if RT_X86_SIMD && SOFTRT_FLOAT
+namespace {
+// All children of a BVH4 node in one SSE register, of a BVH8 node in one AVX register.
+// max/min take the accumulated value when the new distance is NaN (0 * inf), matching
+// the `if (t0 > t_min)` form of the scalar test.
+RT_TARGET_AVX2 inline unsigned intersect4(const WideBVHNode<4>& n, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    __m128 t0 = _mm_set1_ps(t_min);
+    __m128 t1 = _mm_set1_ps(t_max);
+    const __m128 scale = _mm_set1_ps(kBoxExitScale);
+    for (int a = 0; a < 3; ++a) {
+        const __m128 o   = _mm_set1_ps(q.o[a]);
+        const __m128 inv = _mm_set1_ps(q.inv[a]);
+        const __m128 s0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(q.neg[a] ? n.bmax[a] : n.bmin[a]), o), inv);
+        const __m128 s1 = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(q.neg[a] ? n.bmin[a] : n.bmax[a]), o), inv), scale);
+        t0 = _mm_max_ps(s0, t0);
+        t1 = _mm_min_ps(s1, t1);
+    }
+    _mm_storeu_ps(t_near, t0);
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(t0, t1)));
+}
+
+RT_TARGET_AVX2 inline unsigned intersect8(const WideBVHNode<8>& n, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    __m256 t0 = _mm256_set1_ps(t_min);
+    __m256 t1 = _mm256_set1_ps(t_max);
+    const __m256 scale = _mm256_set1_ps(kBoxExitScale);
+    for (int a = 0; a < 3; ++a) {
+        const __m256 o   = _mm256_set1_ps(q.o[a]);
+        const __m256 inv = _mm256_set1_ps(q.inv[a]);
+        const __m256 s0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(q.neg[a] ? n.bmax[a] : n.bmin[a]), o), inv);
+        const __m256 s1 = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(q.neg[a] ? n.bmin[a] : n.bmax[a]), o), inv), scale);
+        t0 = _mm256_max_ps(s0, t0);
+        t1 = _mm256_min_ps(s1, t1);
+    }
+    _mm256_storeu_ps(t_near, t0);
+    return static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+}
+} // namespace
+
+RT_TARGET_AVX2 unsigned intersectWideAVX2(const WideBVHNode<4>& n, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    return intersect4(n, q, t_min, t_max, t_near) & n.valid;
+}
+
+RT_TARGET_AVX2 unsigned intersectWideAVX2(const WideBVHNode<8>& n, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    return intersect8(n, q, t_min, t_max, t_near) & n.valid;
+}
+#elif RT_X86_SIMD
+namespace {
+// Four children starting at `first`. max/min take the accumulated value when the new
+// distance is NaN (0 * inf), matching the `if (t0 > t_min)` form of the scalar test.
+template <int N>
+RT_TARGET_AVX2 inline unsigned intersect4(const WideBVHNode<N>& n, int first, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    __m256d t0 = _mm256_set1_pd(t_min);
+    __m256d t1 = _mm256_set1_pd(t_max);
+    for (int a = 0; a < 3; ++a) {
+        const float* lo = (q.neg[a] ? n.bmax[a] : n.bmin[a]) + first;
+        const float* hi = (q.neg[a] ? n.bmin[a] : n.bmax[a]) + first;
+        const __m256d o   = _mm256_set1_pd(q.o[a]);
+        const __m256d inv = _mm256_set1_pd(q.inv[a]);
+        const __m256d s0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm_load_ps(lo)), o), inv);
+        const __m256d s1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm_load_ps(hi)), o), inv);
+        t0 = _mm256_max_pd(s0, t0);
+        t1 = _mm256_min_pd(s1, t1);
+    }
+    _mm256_storeu_pd(t_near + first, t0);
+    return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(t0, t1, _CMP_LE_OQ))) << first;
+}
+} // namespace
+
+RT_TARGET_AVX2 unsigned intersectWideAVX2(const WideBVHNode<4>& n, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    return intersect4(n, 0, q, t_min, t_max, t_near) & n.valid;
+}
+
+RT_TARGET_AVX2 unsigned intersectWideAVX2(const WideBVHNode<8>& n, const RayBoxQuery& q,
+                                          real t_min, real t_max, real* t_near)
+{
+    return (intersect4(n, 0, q, t_min, t_max, t_near) | intersect4(n, 4, q, t_min, t_max, t_near)) & n.valid;
+}
+#else
+unsigned intersectWideAVX2(const WideBVHNode<4>& n, const RayBoxQuery& q,
+                           real t_min, real t_max, real* t_near)
+{
+    return intersectWideScalar(n, q, t_min, t_max, t_near);
+}
+
+unsigned intersectWideAVX2(const WideBVHNode<8>& n, const RayBoxQuery& q,
+                           real t_min, real t_max, real* t_near)
+{
+    return intersectWideScalar(n, q, t_min, t_max, t_near);
+}
+#endif
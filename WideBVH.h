@@ -0,0 +1,132 @@
+#pragma once
+#include "BVH.h"
+#include "simd.h"
+#include <cstdint>
+#include <vector>
+
+// BVH4 / BVH8 node. The boxes of all N children are stored SoA (bmin[axis][child]) so a
+// single SIMD pass tests every child; the bounds are the float boxes of the binary tree
+// it was collapsed from. 128 bytes for N = 4, 256 bytes for N = 8.
+template <int N>
+struct alignas(32) WideBVHNode {
+    float         bmin[3][N];
+    float         bmax[3][N];
+    std::uint32_t child[N];   // interior child: node index, leaf child: first primitive
+    std::uint8_t  count[N];   // 0 for interior children, primitive count for leaves
+    std::uint8_t  valid;      // bit k set if child k exists
+};
+static_assert(sizeof(WideBVHNode<4>) == 128, "WideBVHNode<4> must stay 128 bytes");
+static_assert(sizeof(WideBVHNode<8>) == 256, "WideBVHNode<8> must stay 256 bytes");
+
+// Tests the children of `n` against [t_min, t_max]. Returns the mask of children hit and
+// writes their entry distances to t_near. Same arithmetic and NaN behaviour as
+// LinearBVHNode::intersect, so every kernel agrees with the binary traversal.
+template <int N>
+inline unsigned intersectWideScalar(const WideBVHNode<N>& n, const RayBoxQuery& q,
+                                    real t_min, real t_max, real* t_near)
+{
+    unsigned mask = 0;
+    for (int k = 0; k < N; ++k) {
+        if (!(n.valid >> k & 1)) continue;
+        real t0 = t_min, t1 = t_max;
+        for (int a = 0; a < 3; ++a) {
+            const real lo = q.neg[a] ? n.bmax[a][k] : n.bmin[a][k];
+            const real hi = q.neg[a] ? n.bmin[a][k] : n.bmax[a][k];
+            const real s0 = (lo - q.o[a]) * q.inv[a];
+            const real s1 = (hi - q.o[a]) * q.inv[a] * kBoxExitScale;
+            if (s0 > t0) t0 = s0;
+            if (s1 < t1) t1 = s1;
+        }
+        t_near[k] = t0;
+        if (t0 <= t1) mask |= 1u << k;
+    }
+    return mask;
+}
+
+// AVX2 versions (4 doubles or 8 floats per register, so one pass per node in float).
+// Only call when simdEnabled().
+unsigned intersectWideAVX2(const WideBVHNode<4>& n, const RayBoxQuery& q,
+                           real t_min, real t_max, real* t_near);
+unsigned intersectWideAVX2(const WideBVHNode<8>& n, const RayBoxQuery& q,
+                           real t_min, real t_max, real* t_near);
+
+// N-wide BVH collapsed from a flattened binary BVH. Leaves keep the binary tree's
+// primitive ranges, so the same primitive array serves both.
+template <int N>
+class WideBVH {
+public:
+    using Node = WideBVHNode<N>;
+
+    // Every wide node takes the largest-area binary descendants until it has N children.
+    void build(const std::vector<LinearBVHNode>& binary);
+
+    // Closest-hit traversal with the same leaf callback as traverseLinearBVH. Hit children
+    // are pushed far to near, so the nearest is always popped next; entries behind the
+    // current hit are dropped when popped. With AnyHit it stops at the first leaf hit.
+    template <bool AnyHit = false, typename LeafFn>
+    bool traverse(const ray& r, interval& ray_t, LeafFn&& leaf, BVHTraversalStats* stats = nullptr) const;
+
+    bool   empty() const { return nodes.empty(); }
+    size_t size()  const { return nodes.size(); }
+    int    depth() const { return max_depth; }
+    size_t bytes() const { return nodes.size() * sizeof(Node); }
+
+private:
+    std::uint32_t collapse(const std::vector<LinearBVHNode>& binary, std::uint32_t index, int depth);
+
+    std::vector<Node> nodes;
+    int max_depth = 0;
+};
+
+template <int N>
+template <bool AnyHit, typename LeafFn>
+bool WideBVH<N>::traverse(const ray& r, interval& ray_t, LeafFn&& leaf, BVHTraversalStats* stats) const
+{
+    if (nodes.empty()) return false;
+    struct Entry { std::uint32_t child; std::uint32_t count; real t; };
+    constexpr int kFixed = (N - 1) * kBVHStackSize + 1;
+    Entry fixed[kFixed];
+    std::vector<Entry> heap;
+    Entry* stack = fixed;
+    if (max_depth > kBVHStackSize) {
+        heap.resize(static_cast<size_t>(N - 1) * max_depth + 1);
+        stack = heap.data();
+    }
+
+    const RayBoxQuery q(r);
+    const bool simd = simdEnabled();
+    int sp = 0;
+    stack[sp++] = {0, 0, ray_t.min};
+    bool hit_any = false;
+    while (sp) {
+        const Entry e = stack[--sp];
+        if (e.t > ray_t.max) continue;
+        if (e.count) {
+            if (stats) ++stats->leaves;
+            if (leaf(e.child, e.count, ray_t)) {
+                hit_any = true;
+                if (AnyHit) break;
+            }
+            continue;
+        }
+        const Node& n = nodes[e.child];
+        real t_near[N];
+        const unsigned mask = simd ? intersectWideAVX2(n, q, ray_t.min, ray_t.max, t_near)
+                                   : intersectWideScalar(n, q, ray_t.min, ray_t.max, t_near);
+        if (stats) { ++stats->nodes; stats->box_tests += N; }
+
+        // 按进入距离从远到近压栈（插入排序，最多 N 个）
+        Entry hits[N];
+        int nh = 0;
+        for (unsigned m = mask; m; m &= m - 1) {
+            int k = 0;
+            while (!(m >> k & 1)) ++k;
+            Entry h{n.child[k], n.count[k], t_near[k]};
+            int i = nh++;
+            while (i > 0 && hits[i - 1].t < h.t) { hits[i] = hits[i - 1]; --i; }
+            hits[i] = h;
+        }
+        for (int i = 0; i < nh; ++i) stack[sp++] = hits[i];
+    }
+    return hit_any;
+}
@@ -0,0 +1,1697 @@
+// Micro/macro benchmarks for the renderer. Not part of the render path.
+//   bench <name> [args...]      run one benchmark
+//   bench                       list available benchmarks
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "parallel.h"
+#include "sampler.h"
+#include "simd.h"
+#include "JSONReader.h"
+#include "OBJLoader.h"
+#include "SceneCache.h"
+#include "hittable_list.h"
+#include "camera.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define RT_BENCH_FORK 1
+#endif
+
+using BenchFn = std::function<int(const std::vector<std::string>& args)>;
+
+static std::map<std::string, std::pair<std::string, BenchFn>>& registry()
+{
+    static std::map<std::string, std::pair<std::string, BenchFn>> r;
+    return r;
+}
+
+static void registerBench(const std::string& name, const std::string& help, BenchFn fn)
+{
+    registry()[name] = {help, std::move(fn)};
+}
+
+template <typename Fn>
+static double timeSeconds(Fn&& fn)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// ---------------------------------------------------------------- rng
+// ns per random number: the old std::rand() path against PCG32 and the per-sample
+// Sampler (which also pays for reseeding at every camera sample / bounce).
+static int benchRng(const std::vector<std::string>& args)
+{
+    const long long n = args.empty() ? 50'000'000LL : std::atoll(args[0].c_str());
+    constexpr int draws_per_sample = 16; // roughly a pixel offset plus a few bounces
+
+    double sink = 0.0;
+    auto report = [&](const char* name, double secs) {
+        std::cout << std::left << std::setw(28) << name << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(9) << secs * 1e9 / n << " ns/sample\n";
+    };
+
+    std::srand(1);
+    report("std::rand (legacy)", timeSeconds([&] {
+        for (long long i = 0; i < n; ++i) sink += std::rand() / (RAND_MAX + 1.0);
+    }));
+
+    pcg32 rng;
+    report("pcg32", timeSeconds([&] {
+        for (long long i = 0; i < n; ++i) sink += rng.next_double();
+    }));
+
+    report("Sampler (reseed every 16)", timeSeconds([&] {
+        Sampler s;
+        for (long long i = 0; i < n; i += draws_per_sample) {
+            s.start(static_cast<std::uint32_t>(i >> 8), static_cast<std::uint32_t>(i & 255));
+            for (int k = 0; k < draws_per_sample; ++k) sink += s.get1D();
+        }
+    }));
+
+    std::cout << "(checksum " << sink << ")\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------- scenes
+static const char* kDefaultScene = "scene_export2/scene_export.json";
+
+static bool loadExportedScene(const std::string& path, hittable_list& world)
+{
+    try {
+        JSONReader reader{};
+        bd::Scene scene = reader.loadFromFile(path);
+        world.loadScene(scene);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "skipping " << path << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// A large ground plane next to many small spheres: the case where median splits
+// produce heavily overlapping nodes.
+static void makeGroundAndSpheres(hittable_list& world, int n_spheres, std::uint32_t seed = 7)
+{
+    const std::uint32_t mat = world.add_material(std::make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+    world.add(std::make_shared<rt::plane>(point3(-500, -500, 0), point3(500, -500, 0),
+                                          point3(500, 500, 0), point3(-500, 500, 0), mat));
+    Sampler s(seed, 0);
+    for (int i = 0; i < n_spheres; ++i) {
+        double x = s.get1D(-20, 20), y = s.get1D(-20, 20), z = s.get1D(0.2, 4);
+        world.add(std::make_shared<rt::sphere>(point3(x, y, z), s.get1D(0.05, 0.3), mat));
+    }
+}
+
+// n spheres scattered through a cube of half-size `extent`, the particle-style case.
+static void makeSphereCloud(hittable_list& world, int n_spheres, double extent = 100.0, std::uint32_t seed = 11)
+{
+    const std::uint32_t mat = world.add_material(std::make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+    world.objects.reserve(world.objects.size() + static_cast<size_t>(n_spheres));
+    Sampler s(seed, 0);
+    for (int i = 0; i < n_spheres; ++i) {
+        if ((i & 0xffff) == 0) s.start(seed, static_cast<std::uint32_t>(i));
+        double x = s.get1D(-extent, extent), y = s.get1D(-extent, extent), z = s.get1D(-extent, extent);
+        world.add(std::make_shared<rt::sphere>(point3(x, y, z), s.get1D(0.1, 0.5), mat));
+    }
+}
+
+// Rays from random points on a sphere around the scene towards random points inside it.
+static std::vector<ray> makeRays(const bounds3& b, int n, std::uint32_t seed = 3)
+{
+    std::vector<ray> rays;
+    rays.reserve(static_cast<size_t>(n));
+    const point3 c = b.Centroid();
+    const double radius = 0.75 * b.diagonal().length();
+    for (int i = 0; i < n; ++i) {
+        Sampler s(seed, static_cast<std::uint32_t>(i));
+        point3 origin = c + radius * random_unit_vector(s);
+        point3 target(s.get1D(b.pMin.x(), b.pMax.x()), s.get1D(b.pMin.y(), b.pMax.y()),
+                      s.get1D(b.pMin.z(), b.pMax.z()));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+struct TraceResult { double seconds = 0; size_t hits = 0; double t_sum = 0; };
+
+template <typename HitFn>
+static TraceResult traceAll(const std::vector<ray>& rays, HitFn&& hit)
+{
+    TraceResult res;
+    res.seconds = timeSeconds([&] {
+        for (const ray& r : rays) {
+            hit_record rec;
+            if (hit(r, rec)) { ++res.hits; res.t_sum += rec.t; }
+        }
+    });
+    return res;
+}
+
+static void printTrace(const char* name, const TraceResult& r, size_t n_rays, double baseline_s)
+{
+    std::cout << "  " << std::left << std::setw(22) << name << std::right << std::fixed
+              << std::setw(9) << std::setprecision(2) << n_rays / r.seconds * 1e-6 << " Mrays/s"
+              << std::setw(8) << std::setprecision(2) << baseline_s / r.seconds << "x"
+              << "   hits " << r.hits << "  sum(t) " << std::setprecision(6) << r.t_sum << "\n";
+}
+
+// ---------------------------------------------------------------- bvh-traverse
+// Recursive shared_ptr BVHNode traversal vs the flattened 32-byte node array, and the
+// flattened traversal without surface(): what the closest hit's shading data costs.
+static int benchBvhTraverse(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 1 ? std::atoi(args[1].c_str()) : 1'000'000;
+    const int n_rays    = args.size() > 2 ? std::atoi(args[2].c_str()) : 1'000'000;
+
+    struct Case { std::string name; hittable_list world; };
+    std::vector<Case> cases(2);
+    cases[0].name = "exported scene";
+    if (!loadExportedScene(args.empty() ? kDefaultScene : args[0], cases[0].world)) cases.erase(cases.begin());
+    cases.back().name = std::to_string(n_spheres) + " spheres";
+    makeSphereCloud(cases.back().world, n_spheres);
+
+    for (auto& c : cases) {
+        BVHBuildOptions opts;
+        opts.method = SplitMethod::SAH;
+        BVH bvh(c.world.objects, opts);
+        std::vector<ray> rays = makeRays(bvh.getBounds(), n_rays);
+        std::cout << c.name << ": " << bvh.node_count() << " nodes, " << rays.size() << " rays\n";
+
+        TraceResult before = traceAll(rays, [&](const ray& r, hit_record& rec) {
+            return bvh.hit_recursive(r, interval(1e-4, infinity), rec);
+        });
+        TraceResult after = traceAll(rays, [&](const ray& r, hit_record& rec) {
+            return bvh.hit(r, interval(1e-4, infinity), rec);
+        });
+        TraceResult bare = traceAll(rays, [&](const ray& r, hit_record& rec) {
+            hit_info h;
+            if (!bvh.intersect(r, interval(1e-4, infinity), h)) return false;
+            rec.t = h.t;
+            return true;
+        });
+        printTrace("recursive BVHNode", before, rays.size(), before.seconds);
+        printTrace("linear 32B nodes", after, rays.size(), before.seconds);
+        printTrace("linear, intersect only", bare, rays.size(), before.seconds);
+        if (before.hits != after.hits || bare.hits != after.hits) std::cout << "  MISMATCH in hit count\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- bvh-leaf
+// Leaf size 1..8 and SAH-chosen leaves: node count, fill, memory and traversal speed.
+static int benchBvhLeaf(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 0 ? std::atoi(args[0].c_str()) : 200'000;
+    const int n_rays    = args.size() > 1 ? std::atoi(args[1].c_str()) : 300'000;
+    hittable_list world;
+    makeSphereCloud(world, n_spheres);
+    std::cout << n_spheres << " spheres, " << n_rays << " rays, SAH/16 builds\n";
+    std::cout << std::left << std::setw(8) << "leaf" << std::right << std::setw(10) << "nodes"
+              << std::setw(9) << "leaves" << std::setw(8) << "fill" << std::setw(12) << "tree KiB"
+              << std::setw(12) << "flat KiB" << std::setw(10) << "SAH" << std::setw(10) << "Mrays/s" << "\n";
+
+    std::vector<ray> rays;
+    for (int leaf : {1, 2, 4, 8, 0}) {
+        BVHBuildOptions opts;
+        opts.method        = SplitMethod::SAH;
+        opts.max_leaf_size = leaf ? leaf : kBVHMaxLeafSize;
+        opts.sah_leaves    = leaf == 0;
+        BVH bvh(world.objects, opts);
+        if (rays.empty()) rays = makeRays(bvh.getBounds(), n_rays);
+        TraceResult tr = traceAll(rays, [&](const ray& r, hit_record& rec) {
+            return bvh.hit(r, interval(1e-4, infinity), rec);
+        });
+        BVHStats st = bvh.stats();
+        std::cout << std::left << std::setw(8) << (leaf ? std::to_string(leaf) : std::string("auto"))
+                  << std::right << std::setw(10) << st.nodes << std::setw(9) << st.leaves
+                  << std::fixed << std::setprecision(2) << std::setw(8) << double(st.primitives) / st.leaves
+                  << std::setw(12) << std::setprecision(0) << st.tree_bytes / 1024.0
+                  << std::setw(12) << st.linear_bytes / 1024.0
+                  << std::setw(10) << std::setprecision(3) << bvh.sah_cost()
+                  << std::setw(10) << std::setprecision(2) << rays.size() / tr.seconds * 1e-6 << "\n";
+        std::cout << "        fill histogram:";
+        for (int k = 1; k <= kBVHMaxLeafSize; ++k) std::cout << " " << k << ":" << st.leaf_fill[k];
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- bvh-build
+// Build time, node count and SAH cost for median vs binned SAH on the same scene.
+static int benchBvhBuild(const std::vector<std::string>& args)
+{
+    struct Case { std::string name; hittable_list world; };
+    std::vector<Case> cases(2);
+    cases[0].name = "exported scene";
+    if (!loadExportedScene(args.empty() ? kDefaultScene : args[0], cases[0].world)) cases.erase(cases.begin());
+    cases.back().name = "ground + 20000 spheres";
+    makeGroundAndSpheres(cases.back().world, 20000);
+
+    std::cout << std::left << std::setw(28) << "scene" << std::setw(14) << "split"
+              << std::right << std::setw(10) << "nodes" << std::setw(12) << "SAH cost"
+              << std::setw(12) << "build ms" << "\n";
+    for (auto& c : cases) {
+        for (int bins : {0, 12, 16, 32}) {
+            BVHBuildOptions opts;
+            opts.method   = bins ? SplitMethod::SAH : SplitMethod::MEDIAN;
+            opts.sah_bins = bins;
+            std::unique_ptr<BVH> bvh;
+            double secs = timeSeconds([&] { bvh = std::make_unique<BVH>(c.world.objects, opts); });
+            std::string split = bins ? "SAH/" + std::to_string(bins) : "median";
+            std::cout << std::left << std::setw(28) << c.name << std::setw(14) << split << std::right
+                      << std::setw(10) << bvh->node_count()
+                      << std::setw(12) << std::fixed << std::setprecision(3) << bvh->sah_cost()
+                      << std::setw(12) << std::setprecision(2) << secs * 1e3 << "\n";
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- bvh-lbvh
+// Parallel LBVH: per-stage build time at 1, 2, 4 ... N threads, then tree quality and
+// trace speed against the recursive builders on the same sphere cloud.
+static int benchBvhLbvh(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 0 ? std::atoi(args[0].c_str()) : 1'000'000;
+    const int n_rays    = args.size() > 1 ? std::atoi(args[1].c_str()) : 500'000;
+    hittable_list world;
+    makeSphereCloud(world, n_spheres);
+    std::cout << n_spheres << " spheres, " << n_rays << " rays\n\n";
+
+    const int max_threads = resolve_thread_count(0);
+    std::vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+
+    std::cout << "LBVH build ms (30-bit codes, leaves <= 1)\n";
+    std::cout << std::setw(8) << "threads" << std::setw(9) << "bounds" << std::setw(9) << "morton"
+              << std::setw(9) << "sort" << std::setw(9) << "emit" << std::setw(9) << "refit"
+              << std::setw(9) << "flatten" << std::setw(9) << "total" << std::setw(9) << "speedup" << "\n";
+    double base_ms = 0.0;
+    for (int t : counts) {
+        BVHBuildOptions opts;
+        opts.method  = SplitMethod::LBVH;
+        opts.threads = t;
+        BVH bvh(world.objects, opts);
+        const BVHBuildTimes& tm = bvh.build_times();
+        if (base_ms == 0.0) base_ms = tm.total_ms;
+        std::cout << std::setw(8) << t << std::fixed << std::setprecision(1)
+                  << std::setw(9) << tm.bounds_ms << std::setw(9) << tm.morton_ms << std::setw(9) << tm.sort_ms
+                  << std::setw(9) << tm.emit_ms << std::setw(9) << tm.refit_ms << std::setw(9) << tm.flatten_ms
+                  << std::setw(9) << tm.total_ms << std::setw(8) << std::setprecision(2) << base_ms / tm.total_ms
+                  << "x\n";
+    }
+
+    struct Config { const char* name; SplitMethod method; bool treelets, morton63; int leaf; };
+    const Config configs[] = {
+        {"median",              SplitMethod::MEDIAN, false, false, 1},
+        {"SAH/16",              SplitMethod::SAH,    false, false, 1},
+        {"SAH/16 leaf auto",    SplitMethod::SAH,    false, false, 0},
+        {"LBVH 30-bit",         SplitMethod::LBVH,   false, false, 1},
+        {"LBVH 63-bit",         SplitMethod::LBVH,   false, true,  1},
+        {"LBVH + treelets",     SplitMethod::LBVH,   true,  false, 1},
+        {"LBVH + tl, leaf auto", SplitMethod::LBVH,  true,  false, 0},
+    };
+    std::cout << "\n" << std::left << std::setw(22) << "builder" << std::right << std::setw(11) << "build ms"
+              << std::setw(10) << "nodes" << std::setw(7) << "depth" << std::setw(10) << "SAH"
+              << std::setw(10) << "Mrays/s" << "\n";
+    std::vector<ray> rays;
+    long long reference_hits = -1;
+    for (const Config& c : configs) {
+        BVHBuildOptions opts;
+        opts.method        = c.method;
+        opts.treelets      = c.treelets;
+        opts.morton63      = c.morton63;
+        opts.max_leaf_size = c.leaf ? c.leaf : kBVHMaxLeafSize;
+        opts.sah_leaves    = c.leaf == 0;
+        std::unique_ptr<BVH> bvh;
+        double secs = timeSeconds([&] { bvh = std::make_unique<BVH>(world.objects, opts); });
+        if (rays.empty()) rays = makeRays(bvh->getBounds(), n_rays);
+        TraceResult tr = traceAll(rays, [&](const ray& r, hit_record& rec) {
+            return bvh->hit(r, interval(1e-4, infinity), rec);
+        });
+        BVHStats st = bvh->stats();
+        std::cout << std::left << std::setw(22) << c.name << std::right << std::fixed
+                  << std::setw(11) << std::setprecision(1) << secs * 1e3
+                  << std::setw(10) << st.nodes << std::setw(7) << st.max_depth
+                  << std::setw(10) << std::setprecision(3) << bvh->sah_cost()
+                  << std::setw(10) << std::setprecision(2) << rays.size() / tr.seconds * 1e-6 << "\n";
+        if (reference_hits < 0) reference_hits = static_cast<long long>(tr.hits);
+        else if (reference_hits != static_cast<long long>(tr.hits)) std::cout << "  MISMATCH in hit count\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- bvh-wide
+// BVH2 vs BVH4 vs BVH8 on the same SAH tree: node fetches, box tests and leaf visits per
+// ray, memory and Mrays/s with the AVX2 kernels and with the scalar fallback.
+static int benchBvhWide(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 0 ? std::atoi(args[0].c_str()) : 1'000'000;
+    const int n_rays    = args.size() > 1 ? std::atoi(args[1].c_str()) : 500'000;
+    hittable_list world;
+    makeSphereCloud(world, n_spheres);
+    std::cout << n_spheres << " spheres, " << n_rays << " rays, SAH/16 builds, AVX2 "
+              << (cpuHasAVX2() ? "available" : "not available") << "\n";
+    std::cout << std::left << std::setw(8) << "width" << std::right << std::setw(10) << "nodes"
+              << std::setw(10) << "MiB" << std::setw(12) << "visits/ray" << std::setw(12) << "boxes/ray"
+              << std::setw(12) << "leaves/ray" << std::setw(14) << "scalar Mr/s" << std::setw(12) << "AVX2 Mr/s"
+              << "\n";
+
+    std::vector<ray> rays;
+    size_t reference_hits = 0;
+    for (int width : {2, 4, 8}) {
+        BVHBuildOptions opts;
+        opts.method = SplitMethod::SAH;
+        opts.width  = width;
+        BVH bvh(world.objects, opts);
+        if (rays.empty()) rays = makeRays(bvh.getBounds(), n_rays);
+
+        BVHTraversalStats ts;
+        for (const ray& r : rays) {
+            hit_info h;
+            bvh.intersect_with_stats(r, interval(1e-4, infinity), h, &ts);
+        }
+        auto trace = [&](bool simd) {
+            setSimdEnabled(simd);
+            TraceResult tr = traceAll(rays, [&](const ray& r, hit_record& rec) {
+                return bvh.hit(r, interval(1e-4, infinity), rec);
+            });
+            if (reference_hits == 0) reference_hits = tr.hits;
+            else if (tr.hits != reference_hits) std::cout << "  MISMATCH in hit count\n";
+            return rays.size() / tr.seconds * 1e-6;
+        };
+        const double scalar = trace(false);
+        const double simd   = cpuHasAVX2() ? trace(true) : 0.0;
+        setSimdEnabled(true);
+
+        BVHStats st = bvh.stats();
+        const size_t nodes = width == 2 ? st.nodes : st.wide_nodes;
+        const size_t bytes = width == 2 ? st.nodes * sizeof(LinearBVHNode) : st.wide_bytes;
+        const double nr = static_cast<double>(rays.size());
+        std::cout << std::left << std::setw(8) << ("BVH" + std::to_string(width)) << std::right
+                  << std::setw(10) << nodes << std::fixed << std::setprecision(1)
+                  << std::setw(10) << bytes / (1024.0 * 1024.0)
+                  << std::setw(12) << ts.nodes / nr << std::setw(12) << ts.box_tests / nr
+                  << std::setw(12) << ts.leaves / nr << std::setprecision(2)
+                  << std::setw(14) << scalar << std::setw(12) << simd << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- packets
+// Primary visibility at preview resolution: single rays vs 2x2, 4x2 and 4x4 packets over
+// a pinhole camera looking across the ground-and-spheres scene.
+static int benchPackets(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 0 ? std::atoi(args[0].c_str()) : 200'000;
+    const int width     = args.size() > 1 ? std::atoi(args[1].c_str()) : 1920;
+    const int height    = args.size() > 2 ? std::atoi(args[2].c_str()) : 1080;
+    hittable_list world;
+    makeGroundAndSpheres(world, n_spheres);
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    BVH bvh(world.objects, opts);
+
+    const point3 eye(0, -30, 12);
+    const vec3 fwd   = unit_vector(point3(0, 0, 1) - eye);
+    const vec3 right = unit_vector(cross(fwd, vec3(0, 0, 1)));
+    const vec3 up    = cross(right, fwd);
+    const double half_h = std::tan(degrees_to_radians(20.0));
+    const double half_w = half_h * width / height;
+    auto primary = [&](int x, int y) {
+        const double u = (2.0 * (x + 0.5) / width - 1.0) * half_w;
+        const double v = (1.0 - 2.0 * (y + 0.5) / height) * half_h;
+        return ray(eye, fwd + u * right + v * up);
+    };
+    std::cout << n_spheres << " spheres + ground, " << width << "x" << height << " primary rays, SIMD "
+              << (simdEnabled() ? "AVX2" : "scalar") << "\n";
+    std::cout << std::left << std::setw(14) << "mode" << std::right << std::setw(10) << "Mrays/s"
+              << std::setw(9) << "speedup" << std::setw(12) << "nodes/ray" << std::setw(10) << "hits" << "\n";
+
+    double base = 0.0;
+    size_t reference_hits = 0;
+    for (int size : {1, 4, 8, 16}) {
+        const int pw = size >= 8 ? 4 : size >= 4 ? 2 : 1;
+        const int ph = size >= 16 ? 4 : size >= 4 ? 2 : 1;
+        BVHTraversalStats ts;
+        size_t hits = 0;
+        auto run = [&](BVHTraversalStats* stats) {
+            hits = 0;
+            for (int by = 0; by < height; by += ph) {
+                for (int bx = 0; bx < width; bx += pw) {
+                    if (size == 1) {
+                        hit_info h;
+                        if (bvh.intersect_with_stats(primary(bx, by), interval(1e-4, infinity), h, stats)) ++hits;
+                        continue;
+                    }
+                    RayPacket packet;
+                    for (int y = by; y < std::min(by + ph, height); ++y)
+                        for (int x = bx; x < std::min(bx + pw, width); ++x)
+                            packet.add(primary(x, y), interval(1e-4, infinity));
+                    hit_info h[kMaxPacketSize];
+                    hits += static_cast<size_t>(laneCount(bvh.intersect_packet_with_stats(packet, h, stats)));
+                }
+            }
+        };
+        run(&ts);
+        const double secs = timeSeconds([&] { run(nullptr); });
+        if (base == 0.0) { base = secs; reference_hits = hits; }
+        const double n = double(width) * height;
+        std::cout << std::left << std::setw(14) << (size == 1 ? std::string("single") : std::to_string(pw) + "x" + std::to_string(ph) + " packet")
+                  << std::right << std::fixed << std::setprecision(2) << std::setw(10) << n / secs * 1e-6
+                  << std::setw(8) << base / secs << "x" << std::setw(12) << std::setprecision(1) << ts.nodes / n
+                  << std::setw(10) << hits << (hits == reference_hits ? "" : "  MISMATCH") << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- shadows
+// Blinn-Phong direct lighting from 8 point lights at the primary hits of the ground-and-
+// spheres scene: closest-hit shadow queries (one per light and term) vs occluded() per
+// term vs one occluded() per light shared by the diffuse and specular terms.
+static int benchShadows(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 0 ? std::atoi(args[0].c_str()) : 200'000;
+    const int n_lights  = args.size() > 1 ? std::atoi(args[1].c_str()) : 8;
+    hittable_list world;
+    makeGroundAndSpheres(world, n_spheres);
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    BVH bvh(world.objects, opts);
+
+    std::vector<PointLightRT> lights;
+    for (int i = 0; i < n_lights; ++i) {
+        const double a = 2.0 * pi * i / n_lights;
+        lights.emplace_back(point3(15 * std::cos(a), 15 * std::sin(a), 10 + i % 3), 500.0);
+    }
+
+    // Shading points: primary hits of a 640x360 view across the field.
+    const int width = 640, height = 360;
+    const point3 eye(0, -30, 12);
+    const vec3 fwd   = unit_vector(point3(0, 0, 1) - eye);
+    const vec3 right = unit_vector(cross(fwd, vec3(0, 0, 1)));
+    const vec3 up    = cross(right, fwd);
+    const double half_h = std::tan(degrees_to_radians(20.0));
+    const double half_w = half_h * width / height;
+    std::vector<hit_record> points;
+    std::vector<vec3> wos;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const double u = (2.0 * (x + 0.5) / width - 1.0) * half_w;
+            const double v = (1.0 - 2.0 * (y + 0.5) / height) * half_h;
+            const ray r(eye, fwd + u * right + v * up);
+            hit_record rec;
+            if (!bvh.hit(r, interval(1e-4, infinity), rec)) continue;
+            points.push_back(rec);
+            wos.push_back(-unit_vector(r.direction()));
+        }
+    }
+
+    // Counts shadow queries; without any_hit, occluded() falls back to the closest-hit default.
+    struct shadow_world : hittable {
+        const BVH& bvh;
+        bool any_hit;
+        mutable size_t queries = 0;
+        shadow_world(const BVH& b, bool any) : bvh(b), any_hit(any) {}
+        bool intersect(const ray& r, interval t, hit_info& h) const override { return bvh.intersect(r, t, h); }
+        bool occluded(const ray& r, interval t) const override {
+            ++queries;
+            return any_hit ? bvh.occluded(r, t) : hittable::occluded(r, t);
+        }
+        bounds3 getBounds() const override { return bvh.getBounds(); }
+    };
+
+    std::cout << n_spheres << " spheres + ground, " << n_lights << " lights, " << points.size()
+              << " shading points\n";
+    std::cout << std::left << std::setw(26) << "shadow query" << std::right << std::setw(10) << "ms"
+              << std::setw(12) << "rays/point" << std::setw(10) << "Mrays/s" << std::setw(9) << "speedup"
+              << std::setw(12) << "max diff" << "\n";
+    std::vector<color> reference;
+    double base = 0.0;
+    for (int mode = 0; mode < 3; ++mode) {
+        shadow_world sw(bvh, mode > 0);
+        std::vector<color> out(points.size());
+        const double secs = timeSeconds([&] {
+            for (size_t i = 0; i < points.size(); ++i) {
+                color Ld, Ls;
+                if (mode < 2) {
+                    Ld = BlinnPhongDiffuse(points[i], sw, lights);
+                    Ls = BlinnPhongSpec(points[i], sw, lights, wos[i], color(0.6), 24.0);
+                } else {
+                    BlinnPhong(points[i], sw, lights, wos[i], color(0.6), 24.0, Ld, Ls);
+                }
+                out[i] = Ld + Ls;
+            }
+        });
+        if (mode == 0) { reference = out; base = secs; }
+        double diff = 0.0;
+        for (size_t i = 0; i < out.size(); ++i)
+            for (int c = 0; c < 3; ++c) diff = std::max(diff, double(std::fabs(out[i][c] - reference[i][c])));
+        const char* name = mode == 0 ? "closest-hit, per term" : mode == 1 ? "occluded, per term" : "occluded, shared";
+        std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << secs * 1e3
+                  << std::setprecision(2) << std::setw(12) << double(sw.queries) / points.size()
+                  << std::setw(10) << sw.queries / secs * 1e-6 << std::setw(8) << base / secs << "x"
+                  << std::setprecision(3) << std::setw(12) << diff << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- mesh
+// A g x g heightfield (2 (g-1)^2 triangles) as one indexed triangle_mesh vs one
+// shared_ptr<triangle> per face under the scene BVH: memory, build time and Mrays/s.
+static int benchMesh(const std::vector<std::string>& args)
+{
+    const int n_tris = args.size() > 0 ? std::atoi(args[0].c_str()) : 2'000'000;
+    const int n_rays = args.size() > 1 ? std::atoi(args[1].c_str()) : 1'000'000;
+    const int g = std::max(2, static_cast<int>(std::sqrt(n_tris / 2.0)) + 1);
+
+    std::vector<point3> pos;
+    std::vector<std::uint32_t> idx;
+    pos.reserve(static_cast<size_t>(g) * g);
+    for (int y = 0; y < g; ++y)
+        for (int x = 0; x < g; ++x) {
+            const double px = 100.0 * x / (g - 1) - 50.0, py = 100.0 * y / (g - 1) - 50.0;
+            pos.emplace_back(px, py, 3.0 * std::sin(0.3 * px) * std::cos(0.2 * py));
+        }
+    for (int y = 0; y + 1 < g; ++y)
+        for (int x = 0; x + 1 < g; ++x) {
+            const std::uint32_t i = static_cast<std::uint32_t>(y * g + x);
+            idx.insert(idx.end(), {i, i + 1, i + g + 1, i, i + g + 1, i + g});
+        }
+    const size_t tris = idx.size() / 3;
+    const std::uint32_t mat = 0;
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    opts.max_leaf_size = 4;
+    opts.sah_leaves = true;
+
+    std::cout << tris << " triangles (" << g << "x" << g << " heightfield), " << n_rays << " rays\n";
+    std::cout << std::left << std::setw(26) << "representation" << std::right << std::setw(12) << "build ms"
+              << std::setw(12) << "MB" << "\n";
+
+    // 逐个三角形：每个面一个 shared_ptr<triangle>（对象 + 控制块 + 指针）
+    std::vector<std::shared_ptr<hittable>> objs;
+    double objs_ms = 1e3 * timeSeconds([&] {
+        objs.reserve(tris);
+        for (size_t t = 0; t < tris; ++t)
+            objs.push_back(std::make_shared<triangle>(pos[idx[3 * t]], pos[idx[3 * t + 1]], pos[idx[3 * t + 2]], mat));
+    });
+    std::unique_ptr<BVH> bvh;
+    objs_ms += 1e3 * timeSeconds([&] { bvh = std::make_unique<BVH>(objs, opts); });
+    const BVHStats st = bvh->stats();
+    const size_t objs_bytes = tris * (sizeof(triangle) + 16 + 2 * sizeof(std::shared_ptr<hittable>)) + st.linear_bytes;
+
+    std::unique_ptr<rt::triangle_mesh> mesh;
+    const double mesh_ms = 1e3 * timeSeconds([&] {
+        mesh = std::make_unique<rt::triangle_mesh>(pos, idx, std::vector<vec3>{}, std::vector<std::uint32_t>{},
+                                                   std::vector<point2>{}, std::vector<std::uint32_t>{}, mat, opts);
+    });
+    auto row = [](const char* name, double ms, size_t bytes) {
+        std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ms << std::setw(12) << bytes / 1048576.0 << "\n";
+    };
+    row("shared_ptr<triangle> + BVH", objs_ms, objs_bytes);
+    row("triangle_mesh", mesh_ms, mesh->bytes());
+
+    const std::vector<ray> rays = makeRays(mesh->getBounds(), n_rays);
+    const TraceResult a = traceAll(rays, [&](const ray& r, hit_record& rec) { return bvh->hit(r, interval(1e-4, infinity), rec); });
+    const TraceResult b = traceAll(rays, [&](const ray& r, hit_record& rec) { return mesh->hit(r, interval(1e-4, infinity), rec); });
+    printTrace("shared_ptr<triangle>", a, rays.size(), a.seconds);
+    printTrace("triangle_mesh", b, rays.size(), a.seconds);
+    return 0;
+}
+
+// ---------------------------------------------------------------- obj
+// Legacy getline/istringstream OBJ parser vs the mmap + parallel two-pass loader: MB/s
+// and peak resident memory. Each loader runs in a child process so that each peak is its
+// own; the child reports counts and a checksum back through a pipe.
+struct OBJRun {
+    double ms = 0.0;
+    long   peak_kb = 0;
+    size_t verts = 0, norms = 0, tex = 0, tris = 0;
+    long long index_sum = 0;
+    double coord_sum = 0.0;
+    bool ok = false;
+};
+
+static OBJRun runOBJLoader(const std::string& path, bool legacy)
+{
+    OBJRun r;
+    OBJData d;
+    const auto t0 = std::chrono::steady_clock::now();
+    r.ok = legacy ? loadOBJLegacy(path, d) : loadOBJ(path, d);
+    r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    r.verts = d.verts.size(); r.norms = d.norms.size(); r.tex = d.tex.size(); r.tris = d.faceVerts.size() / 3;
+    for (const point3& v : d.verts) r.coord_sum += std::fabs(v.x()) + std::fabs(v.y()) + std::fabs(v.z());
+    for (const auto* f : {&d.faceVerts, &d.faceTexs, &d.faceNorms})
+        for (int i : *f) r.index_sum += i;
+    return r;
+}
+
+// Runs fn() in a child process so that the peak resident memory it reports is fn's own;
+// the result (trivially copyable) comes back through a pipe. Without fork it runs
+// in-process and peak_kb is 0.
+template <typename R, typename Fn>
+static R runIsolated(Fn&& fn, long& peak_kb)
+{
+    peak_kb = 0;
+#ifdef RT_BENCH_FORK
+    int fds[2];
+    if (pipe(fds) == 0) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            const R r = fn();
+            const ssize_t n = write(fds[1], &r, sizeof(r));
+            _exit(n == static_cast<ssize_t>(sizeof(r)) ? 0 : 1);
+        }
+        close(fds[1]);
+        R r;
+        const bool got = pid > 0 && read(fds[0], &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r));
+        close(fds[0]);
+        int status = 0;
+        struct rusage ru {};
+        if (pid > 0) wait4(pid, &status, 0, &ru);
+        if (got) {
+            peak_kb = ru.ru_maxrss;
+#ifdef __APPLE__
+            peak_kb /= 1024;  // bytes on macOS
+#endif
+            return r;
+        }
+    }
+#endif
+    return fn();
+}
+
+static OBJRun runOBJLoaderIsolated(const std::string& path, bool legacy)
+{
+    long peak_kb = 0;
+    OBJRun r = runIsolated<OBJRun>([&] { return runOBJLoader(path, legacy); }, peak_kb);
+    r.peak_kb = peak_kb;
+    return r;
+}
+
+// g x g heightfield with positions, texcoords and normals, triangulated "f v/t/n" faces.
+static bool writeGridOBJ(const std::string& path, int g)
+{
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    for (int y = 0; y < g; ++y)
+        for (int x = 0; x < g; ++x) {
+            const double px = 100.0 * x / (g - 1) - 50.0, py = 100.0 * y / (g - 1) - 50.0;
+            std::fprintf(f, "v %.6f %.6f %.6f\n", px, py, 3.0 * std::sin(0.3 * px) * std::cos(0.2 * py));
+        }
+    for (int y = 0; y < g; ++y)
+        for (int x = 0; x < g; ++x) std::fprintf(f, "vt %.6f %.6f\n", double(x) / (g - 1), double(y) / (g - 1));
+    for (int y = 0; y < g; ++y)
+        for (int x = 0; x < g; ++x) {
+            const double px = 100.0 * x / (g - 1) - 50.0, py = 100.0 * y / (g - 1) - 50.0;
+            const vec3 n = unit_vector(vec3(-0.9 * std::cos(0.3 * px) * std::cos(0.2 * py),
+                                            0.6 * std::sin(0.3 * px) * std::sin(0.2 * py), 1.0));
+            std::fprintf(f, "vn %.6f %.6f %.6f\n", n.x(), n.y(), n.z());
+        }
+    for (int y = 0; y + 1 < g; ++y)
+        for (int x = 0; x + 1 < g; ++x) {
+            const int i = y * g + x + 1;
+            std::fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", i, i, i, i + 1, i + 1, i + 1, i + g + 1, i + g + 1, i + g + 1);
+            std::fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", i, i, i, i + g + 1, i + g + 1, i + g + 1, i + g, i + g, i + g);
+        }
+    return std::fclose(f) == 0;
+}
+
+static int benchObj(const std::vector<std::string>& args)
+{
+    std::string path = args.size() > 0 ? args[0] : "";
+    if (path.empty() || !std::filesystem::exists(path)) {
+        const int n_tris = path.empty() ? 2'000'000 : std::atoi(path.c_str());
+        const int g = std::max(2, static_cast<int>(std::sqrt(n_tris / 2.0)) + 1);
+        path = (std::filesystem::temp_directory_path() / ("bench_grid_" + std::to_string(g) + ".obj")).string();
+        if (!std::filesystem::exists(path)) {
+            std::cout << "writing " << path << " ...\n";
+            if (!writeGridOBJ(path, g)) { std::cerr << "cannot write " << path << "\n"; return 1; }
+        }
+    }
+    const double mb = std::filesystem::file_size(path) / 1048576.0;
+    std::cout << path << ": " << std::fixed << std::setprecision(1) << mb << " MB, "
+              << resolve_thread_count(0) << " threads\n";
+    std::cout << std::left << std::setw(10) << "loader" << std::right << std::setw(10) << "ms"
+              << std::setw(10) << "MB/s" << std::setw(14) << "peak RSS MB" << std::setw(10) << "speedup"
+              << "   verts / tris / checksum\n";
+    double base = 0.0;
+    for (bool legacy : {true, false}) {
+        const OBJRun r = runOBJLoaderIsolated(path, legacy);
+        if (!r.ok) { std::cerr << "failed to load " << path << "\n"; return 1; }
+        if (legacy) base = r.ms;
+        std::cout << std::left << std::setw(10) << (legacy ? "legacy" : "mmap") << std::right
+                  << std::setprecision(1) << std::setw(10) << r.ms << std::setw(10) << mb / (r.ms * 1e-3)
+                  << std::setw(14) << (r.peak_kb ? std::to_string(r.peak_kb / 1024) : std::string("n/a"))
+                  << std::setprecision(2) << std::setw(9) << base / r.ms << "x"
+                  << "   " << r.verts << " / " << r.tris << " / " << r.index_sum << " "
+                  << std::setprecision(3) << r.coord_sum << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- json
+// DOM (`ifs >> json`, then the handlers) vs the streaming SAX loader on a generated scene
+// of spheres, cubes and planes: MB/s and peak resident memory, each in its own process.
+struct JSONRun {
+    double ms = 0.0;
+    size_t cameras = 0, spheres = 0, cubes = 0, planes = 0;
+    double checksum = 0.0;
+    bool ok = false;
+};
+
+static JSONRun runJSONLoader(const std::string& path, bool dom)
+{
+    JSONRun r;
+    try {
+        JSONReader reader{};
+        bd::Scene scene;
+        r.ms = 1e3 * timeSeconds([&] { scene = dom ? reader.loadFromFileDOM(path) : reader.loadFromFile(path); });
+        r.cameras = scene.cameras.size(); r.spheres = scene.spheres.size();
+        r.cubes = scene.cubes.size();     r.planes = scene.planes.size();
+        for (const auto& s : scene.spheres) r.checksum += s.radius + std::fabs(s.location.x());
+        for (const auto& c : scene.cubes) r.checksum += c.scale_1d + std::fabs(c.translation.z());
+        for (const auto& p : scene.planes) r.checksum += std::fabs(p.corners[2].y()) + p.uv_scale.x();
+        r.ok = true;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+    }
+    return r;
+}
+
+// The exporter's layout: one object per line inside each section array.
+static bool writeObjectSceneJSON(const std::string& path, int n)
+{
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    pcg32 rng;
+    auto u = [&] { return 200.0 * rng.next_double() - 100.0; };
+    std::fprintf(f, "{\"cameras\": [{\"name\": \"Camera\", \"location\": [0, -150, 60], \"gaze\": [0, 0.928, -0.371],"
+                    " \"up\": [0, 0.371, 0.928], \"focal_length_mm\": 50.0, \"sensor_width_mm\": 36.0,"
+                    " \"sensor_height_mm\": 24.0, \"film_resolution\": {\"x\": 640, \"y\": 480}}],\n");
+    std::fprintf(f, " \"point_lights\": [{\"name\": \"Light\", \"location\": [20, -40, 80], \"radiant_intensity\": 1000.0}],\n");
+    std::fprintf(f, " \"spheres\": [\n");
+    for (int i = 0; i < n / 2; ++i)
+        std::fprintf(f, "  {\"name\": \"Sphere.%06d\", \"location\": [%.17g, %.17g, %.17g], \"radius\": %.17g}%s\n",
+                     i, u(), u(), u(), 0.1 + rng.next_double(), i + 1 < n / 2 ? "," : "");
+    std::fprintf(f, " ],\n \"cubes\": [\n");
+    for (int i = 0; i < n / 4; ++i)
+        std::fprintf(f, "  {\"name\": \"Cube.%06d\", \"translation\": [%.17g, %.17g, %.17g],"
+                        " \"rotation_euler_xyz_radians\": [0.0, %.17g, 0.0], \"scale_1d\": %.17g}%s\n",
+                     i, u(), u(), u(), rng.next_double(), 0.5 + rng.next_double(), i + 1 < n / 4 ? "," : "");
+    std::fprintf(f, " ],\n \"planes\": [\n");
+    for (int i = 0; i < n / 4; ++i) {
+        const double x = u(), y = u(), z = u();
+        std::fprintf(f, "  {\"name\": \"Plane.%06d\", \"corners\": [[%.17g, %.17g, %.17g], [%.17g, %.17g, %.17g],"
+                        " [%.17g, %.17g, %.17g], [%.17g, %.17g, %.17g]], \"texture\": \"\", \"uv_scale\": [1.0, 1.0],"
+                        " \"uv_offset\": [0.0, 0.0]}%s\n",
+                     i, x, y, z, x + 1, y, z, x + 1, y + 1, z, x, y + 1, z, i + 1 < n / 4 ? "," : "");
+    }
+    std::fprintf(f, " ]\n}\n");
+    return std::fclose(f) == 0;
+}
+
+static int benchJson(const std::vector<std::string>& args)
+{
+    std::string path = args.size() > 0 ? args[0] : "";
+    if (path.empty() || !std::filesystem::exists(path)) {
+        const int n = path.empty() ? 1'000'000 : std::atoi(path.c_str());
+        path = (std::filesystem::temp_directory_path() / ("bench_scene_" + std::to_string(n) + ".json")).string();
+        if (!std::filesystem::exists(path)) {
+            std::cout << "writing " << path << " ...\n";
+            if (!writeObjectSceneJSON(path, n)) { std::cerr << "cannot write " << path << "\n"; return 1; }
+        }
+    }
+    const double mb = std::filesystem::file_size(path) / 1048576.0;
+    std::cout << path << ": " << std::fixed << std::setprecision(1) << mb << " MB\n";
+    std::cout << std::left << std::setw(10) << "loader" << std::right << std::setw(10) << "ms"
+              << std::setw(10) << "MB/s" << std::setw(14) << "peak RSS MB" << std::setw(10) << "speedup"
+              << "   spheres / cubes / planes / checksum\n";
+    double base = 0.0;
+    for (bool dom : {true, false}) {
+        long peak_kb = 0;
+        const JSONRun r = runIsolated<JSONRun>([&] { return runJSONLoader(path, dom); }, peak_kb);
+        if (!r.ok) { std::cerr << "failed to load " << path << "\n"; return 1; }
+        if (dom) base = r.ms;
+        std::cout << std::left << std::setw(10) << (dom ? "DOM" : "SAX") << std::right
+                  << std::setprecision(1) << std::setw(10) << r.ms << std::setw(10) << mb / (r.ms * 1e-3)
+                  << std::setw(14) << (peak_kb ? std::to_string(peak_kb / 1024) : std::string("n/a"))
+                  << std::setprecision(2) << std::setw(9) << base / r.ms << "x"
+                  << "   " << r.spheres << " / " << r.cubes << " / " << r.planes << " / "
+                  << std::setprecision(3) << r.checksum << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- instancing
+// n randomly rotated and scaled cubes over a ground plane, built flattened (one rt::cube
+// per cube in the scene BVH), as instances of the shared unit box (the default) and as
+// instances of a 12-triangle unit-cube mesh, both under a top-level BVH. Each variant
+// builds and renders a frame in its own process, so the peak RSS is its own.
+enum class CubeRep { Flat, BoxInstances, MeshInstances };
+
+// The [-1, 1]^3 cube as a 12-triangle mesh, every face wound CCW seen from outside so
+// front_face matches rt::cube.
+static std::shared_ptr<rt::triangle_mesh> unitCubeMesh()
+{
+    std::vector<point3> P{point3(-1,-1,-1), point3( 1,-1,-1), point3( 1, 1,-1), point3(-1, 1,-1),
+                          point3(-1,-1, 1), point3( 1,-1, 1), point3( 1, 1, 1), point3(-1, 1, 1)};
+    const std::uint32_t quads[6][4] = {{0,3,2,1}, {4,5,6,7}, {0,1,5,4}, {3,7,6,2}, {0,4,7,3}, {1,2,6,5}};
+    std::vector<std::uint32_t> idx;
+    for (const auto& q : quads) idx.insert(idx.end(), {q[0], q[1], q[2], q[0], q[2], q[3]});
+    BVHBuildOptions opts;
+    opts.method        = SplitMethod::SAH;
+    opts.max_leaf_size = kBVHMaxLeafSize;  // 12 triangles: fewer nodes beat tighter leaves
+    opts.sah_leaves    = true;
+    return std::make_shared<rt::triangle_mesh>(std::move(P), std::move(idx), std::vector<vec3>{}, std::vector<std::uint32_t>{},
+                                               std::vector<point2>{}, std::vector<std::uint32_t>{}, 0, opts);
+}
+struct InstancingRun {
+    double build_ms = 0.0, render_ms = 0.0, mrays = 0.0;
+    size_t geometry_bytes = 0;
+    double image_sum = 0.0;
+    bool ok = false;
+};
+
+static InstancingRun runInstancing(int n_cubes, int width, int height, CubeRep rep)
+{
+    InstancingRun r;
+    bd::Scene scene;
+    pcg32 rng;
+    const double extent = 10.0 * std::sqrt(double(n_cubes));
+    for (int i = 0; i < n_cubes; ++i) {
+        bd::Cube c;
+        c.translation = vec3(extent * (2 * rng.next_double() - 1), extent * (2 * rng.next_double() - 1), 1.0 + 3.0 * rng.next_double());
+        c.rotation_euler_xyz_rad = vec3(2 * pi * rng.next_double(), 2 * pi * rng.next_double(), 2 * pi * rng.next_double());
+        c.scale_1d = 0.5 + rng.next_double();
+        scene.cubes.push_back(c);
+    }
+    bd::Plane ground;
+    const double g = 1.2 * extent;
+    ground.corners = {point3(-g, -g, 0), point3(g, -g, 0), point3(g, g, 0), point3(-g, g, 0)};
+    scene.planes.push_back(ground);
+    scene.point_lights.push_back(bd::PointLight{"Light", vec3(0.3 * extent, -0.5 * extent, 2.0 * extent), 1e6});
+
+    hittable_list world;
+    world.instance_cubes = rep == CubeRep::BoxInstances;
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    const std::shared_ptr<rt::triangle_mesh> mesh = rep == CubeRep::MeshInstances ? unitCubeMesh() : nullptr;
+    r.build_ms = 1e3 * timeSeconds([&] {
+        std::streambuf* old = std::clog.rdbuf(nullptr);  // loadScene's "No spheres" etc.
+        if (mesh) {
+            // loadScene's instancing loop with the mesh as the shared geometry
+            std::vector<bd::Cube> cubes;
+            cubes.swap(scene.cubes);
+            world.loadScene(scene);
+            auto tlas = std::make_shared<rt::instance_bvh>();
+            const std::uint32_t unit = tlas->add_geometry(mesh);
+            const std::uint32_t mat = world.add_material(std::make_shared<lambertian>(color(0.1, 0.2, 0.5)));
+            for (auto& c : cubes)
+                tlas->add(unit, rt::cube::object_to_world(c.rotation_euler_xyz_rad, c.scale_1d), c.translation, mat);
+            tlas->build(opts);
+            world.add(tlas);
+        } else {
+            world.loadScene(scene);
+        }
+        std::clog.rdbuf(old);
+        world.bvh = std::make_unique<BVH>(world.objects, opts);
+    });
+    const BVHStats st = world.bvh->stats();
+    if (rep != CubeRep::Flat) {
+        for (const auto& o : world.objects)
+            if (auto* tlas = dynamic_cast<const rt::instance_bvh*>(o.get()))
+                r.geometry_bytes += tlas->bytes(mesh ? mesh->bytes() : sizeof(rt::cube));
+    } else {
+        // cube + control block + pointers in objects and the BVH
+        r.geometry_bytes = size_t(n_cubes) * (sizeof(rt::cube) + 16
+                                              + 2 * sizeof(std::shared_ptr<hittable>) + sizeof(const hittable*));
+    }
+    r.geometry_bytes += st.linear_bytes;
+
+    bd::Camera cam_data;
+    cam_data.location = vec3(0, -1.3 * extent, 0.6 * extent);
+    cam_data.gaze = unit_vector(vec3(0, 0, 0) - cam_data.location);
+    cam_data.up = unit_vector(cross(cross(cam_data.gaze, vec3(0, 0, 1)), cam_data.gaze));
+    cam_data.focal_mm = 30.0; cam_data.sensor_w_mm = 36.0; cam_data.sensor_h_mm = 24.0;
+    cam_data.film_x = width; cam_data.film_y = height;
+    rt::camera cam(cam_data);
+    cam.samples_per_pixel = 1;
+    cam.materials = &world.materials;
+    rt::camera::render_stats rs;
+    std::streambuf* old = std::clog.rdbuf(nullptr);
+    const Image img = cam.render(world, world.pointLights, &rs);
+    std::clog.rdbuf(old);
+    r.render_ms = rs.seconds * 1e3;
+    r.mrays = rs.mrays_per_sec();
+    for (const color& c : img.pixels()) r.image_sum += c.x() + c.y() + c.z();
+    r.ok = true;
+    return r;
+}
+
+static int benchInstancing(const std::vector<std::string>& args)
+{
+    const int n_cubes = args.size() > 0 ? std::atoi(args[0].c_str()) : 100'000;
+    const int width   = args.size() > 1 ? std::atoi(args[1].c_str()) : 640;
+    const int height  = args.size() > 2 ? std::atoi(args[2].c_str()) : 480;
+    std::cout << n_cubes << " rotated cubes + ground, " << width << "x" << height << " at 1 spp, "
+              << resolve_thread_count(0) << " threads\n";
+    std::cout << std::left << std::setw(26) << "representation" << std::right << std::setw(10) << "build ms"
+              << std::setw(13) << "geometry MB" << std::setw(14) << "peak RSS MB" << std::setw(11) << "render ms"
+              << std::setw(10) << "Mrays/s" << "   image sum\n";
+    for (CubeRep rep : {CubeRep::Flat, CubeRep::BoxInstances, CubeRep::MeshInstances}) {
+        long peak_kb = 0;
+        const InstancingRun r = runIsolated<InstancingRun>([&] { return runInstancing(n_cubes, width, height, rep); }, peak_kb);
+        if (!r.ok) return 1;
+        std::cout << std::left << std::setw(26) << (rep == CubeRep::Flat         ? "rt::cube (oriented box)"
+                                                  : rep == CubeRep::BoxInstances ? "instances of unit box"
+                                                                                 : "instances of 12-tri mesh")
+                  << std::right << std::fixed << std::setprecision(1) << std::setw(10) << r.build_ms
+                  << std::setw(13) << r.geometry_bytes / 1048576.0
+                  << std::setw(14) << (peak_kb ? std::to_string(peak_kb / 1024) : std::string("n/a"))
+                  << std::setw(11) << r.render_ms << std::setw(10) << std::setprecision(2) << r.mrays
+                  << "   " << std::setprecision(3) << r.image_sum << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- intersect
+// ns per hit() / occluded() call on a single quad and a single rotated cube: the analytic
+// parallelogram and oriented-box tests against the earlier paths (a quad as two
+// Möller–Trumbore triangles, a cube as six such quads), rebuilt here from
+// plane::intersect_tri / plane::fill. Rays are aimed at a square a bit larger than the
+// object, so some of them miss.
+struct TwoTriangleQuad {
+    point3 v0, v1, v2, v3;
+    std::uint32_t mat;
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+        real t0, t1;
+        const bool h0 = rt::plane::intersect_tri(v0, v1, v2, r, ray_t, t0);
+        const bool h1 = rt::plane::intersect_tri(v0, v2, v3, r, ray_t, t1);
+        if (!h0 && !h1) return false;
+        rec.t = h0 && (!h1 || t0 < t1) ? t0 : t1;
+        if (h0 && (!h1 || t0 < t1)) rt::plane::fill(v0, v1, v2, r, t0, rec);
+        else                        rt::plane::fill(v0, v2, v3, r, t1, rec);
+        rec.mat_id = mat;
+        return true;
+    }
+    bool occluded(const ray& r, interval ray_t) const {
+        real t;
+        return rt::plane::intersect_tri(v0, v1, v2, r, ray_t, t) || rt::plane::intersect_tri(v0, v2, v3, r, ray_t, t);
+    }
+};
+
+struct SixQuadCube {
+    std::vector<TwoTriangleQuad> faces;
+    std::uint32_t mat;
+    SixQuadCube(vec3 translation, vec3 rotation, double s, std::uint32_t m) : mat(m) {
+        std::vector<point3> P{point3(-s,-s,-s), point3( s,-s,-s), point3( s, s,-s), point3(-s, s,-s),
+                              point3(-s,-s, s), point3( s,-s, s), point3( s, s, s), point3(-s, s, s)};
+        const mat3 R = eulerXYZ_to_mat3(rotation);
+        for (auto& p : P) p = translation + R * p;
+        const int quads[6][4] = {{0,1,2,3}, {4,5,6,7}, {0,1,5,4}, {3,2,6,7}, {0,4,7,3}, {1,2,6,5}};
+        for (const auto& q : quads) faces.push_back({P[q[0]], P[q[1]], P[q[2]], P[q[3]], m});
+    }
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+        bool hit_any = false;
+        real closest = ray_t.max;
+        hit_record temp;
+        for (const auto& f : faces) {
+            if (f.hit(r, {ray_t.min, closest}, temp)) { hit_any = true; closest = temp.t; rec = temp; rec.mat_id = mat; }
+        }
+        return hit_any;
+    }
+    bool occluded(const ray& r, interval ray_t) const {
+        for (const auto& f : faces) if (f.occluded(r, ray_t)) return true;
+        return false;
+    }
+};
+
+static int benchIntersect(const std::vector<std::string>& args)
+{
+    const int n = args.empty() ? 2'000'000 : std::atoi(args[0].c_str());
+    const std::uint32_t mat = 0;
+
+    // rays from a sphere of radius 6 around the origin towards points in [-1.5, 1.5]^3
+    pcg32 rng;
+    std::vector<ray> rays;
+    rays.reserve(size_t(n));
+    for (int i = 0; i < n; ++i) {
+        const point3 o = 6.0 * unit_vector(vec3(2 * rng.next_double() - 1, 2 * rng.next_double() - 1, 2 * rng.next_double() - 1));
+        const point3 target(3 * rng.next_double() - 1.5, 3 * rng.next_double() - 1.5, 3 * rng.next_double() - 1.5);
+        rays.emplace_back(o, target - o);
+    }
+
+    const point3 q0(-1, -1, 0.2), q1(1, -1, -0.2), q3(-1, 1, 0.3);
+    const point3 q2 = q1 + q3 - q0;
+    const rt::plane quad(q0, q1, q2, q3, mat);
+    const TwoTriangleQuad quad_ref{q0, q1, q2, q3, mat};
+    const vec3 rot(0.3, 0.7, 1.1);
+    const rt::cube box(vec3(0.1, -0.2, 0.05), rot, 1.0, mat);
+    const SixQuadCube box_ref(vec3(0.1, -0.2, 0.05), rot, 1.0, mat);
+    // the same cube as the one instance of a shared geometry, as hittable_list builds it
+    auto instanced = [&](std::shared_ptr<hittable> geometry) {
+        rt::instance_bvh tlas;
+        tlas.add(tlas.add_geometry(std::move(geometry)), rt::cube::object_to_world(rot, 1.0), vec3(0.1, -0.2, 0.05), mat);
+        tlas.build();
+        return tlas;
+    };
+    const rt::instance_bvh box_inst = instanced(rt::cube::unit());
+    const rt::instance_bvh mesh_inst = instanced(unitCubeMesh());
+
+    std::cout << n << " rays per test\n";
+    std::cout << std::left << std::setw(34) << "primitive" << std::right << std::setw(12) << "hit ns"
+              << std::setw(14) << "occluded ns" << std::setw(10) << "hits" << "   t sum\n";
+    auto run = [&](const char* name, const auto& prim) {
+        size_t hits = 0, occ = 0;
+        double t_sum = 0.0;
+        hit_record rec{};
+        const double hit_s = timeSeconds([&] {
+            for (const ray& r : rays)
+                if (prim.hit(r, interval(1e-3, infinity), rec)) { ++hits; t_sum += rec.t; }
+        });
+        const double occ_s = timeSeconds([&] {
+            for (const ray& r : rays) occ += prim.occluded(r, interval(1e-3, infinity));
+        });
+        std::cout << std::left << std::setw(34) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << hit_s * 1e9 / n << std::setw(14) << occ_s * 1e9 / n
+                  << std::setw(10) << hits << "   " << std::setprecision(3) << t_sum
+                  << (occ == hits ? "" : "  (occluded count differs)") << "\n";
+    };
+    run("quad: two triangles (before)", quad_ref);
+    run("quad: parallelogram", quad);
+    run("cube: six quads (before)", box_ref);
+    run("cube: oriented-box slab", box);
+    run("cube: instance of 12-tri mesh", mesh_inst);
+    run("cube: instance of unit box", box_inst);
+    return 0;
+}
+
+// ---------------------------------------------------------------- soa
+// BVH leaves tested through hittable* virtual calls vs the type-sorted PrimitiveSoA
+// arrays, on a sphere cloud and on a mix of spheres, rotated cubes and parallelograms.
+static void makeMixedCloud(hittable_list& world, int n, double extent = 100.0, std::uint32_t seed = 13)
+{
+    const std::uint32_t mat = world.add_material(std::make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+    world.objects.reserve(world.objects.size() + static_cast<size_t>(n));
+    pcg32 rng(seed, 1);
+    auto coord = [&] { return extent * (2 * rng.next_double() - 1); };
+    for (int i = 0; i < n; ++i) {
+        const point3 c(coord(), coord(), coord());
+        const double size = 0.1 + 0.4 * rng.next_double();
+        if (i % 3 == 0) {
+            world.add(std::make_shared<rt::sphere>(c, size, mat));
+        } else if (i % 3 == 1) {
+            const vec3 rot(3 * rng.next_double(), 3 * rng.next_double(), 3 * rng.next_double());
+            world.add(std::make_shared<rt::cube>(c, rot, size, mat));
+        } else {
+            const vec3 e1(size, 0.3 * size * rng.next_double(), 0), e2(0, 0.3 * size * rng.next_double(), size);
+            world.add(std::make_shared<rt::plane>(c, c + e1, c + e1 + e2, c + e2, mat));
+        }
+    }
+}
+
+static int benchSoa(const std::vector<std::string>& args)
+{
+    const int n_objects = args.size() > 0 ? std::atoi(args[0].c_str()) : 300'000;
+    const int n_rays    = args.size() > 1 ? std::atoi(args[1].c_str()) : 500'000;
+    const double extent = 40.0;  // dense enough that most rays reach several leaves
+
+    struct Case { std::string name; hittable_list world; };
+    std::vector<Case> cases(2);
+    cases[0].name = std::to_string(n_objects) + " spheres";
+    makeSphereCloud(cases[0].world, n_objects, extent);
+    cases[1].name = std::to_string(n_objects) + " spheres / cubes / quads";
+    makeMixedCloud(cases[1].world, n_objects, extent);
+
+    for (auto& c : cases) {
+        std::cout << c.name << ", " << n_rays << " rays, SAH builds\n";
+        std::cout << "  " << std::left << std::setw(6) << "leaf" << std::setw(20) << "primitives" << std::right
+                  << std::setw(9) << "SoA KiB" << std::setw(13) << "hit Mrays/s" << std::setw(18) << "occluded Mrays/s"
+                  << std::setw(10) << "hits" << "   t sum\n";
+        std::vector<ray> rays;
+        for (int leaf : {1, 4, 8}) {
+            for (bool soa : {false, true}) {
+                BVHBuildOptions opts;
+                opts.method        = SplitMethod::SAH;
+                opts.max_leaf_size = leaf;
+                opts.soa_leaves    = soa;
+                BVH bvh(c.world.objects, opts);
+                if (rays.empty()) rays = makeRays(bvh.getBounds(), n_rays);
+                TraceResult tr = traceAll(rays, [&](const ray& r, hit_record& rec) {
+                    return bvh.hit(r, interval(1e-4, infinity), rec);
+                });
+                size_t occ = 0;
+                const double occ_s = timeSeconds([&] {
+                    for (const ray& r : rays) occ += bvh.occluded(r, interval(1e-4, infinity));
+                });
+                std::cout << "  " << std::left << std::setw(6) << leaf << std::setw(20)
+                          << (soa ? "type-sorted SoA" : "virtual hittable*") << std::right << std::fixed
+                          << std::setw(9) << std::setprecision(0) << bvh.stats().soa_bytes / 1024.0
+                          << std::setw(13) << std::setprecision(2) << rays.size() / tr.seconds * 1e-6
+                          << std::setw(18) << rays.size() / occ_s * 1e-6
+                          << std::setw(10) << tr.hits << "   " << std::setprecision(3) << tr.t_sum
+                          << (occ == tr.hits ? "" : "  (occluded count differs)") << "\n";
+            }
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- spheres
+// One ray against 4 / 8 / 64 spheres from a SphereSoA: the scalar loop vs the AVX2
+// kernel, checked to return the same sphere and the same t bit for bit, then both inside
+// BVH leaves of up to 8 spheres and in the brute-force hittable_list loop.
+static int benchSpheres(const std::vector<std::string>& args)
+{
+    const int n_spheres = args.size() > 0 ? std::atoi(args[0].c_str()) : 200'000;
+    const int n_rays    = args.size() > 1 ? std::atoi(args[1].c_str()) : 200'000;
+    std::cout << "AVX2 " << (cpuHasAVX2() ? "available" : "not available, both columns scalar") << "\n";
+
+    // kernel: 4096 spheres of radius 0.5..2 in a 40^3 box, each ray tested against every group
+    const std::uint32_t kernel_spheres = 4096;
+    const int kernel_rays = std::max(1, n_rays / 100);
+    SphereSoA soa;
+    {
+        pcg32 rng(5, 1);
+        for (std::uint32_t i = 0; i < kernel_spheres; ++i) {
+            const point3 c(40 * rng.next_double() - 20, 40 * rng.next_double() - 20, 40 * rng.next_double() - 20);
+            soa.add(rt::sphere(c, 0.5 + 1.5 * rng.next_double(), 0));
+        }
+    }
+    std::vector<ray> rays = makeRays(bounds3(point3(-20, -20, -20), point3(20, 20, 20)), kernel_rays);
+    std::cout << kernel_rays << " rays x " << kernel_spheres << " spheres\n";
+    std::cout << "  " << std::left << std::setw(10) << "batch" << std::right << std::setw(16) << "scalar Mis/s"
+              << std::setw(14) << "AVX2 Mis/s" << std::setw(10) << "speedup" << std::setw(12) << "mismatches" << "\n";
+    for (std::uint32_t batch : {2u, 3u, 4u, 5u, 6u, 7u, 8u, 64u}) {
+        struct Result { bool found; std::uint32_t which; real t; };
+        std::vector<Result> res[2];
+        double seconds[2];
+        for (int simd = 0; simd < 2; ++simd) {
+            std::vector<Result>& out = res[simd];
+            out.resize(rays.size() * (kernel_spheres / batch));
+            const bool use_simd = simd && cpuHasAVX2();
+            seconds[simd] = timeSeconds([&] {
+                size_t o = 0;
+                for (const ray& r : rays) {
+                    for (std::uint32_t g = 0; g + batch <= kernel_spheres; g += batch, ++o) {
+                        Result& x = out[o];
+                        x.found = soa.intersect(g, batch, r, interval(1e-4, infinity), x.t, x.which, use_simd);
+                    }
+                }
+            });
+        }
+        size_t mismatches = 0;
+        for (size_t i = 0; i < res[0].size(); ++i) {
+            const Result& a = res[0][i];
+            const Result& b = res[1][i];
+            if (a.found != b.found || (a.found && (a.which != b.which || std::memcmp(&a.t, &b.t, sizeof(double)) != 0)))
+                ++mismatches;
+        }
+        const double tests = double(rays.size()) * (kernel_spheres / batch * batch);
+        std::cout << "  " << std::left << std::setw(10) << batch << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(16) << tests / seconds[0] * 1e-6 << std::setw(14) << tests / seconds[1] * 1e-6
+                  << std::setw(9) << std::setprecision(2) << seconds[0] / seconds[1] << "x"
+                  << std::setw(12) << mismatches << "\n";
+    }
+
+    // BVH with up to 8 spheres per leaf, and the brute-force list over a small scene
+    hittable_list cloud;
+    makeSphereCloud(cloud, n_spheres, 40.0);
+    hittable_list small;
+    makeSphereCloud(small, 256, 10.0);
+    BVHBuildOptions opts;
+    opts.method        = SplitMethod::SAH;
+    opts.max_leaf_size = kBVHMaxLeafSize;
+    BVH bvh(cloud.objects, opts);
+    rays = makeRays(bvh.getBounds(), n_rays);
+    std::vector<ray> small_rays = makeRays(small.getBounds(), std::max(1, n_rays / 10));
+
+    auto row = [&](const char* name, const hittable& world, const std::vector<ray>& rs) {
+        // scalar and AVX2 alternate, best of 5 each, so drift on a shared machine hits both
+        TraceResult tr[2];
+        double occ_s[2] = {1e30, 1e30};
+        size_t occ[2] = {0, 0};
+        tr[0].seconds = tr[1].seconds = 1e30;
+        for (int rep = 0; rep < 5; ++rep)
+            for (int simd = 0; simd < 2; ++simd) {
+                setSimdEnabled(simd);
+                const TraceResult t = traceAll(rs, [&](const ray& r, hit_record& rec) {
+                    return world.hit(r, interval(1e-4, infinity), rec);
+                });
+                if (t.seconds < tr[simd].seconds) tr[simd] = t;
+                size_t o = 0;
+                occ_s[simd] = std::min(occ_s[simd], timeSeconds([&] {
+                    for (const ray& r : rs) o += world.occluded(r, interval(1e-4, infinity));
+                }));
+                occ[simd] = o;
+            }
+        setSimdEnabled(true);
+        std::cout << "  " << std::left << std::setw(30) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << rs.size() / tr[0].seconds * 1e-6 << std::setw(8) << rs.size() / tr[1].seconds * 1e-6
+                  << std::setw(10) << rs.size() / occ_s[0] * 1e-6 << std::setw(8) << rs.size() / occ_s[1] * 1e-6
+                  << std::setw(10) << tr[1].hits
+                  << (tr[0].hits == tr[1].hits && tr[0].t_sum == tr[1].t_sum && occ[0] == occ[1] ? "" : "  MISMATCH")
+                  << "\n";
+    };
+    std::cout << "Mrays/s, scalar / AVX2\n  " << std::left << std::setw(30) << "world" << std::right
+              << std::setw(18) << "hit" << std::setw(18) << "occluded" << std::setw(10) << "hits" << "\n";
+    row((std::to_string(n_spheres) + " spheres, BVH leaves <= 8").c_str(), bvh, rays);
+    row("256 spheres, no BVH", small, small_rays);
+    return 0;
+}
+
+// ---------------------------------------------------------------- adaptive
+// Fixed samples per pixel vs adaptive sampling on the exported scene, at a reduced film
+// size: total rays, render time and RMSE against a high-spp reference. Read a row of each
+// kind at about the same RMSE to get the saving at equal noise.
+static double rmse(const Image& a, const Image& b)
+{
+    double sq = 0.0;
+    for (size_t i = 0; i < a.pixels().size(); ++i)
+        for (int c = 0; c < 3; ++c) {
+            const double d = double(a.pixels()[i][c]) - double(b.pixels()[i][c]);
+            sq += d * d;
+        }
+    return std::sqrt(sq / (3.0 * double(a.pixels().size())));
+}
+
+static int benchAdaptive(const std::vector<std::string>& args)
+{
+    const std::string path = args.size() > 0 ? args[0] : kDefaultScene;
+    const int width   = args.size() > 1 ? std::atoi(args[1].c_str()) : 360;
+    const int ref_spp = args.size() > 2 ? std::atoi(args[2].c_str()) : 1024;
+
+    bd::Scene scene;
+    hittable_list world;
+    try {
+        scene = JSONReader{}.loadFromFile(path);
+    } catch (const std::exception& e) {
+        std::cerr << "cannot load " << path << ": " << e.what() << "\n";
+        return 1;
+    }
+    std::streambuf* old = std::clog.rdbuf(nullptr);
+    world.loadScene(scene);
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    world.buildBVH(opts);
+    std::clog.rdbuf(old);
+
+    bd::Camera cam_data = scene.cameras[0];
+    cam_data.film_y = std::max(1, cam_data.film_y * width / cam_data.film_x);
+    cam_data.film_x = width;
+
+    auto render = [&](int spp, double error, int min_spp, rt::camera::render_stats& st) {
+        rt::camera cam(cam_data);
+        cam.materials = &world.materials;
+        cam.samples_per_pixel = spp;
+        cam.adaptive_error = error;
+        cam.min_samples = min_spp;
+        std::streambuf* saved = std::clog.rdbuf(nullptr);
+        Image img = cam.render(world, world.pointLights, &st);
+        std::clog.rdbuf(saved);
+        return img;
+    };
+    rt::camera::render_stats ref_st;
+    const Image reference = render(ref_spp, 0.0, ref_spp, ref_st);
+    const double pixels = double(reference.width()) * reference.height();
+    std::cout << path << " at " << reference.width() << "x" << reference.height() << ", reference " << ref_spp
+              << " spp (" << std::fixed << std::setprecision(1) << ref_st.seconds << " s)\n";
+    std::cout << std::left << std::setw(24) << "sampling" << std::right << std::setw(10) << "spp avg"
+              << std::setw(12) << "Mrays" << std::setw(10) << "ms" << std::setw(12) << "RMSE" << "\n";
+    auto row = [&](const std::string& name, int spp, double error, int min_spp) {
+        rt::camera::render_stats st;
+        const Image img = render(spp, error, min_spp, st);
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << double(st.samples) / pixels << std::setprecision(2)
+                  << std::setw(12) << double(st.rays) * 1e-6 << std::setw(10) << std::setprecision(0)
+                  << st.seconds * 1e3 << std::setw(12) << std::scientific << std::setprecision(2)
+                  << rmse(img, reference) << std::fixed << "\n";
+    };
+    for (int spp : {8, 16, 32, 64, 128, 256})
+        row("fixed " + std::to_string(spp), spp, 0.0, spp);
+    for (int min_spp : {8, 16, 32}) {
+        for (double error : {0.01, 0.005, 0.002}) {
+            std::ostringstream name;
+            name << "adaptive " << error << ", " << min_spp << "-256";
+            row(name.str(), 256, error, min_spp);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- samplers
+// Convergence of the pixel estimates per sample method: RMSE against a reference vs
+// samples per pixel, on the exported scene at a reduced film size. The reference is a
+// Sobol render of another frame, so its scrambling is independent of every row.
+static int benchSamplers(const std::vector<std::string>& args)
+{
+    const std::string path = args.size() > 0 ? args[0] : kDefaultScene;
+    const int width   = args.size() > 1 ? std::atoi(args[1].c_str()) : 240;
+    const int ref_spp = args.size() > 2 ? std::atoi(args[2].c_str()) : 4096;
+
+    bd::Scene scene;
+    hittable_list world;
+    try {
+        scene = JSONReader{}.loadFromFile(path);
+    } catch (const std::exception& e) {
+        std::cerr << "cannot load " << path << ": " << e.what() << "\n";
+        return 1;
+    }
+    std::streambuf* old = std::clog.rdbuf(nullptr);
+    world.loadScene(scene);
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    world.buildBVH(opts);
+    std::clog.rdbuf(old);
+
+    bd::Camera cam_data = scene.cameras[0];
+    cam_data.film_y = std::max(1, cam_data.film_y * width / cam_data.film_x);
+    cam_data.film_x = width;
+    auto render = [&](SampleMethod method, int spp, int frame, double& seconds) {
+        rt::camera cam(cam_data);
+        cam.materials = &world.materials;
+        cam.samples_per_pixel = spp;
+        cam.sample_method = method;
+        cam.frame = frame;
+        rt::camera::render_stats st;
+        std::streambuf* saved = std::clog.rdbuf(nullptr);
+        Image img = cam.render(world, world.pointLights, &st);
+        std::clog.rdbuf(saved);
+        seconds = st.seconds;
+        return img;
+    };
+    double ref_s = 0.0;
+    const Image reference = render(SampleMethod::Sobol, ref_spp, 1, ref_s);
+    std::cout << path << " at " << reference.width() << "x" << reference.height() << ", reference " << ref_spp
+              << " spp Sobol, frame 1 (" << std::fixed << std::setprecision(1) << ref_s << " s)\n";
+
+    const SampleMethod methods[] = {SampleMethod::Random, SampleMethod::Stratified, SampleMethod::Halton,
+                                    SampleMethod::Sobol};
+    const char* names[] = {"random", "stratified", "halton", "sobol"};
+    const int spps[] = {1, 2, 4, 8, 16, 32, 64, 128};
+    double err[4][8], ms[4] = {};
+    for (int m = 0; m < 4; ++m)
+        for (int k = 0; k < 8; ++k) {
+            double s = 0.0;
+            err[m][k] = rmse(render(methods[m], spps[k], 0, s), reference);
+            if (spps[k] == 64) ms[m] = s * 1e3;
+        }
+
+    std::cout << "RMSE\n" << std::setw(6) << "spp";
+    for (const char* n : names) std::cout << std::setw(13) << n;
+    std::cout << "\n";
+    for (int k = 0; k < 8; ++k) {
+        std::cout << std::setw(6) << spps[k] << std::scientific << std::setprecision(2);
+        for (int m = 0; m < 4; ++m) std::cout << std::setw(13) << err[m][k];
+        std::cout << std::fixed << "\n";
+    }
+    std::cout << std::setw(6) << "ms@64" << std::setprecision(0);
+    for (int m = 0; m < 4; ++m) std::cout << std::setw(13) << ms[m];
+    // fewest spp whose RMSE is at or below random at 64 spp (the ladder doubles, so this rounds up)
+    std::cout << "\n" << std::setw(6) << "=r64";
+    for (int m = 0; m < 4; ++m) {
+        int k = 0;
+        while (k < 8 && err[m][k] > err[0][6]) ++k;
+        std::cout << std::setw(13) << (k < 8 ? std::to_string(spps[k]) + " spp" : std::string(">128"));
+    }
+    std::cout << "\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------- aovs
+// Cost of filling the render layers in the beauty pass: time and rays with and without
+// camera::layers, per integrator. The rays must match (no extra traversal) and so must the
+// beauty images.
+static int benchAovs(const std::vector<std::string>& args)
+{
+    const std::string path = args.size() > 0 ? args[0] : kDefaultScene;
+    const int width = args.size() > 1 ? std::atoi(args[1].c_str()) : 540;
+    const int spp   = args.size() > 2 ? std::atoi(args[2].c_str()) : 16;
+
+    bd::Scene scene;
+    hittable_list world;
+    try {
+        scene = JSONReader{}.loadFromFile(path);
+    } catch (const std::exception& e) {
+        std::cerr << "cannot load " << path << ": " << e.what() << "\n";
+        return 1;
+    }
+    std::streambuf* old = std::clog.rdbuf(nullptr);
+    world.loadScene(scene);
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    world.buildBVH(opts);
+    std::clog.rdbuf(old);
+
+    bd::Camera cam_data = scene.cameras[0];
+    cam_data.film_y = std::max(1, cam_data.film_y * width / cam_data.film_x);
+    cam_data.film_x = width;
+    std::cout << path << " at " << cam_data.film_x << "x" << cam_data.film_y << ", " << spp << " spp\n";
+    std::cout << "integrator  layers      ms   Mrays  same beauty\n";
+    for (rt::Integrator integrator : {rt::Integrator::Normals, rt::Integrator::Path}) {
+        Image beauty[2];
+        for (int with = 0; with < 2; ++with) {
+            double best = 1e30;
+            rt::camera::render_stats st;
+            for (int rep = 0; rep < 3; ++rep) {
+                rt::camera cam(cam_data);
+                cam.materials = &world.materials;
+                cam.samples_per_pixel = spp;
+                cam.integrator = integrator;
+                RenderLayers layers;
+                if (with) cam.layers = &layers;
+                std::streambuf* saved = std::clog.rdbuf(nullptr);
+                beauty[with] = cam.render(world, world.pointLights, &st);
+                std::clog.rdbuf(saved);
+                best = std::min(best, st.seconds);
+            }
+            const bool same = !with || std::memcmp(beauty[0].pixels().data(), beauty[1].pixels().data(),
+                                                   beauty[0].pixels().size() * sizeof(color)) == 0;
+            std::cout << std::setw(10) << (integrator == rt::Integrator::Path ? "path" : "normals")
+                      << std::setw(8) << (with ? "all" : "none") << std::fixed << std::setprecision(0)
+                      << std::setw(8) << best * 1e3 << std::setprecision(2) << std::setw(8) << st.rays * 1e-6
+                      << std::setw(13) << (with ? (same ? "yes" : "NO") : "-") << "\n";
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------- denoise
+// Path-traced renders of the exported scene at 4-32 spp, before and after denoise(), against
+// a high-spp reference of another frame: RMSE, and the filter's time per megapixel with
+// the scalar and the AVX2 kernel (which must agree bit for bit).
+static int benchDenoise(const std::vector<std::string>& args)
+{
+    const std::string path = args.size() > 0 ? args[0] : kDefaultScene;
+    const int width   = args.size() > 1 ? std::atoi(args[1].c_str()) : 360;
+    const int ref_spp = args.size() > 2 ? std::atoi(args[2].c_str()) : 1024;
+
+    bd::Scene scene;
+    hittable_list world;
+    try {
+        scene = JSONReader{}.loadFromFile(path);
+    } catch (const std::exception& e) {
+        std::cerr << "cannot load " << path << ": " << e.what() << "\n";
+        return 1;
+    }
+    std::streambuf* old = std::clog.rdbuf(nullptr);
+    world.loadScene(scene);
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    world.buildBVH(opts);
+    std::clog.rdbuf(old);
+
+    bd::Camera cam_data = scene.cameras[0];
+    cam_data.film_y = std::max(1, cam_data.film_y * width / cam_data.film_x);
+    cam_data.film_x = width;
+    auto render = [&](int spp, int frame, RenderLayers* layers) {
+        rt::camera cam(cam_data);
+        cam.materials = &world.materials;
+        cam.samples_per_pixel = spp;
+        cam.integrator = rt::Integrator::Path;
+        cam.frame = frame;
+        cam.layers = layers;
+        std::streambuf* saved = std::clog.rdbuf(nullptr);
+        Image img = cam.render(world, world.pointLights);
+        std::clog.rdbuf(saved);
+        return img;
+    };
+    const Image reference = render(ref_spp, 1, nullptr);
+    const double mpix = double(reference.width()) * reference.height() * 1e-6;
+    std::cout << path << " at " << reference.width() << "x" << reference.height() << ", path traced, reference "
+              << ref_spp << " spp of frame 1\n";
+    std::cout << "   spp   noisy RMSE  denoised RMSE  scalar ms/MP  AVX2 ms/MP  identical\n";
+    const bool had_simd = simdEnabled();
+    for (int spp : {4, 8, 16, 32}) {
+        RenderLayers layers;
+        const Image noisy = render(spp, 0, &layers);
+        DenoiseOptions dopt;
+        Image out[2];
+        double ms[2];
+        for (int k = 0; k < 2; ++k) {
+            setSimdEnabled(k == 1 && had_simd);
+            double best = 1e30;
+            for (int rep = 0; rep < 3; ++rep) {
+                DenoiseStats st;
+                out[k] = denoise(noisy, layers, dopt, &st);
+                best = std::min(best, st.setup_ms + st.ms);
+            }
+            ms[k] = best / mpix;
+        }
+        setSimdEnabled(had_simd);
+        const bool same = std::memcmp(out[0].pixels().data(), out[1].pixels().data(),
+                                      out[0].pixels().size() * sizeof(color)) == 0;
+        std::cout << std::setw(6) << spp << std::scientific << std::setprecision(2)
+                  << std::setw(13) << rmse(noisy, reference) << std::setw(15) << rmse(out[1], reference)
+                  << std::fixed << std::setprecision(0) << std::setw(14) << ms[0]
+                  << std::setw(12) << (had_simd ? ms[1] : 0.0) << std::setw(11) << (same ? "yes" : "NO") << "\n";
+    }
+    // how many samples the undenoised render needs for the same error
+    std::cout << "noisy RMSE at 64 / 256 spp: " << std::scientific << std::setprecision(2)
+              << rmse(render(64, 0, nullptr), reference) << " / " << rmse(render(256, 0, nullptr), reference)
+              << std::fixed << "\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------- scene-cache
+// Time to first ray (scene load + BVH, everything before the first camera ray) from the
+// JSON vs from the binary scene cache, for the exported scene and for a scene holding one
+// large OBJ mesh. Files are in the page cache for both paths.
+static bool writeMeshSceneJSON(const std::string& path, const std::string& obj)
+{
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    std::fprintf(f, "{\"cameras\": [{\"name\": \"Camera\", \"location\": [0, -120, 60], \"gaze\": [0, 0.894, -0.447],"
+                    " \"up\": [0, 0.447, 0.894], \"focal_length_mm\": 50.0, \"sensor_width_mm\": 36.0,"
+                    " \"sensor_height_mm\": 24.0, \"film_resolution\": {\"x\": 640, \"y\": 480}}],"
+                    " \"point_lights\": [{\"name\": \"Light\", \"location\": [20, -40, 80], \"radiant_intensity\": 1000.0}],"
+                    " \"meshes\": [{\"name\": \"Grid\", \"file\": \"%s\"}]}\n", obj.c_str());
+    return std::fclose(f) == 0;
+}
+
+static int benchSceneCache(const std::vector<std::string>& args)
+{
+    const std::string scene_path = args.size() > 0 ? args[0] : kDefaultScene;
+    const int n_tris = args.size() > 1 ? std::atoi(args[1].c_str()) : 500'000;
+    const int g = std::max(2, static_cast<int>(std::sqrt(n_tris / 2.0)) + 1);
+    const auto tmp = std::filesystem::temp_directory_path();
+    const std::string obj  = (tmp / ("bench_grid_" + std::to_string(g) + ".obj")).string();
+    const std::string grid = (tmp / ("bench_cache_grid_" + std::to_string(g) + ".json")).string();
+    if (!std::filesystem::exists(obj)) {
+        std::cout << "writing " << obj << " ...\n";
+        if (!writeGridOBJ(obj, g)) { std::cerr << "cannot write " << obj << "\n"; return 1; }
+    }
+    if (!writeMeshSceneJSON(grid, obj)) { std::cerr << "cannot write " << grid << "\n"; return 1; }
+
+    BVHBuildOptions opts;
+    opts.method = SplitMethod::SAH;
+    constexpr int reps = 3;
+
+    std::cout << std::left << std::setw(34) << "scene" << std::right << std::setw(12) << "cold ms"
+              << std::setw(12) << "cached ms" << std::setw(10) << "hash ms" << std::setw(12) << "cache MB"
+              << std::setw(10) << "speedup" << "   SAH cost cold / cached\n";
+    for (const std::string& path : {scene_path, grid}) {
+        const std::string cache = (tmp / (std::filesystem::path(path).filename().string() + ".bench.cache")).string();
+        std::remove(cache.c_str());
+
+        double cold = 1e30, cached = 1e30, cold_sah = 0.0, cached_sah = 0.0;
+        SceneCacheStats cs;
+        try {
+            for (int i = 0; i < reps; ++i) {
+                hittable_list world;
+                bd::Scene scene;
+                cold = std::min(cold, 1e3 * timeSeconds([&] {
+                    JSONReader reader{};
+                    scene = reader.loadFromFile(path);
+                    world.loadScene(scene);
+                    world.bvh = std::make_unique<BVH>(world.objects, opts);
+                }));
+                cold_sah = world.bvh->sah_cost();
+                if (i == 0 && !saveSceneCache(cache, path, scene, world, &opts)) {
+                    std::cerr << "cannot write " << cache << "\n";
+                    return 1;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "skipping " << path << ": " << e.what() << "\n";
+            continue;
+        }
+        for (int i = 0; i < reps; ++i) {
+            hittable_list world;
+            bool hit = false;
+            const double ms = 1e3 * timeSeconds([&] {
+                SceneCacheData data;
+                hit = loadSceneCache(cache, path, &opts, world.instance_cubes, data, &cs);
+                if (!hit) return;
+                world.loadScene(data.scene, &data.meshes);
+                world.bvh = std::make_unique<BVH>(world.objects, std::move(data.bvh), opts);
+            });
+            if (!hit) { std::cerr << "cache miss on " << cache << ": " << cs.reason << "\n"; return 1; }
+            cached = std::min(cached, ms);
+            cached_sah = world.bvh->sah_cost();
+        }
+        std::cout << std::left << std::setw(34) << std::filesystem::path(path).filename().string() << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(12) << cold << std::setw(12) << cached
+                  << std::setw(10) << cs.hash_ms << std::setw(12) << cs.bytes / 1048576.0
+                  << std::setprecision(1) << std::setw(9) << cold / cached << "x"
+                  << "   " << std::setprecision(4) << cold_sah << " / " << cached_sah << "\n";
+        std::remove(cache.c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    registerBench("rng", "[count]  ns/sample of std::rand vs pcg32 vs Sampler", benchRng);
+    registerBench("bvh-traverse", "[scene.json] [spheres] [rays]  recursive vs flattened BVH traversal", benchBvhTraverse);
+    registerBench("bvh-leaf", "[spheres] [rays]  leaf size 1..8 / auto: nodes, fill, memory, Mrays/s", benchBvhLeaf);
+    registerBench("bvh-build", "[scene.json]  median vs binned SAH: nodes, SAH cost, build time", benchBvhBuild);
+    registerBench("bvh-wide", "[spheres] [rays]  BVH2 vs BVH4 vs BVH8: node visits, memory, Mrays/s scalar/AVX2", benchBvhWide);
+    registerBench("packets", "[spheres] [width] [height]  primary visibility: single rays vs 4/8/16-ray packets", benchPackets);
+    registerBench("shadows", "[spheres] [lights]  Blinn-Phong shadow rays: closest-hit vs occluded, per term vs shared", benchShadows);
+    registerBench("mesh", "[triangles] [rays]  indexed triangle_mesh vs one shared_ptr<triangle> per face", benchMesh);
+    registerBench("obj", "[file.obj | triangles]  legacy OBJ parser vs mmap parallel loader: MB/s, peak RSS", benchObj);
+    registerBench("instancing", "[cubes] [width] [height]  rt::cube per cube vs instances of the unit box / a 12-triangle mesh: memory, build and render time", benchInstancing);
+    registerBench("intersect", "[rays]  ns per quad / cube intersection: analytic tests vs triangle pairs, instanced box vs mesh", benchIntersect);
+    registerBench("soa", "[objects] [rays]  BVH leaves through virtual calls vs type-sorted sphere / quad / box arrays", benchSoa);
+    registerBench("spheres", "[spheres] [rays]  batched sphere kernel: scalar vs AVX2 intersections/s, BVH leaves and brute-force list", benchSpheres);
+    registerBench("json", "[file.json | objects]  DOM vs streaming SAX scene loading: MB/s, peak RSS", benchJson);
+    registerBench("scene-cache", "[scene.json] [triangles]  time to first ray: JSON + OBJ + BVH build vs binary scene cache", benchSceneCache);
+    registerBench("adaptive", "[scene.json] [width] [ref spp]  fixed vs adaptive samples per pixel: rays, ms and RMSE against a reference", benchAdaptive);
+    registerBench("samplers", "[scene.json] [width] [ref spp]  RMSE vs spp for random / stratified / Halton / Sobol sampling", benchSamplers);
+    registerBench("aovs", "[scene.json] [width] [spp]  Render time and rays with and without the normal / albedo / depth / ID layers", benchAovs);
+    registerBench("denoise", "[scene.json] [width] [ref spp]  Path-traced 4-32 spp vs denoised: RMSE against a reference, filter ms per megapixel", benchDenoise);
+    registerBench("bvh-lbvh", "[spheres] [rays]  parallel LBVH stage times per thread count vs median/SAH", benchBvhLbvh);
+
+    if (argc < 2 || !registry().count(argv[1])) {
+        std::cerr << "Usage: " << argv[0] << " <benchmark> [args]\n";
+        for (const auto& [name, entry] : registry())
+            std::cerr << "  " << std::left << std::setw(12) << name << entry.first << "\n";
+        return argc < 2 ? 0 : 1;
+    }
+    std::vector<std::string> args(argv + 2, argv + argc);
+    return registry()[argv[1]].second(args);
+}
@@ -8,7 +8,7 @@ public:
     point3 pMin, pMax;
     bounds3()
     {
-        const double INF = std::numeric_limits<double>::infinity();
+        const real INF = std::numeric_limits<real>::infinity();
         pMin = point3( INF,  INF,  INF);
         pMax = point3(-INF, -INF, -INF);
     }
@@ -88,8 +88,8 @@ public:
                   std::max(t0v.y(), t1v.y()),
                   std::max(t0v.z(), t1v.z()));
 
-        double t_enter = std::max(tmin.x(), std::max(tmin.y(), tmin.z()));
-        double t_exit  = std::min(tmax.x(), std::min(tmax.y(), tmax.z()));
+        real t_enter = std::max(tmin.x(), std::max(tmin.y(), tmin.z()));
+        real t_exit  = std::min(tmax.x(), std::min(tmax.y(), tmax.z()));
 
         t_enter = std::max(t_enter, ray_t.min);
         t_exit  = std::min(t_exit,  ray_t.max);
@@ -1,16 +1,59 @@
 #pragma once
 #include "color.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <vector>
+#include "Checkpoint.h"
+#include "Denoiser.h"
+#include "parallel.h"
 #include "scene.h"
 #include "mat3.h"
 #include "utility.h"
 #include "material.h"
 #include "lighting.h"
 namespace rt {// i.e. ray tracing
+// What a camera sample returns: the normal visualisation, or the path-traced colour
+// (diffuse / mirror / glass bounces under the sky, no lights).
+enum class Integrator { Normals, Path };
+
 class camera {
 public:
     int  samples_per_pixel = 100;
     int    max_depth         =6;   // Maximum number of ray bounces into scene
+    int    num_threads       = 0;  // 0 = one worker per hardware thread
+    int    tile_size         = 16; // Edge length of a square render tile in pixels
+    int    frame             = 0;  // Animation frame, part of every sample's random seed
+    int    packet_size       = 16; // Primary rays traced together: 16 (4x4 pixels), 8 (4x2), 4 (2x2) or 1
+    SampleMethod sample_method = SampleMethod::Random; // sequence behind pixel offsets and scattering choices
+    Integrator integrator = Integrator::Normals;
+    const material_table* materials = nullptr; // What hit_record::mat_id indexes (hittable_list::materials)
+
+    // Adaptive sampling. With adaptive_error > 0 a pixel stops once it has min_samples and
+    // the standard error of its mean luminance is below adaptive_error times that mean;
+    // samples_per_pixel is then the cap. 0 gives every pixel samples_per_pixel.
+    double adaptive_error    = 0.0;
+    int    min_samples       = 16;
+    Image* sample_counts     = nullptr; // if set, receives samples taken / samples_per_pixel per pixel
+    RenderLayers* layers     = nullptr; // if set, receives normal, albedo, depth, object ID ... per pixel
+
+    // Progressive rendering and checkpoints, see render().
+    int    pass_samples        = 0;     // samples per pixel per pass, 0 = one pass
+    std::string checkpoint_path;        // "" = no checkpoints
+    double checkpoint_interval = 60.0;  // seconds between checkpoints, 0 = after every pass
+    std::uint64_t checkpoint_key = 0;   // identifies the scene (sceneContentHash), stored in the checkpoint
+
+    struct render_stats {
+        double        seconds = 0.0;
+        std::uint64_t rays    = 0;  // every query sent to the scene (camera + secondary + shadow)
+        std::uint64_t samples = 0;  // camera samples over all pixels
+        int           threads = 1;
+        double mrays_per_sec() const { return seconds > 0.0 ? rays / seconds * 1e-6 : 0.0; }
+    };
 
     camera(bd::Camera& camera_data)
     {
@@ -25,23 +68,110 @@ public:
         focus_dist  = 1.0;
     }
 
-    void render(const hittable& objects, const std::vector<PointLightRT>& pl)
+    // Renders the image tile by tile on `num_threads` workers. Tiles write straight into
+    // their own pixels of the framebuffer, so nothing has to be produced in scanline
+    // order. Every sample draws from a Sampler keyed on (pixel, sample,
+    // bounce, frame), so the result is bit-identical for any thread count or tile size.
+    //
+    // With pass_samples > 0 the frame is rendered progressively: every pass takes up to
+    // pass_samples more samples per pixel into an accumulation buffer. Pixel n's samples
+    // are the same whichever pass takes them and are summed in the same order, so the
+    // image does not depend on the pass size. With checkpoint_path set, the buffer is saved
+    // after a pass once checkpoint_interval seconds have passed since the last save, and a
+    // matching checkpoint found at the start is resumed from.
+    Image render(const hittable& objects, const std::vector<PointLightRT>& pl,
+                 render_stats* stats = nullptr)
     {
+        (void)pl;
         initialize();
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-            for (int j = 0; j < image_height; ++j) {
-                std::clog << "\rScanline: " << (j + 1) << " / " << image_height << std::endl;
-                for (int i = 0; i < image_width; ++i) {
-                    color pixelColor(0, 0, 0);
-                    for (int sample = 0; sample < samples_per_pixel; sample++) {
-                        ray r = get_ray(i, j);
-                        pixelColor += ray_color_normal(r, objects);
-                        //pixelColor += ray_color(r, max_depth, objects, pl);
-                    }
-                    writeColor(std::cout, pixel_samples_scale * pixelColor);
+        Image img(image_width, image_height);
+        if (sample_counts) *sample_counts = Image(image_width, image_height);
+        if (layers) layers->resize(image_width, image_height);
+
+        const int ts      = tile_size > 0 ? tile_size : 16;
+        const int tiles_x = (image_width  + ts - 1) / ts;
+        const int tiles_y = (image_height + ts - 1) / ts;
+        const std::size_t n_tiles = static_cast<std::size_t>(tiles_x) * tiles_y;
+        const int threads = resolve_thread_count(num_threads);
+
+        std::vector<pixel_estimate> acc(static_cast<std::size_t>(image_width) * image_height);
+        RenderCheckpoint ck;
+        ck.scene_key = checkpoint_key;
+        ck.params    = checkpoint_params();
+        int level = 0;   // samples per pixel that every pixel has taken or stopped before
+        if (!checkpoint_path.empty()) {
+            std::string reason;
+            if (loadCheckpoint(checkpoint_path, ck, acc.data(), sizeof(pixel_estimate), acc.size(), &reason)) {
+                level = static_cast<int>(ck.level);
+                std::clog << "Resuming from " << checkpoint_path << " at " << level << " samples per pixel\n";
+            } else {
+                std::fill(acc.begin(), acc.end(), pixel_estimate{});
+                std::clog << "Checkpoint " << checkpoint_path << " not used: " << reason << "\n";
+            }
+        }
+        const int step     = pass_samples > 0 ? pass_samples : samples_per_pixel;
+        const int n_passes = std::max(1, (samples_per_pixel - level + step - 1) / step);
+
+        std::atomic<std::uint64_t> rays{0}, samples{0};
+        std::atomic<std::size_t>   tiles_done{0};
+        std::mutex log_mutex;
+        int last_percent = -1;
+
+        auto t0 = std::chrono::steady_clock::now();
+        auto last_save = t0;
+        while (level < samples_per_pixel) {
+            const int limit = std::min(samples_per_pixel, level + step);
+            WorkStealingScheduler::run(threads, n_tiles, [&](std::size_t t, int) {
+                const int x0 = static_cast<int>(t % tiles_x) * ts;
+                const int y0 = static_cast<int>(t / tiles_x) * ts;
+                const int x1 = std::min(x0 + ts, image_width);
+                const int y1 = std::min(y0 + ts, image_height);
+
+                ray_counter world(objects);
+                samples += packet_size > 1 ? render_tile_packets(acc, world, limit, x0, y0, x1, y1)
+                                           : render_tile(acc, world, limit, x0, y0, x1, y1);
+                rays += world.count;
+
+                const std::size_t done = ++tiles_done;
+                const int percent = static_cast<int>(100 * done / (n_tiles * n_passes));
+                std::lock_guard<std::mutex> lock(log_mutex);
+                if (percent != last_percent) {
+                    last_percent = percent;
+                    std::clog << "\rTiles: " << done << " / " << n_tiles * n_passes << " (" << percent << "%)" << std::flush;
                 }
+            });
+            level = limit;
+
+            const auto now = std::chrono::steady_clock::now();
+            if (!checkpoint_path.empty() && level < samples_per_pixel
+                && std::chrono::duration<double>(now - last_save).count() >= checkpoint_interval) {
+                ck.level = static_cast<std::uint32_t>(level);
+                if (!saveCheckpoint(checkpoint_path, ck, acc.data(), sizeof(pixel_estimate), acc.size()))
+                    std::clog << "\nWARNING: could not write checkpoint " << checkpoint_path << "\n";
+                last_save = now;
             }
-            std::clog << "\rDone.                 \n";
+        }
+        std::uint64_t total = 0;   // including the samples of a resumed checkpoint
+        for (int j = 0; j < image_height; ++j)
+            for (int i = 0; i < image_width; ++i) {
+                const pixel_estimate& e = acc[static_cast<std::size_t>(j) * image_width + i];
+                store(img, i, j, e);
+                total += static_cast<std::uint64_t>(e.n);
+            }
+        auto t1 = std::chrono::steady_clock::now();
+        std::clog << "\rDone.                              \n";
+        if (adaptive_error > 0.0)
+            std::clog << "Adaptive sampling: " << total << " samples, "
+                      << double(total) / (double(image_width) * image_height) << " per pixel (max "
+                      << samples_per_pixel << ")\n";
+
+        if (stats) {
+            stats->seconds = std::chrono::duration<double>(t1 - t0).count();
+            stats->rays    = rays.load();
+            stats->samples = samples.load();
+            stats->threads = threads;
+        }
+        return img;
     }
 private: 
     double aspect_ratio;
@@ -57,6 +187,7 @@ private:
     vec3 pixel00_loc;
     vec3 pixel_delta_u;
     vec3 pixel_delta_v;
+    vec3 forward;       // unit view axis, for the depth layer
 
 
     
@@ -64,11 +195,214 @@ private:
 
     std::vector<bd::PointLight> pointLights;
 
+    // Forwards every query to the scene and counts it. One instance lives per tile,
+    // so the counter needs no synchronisation.
+    class ray_counter : public hittable {
+    public:
+        explicit ray_counter(const hittable& w) : world(w) {}
+        bool intersect(const ray& r, interval ray_t, hit_info& h) const override {
+            ++count;
+            return world.intersect(r, ray_t, h);
+        }
+        bool occluded(const ray& r, interval ray_t) const override {
+            ++count;
+            return world.occluded(r, ray_t);
+        }
+        std::uint32_t intersect_packet(const RayPacket& packet, hit_info* hits) const override {
+            count += static_cast<std::uint64_t>(laneCount(packet.active));
+            return world.intersect_packet(packet, hits);
+        }
+        bounds3 getBounds() const override { return world.getBounds(); }
+        mutable std::uint64_t count = 0;
+    private:
+        const hittable& world;
+    };
+
+    // First hit of one camera sample, as the layers see it.
+    struct sample_features {
+        vec3  normal{0, 0, 0};
+        color albedo{1, 1, 1};
+        real  depth = 0;
+        std::uint32_t object_id = 0;
+    };
+
+    // One pixel's samples: the colour sum, and a running mean and variance of their
+    // luminance (Welford) for the adaptive stopping test, plus the sums of the samples'
+    // features and the first sample's object when camera::layers is set.
+    struct pixel_estimate {
+        color  sum{0, 0, 0};
+        int    n    = 0;
+        double mean = 0.0;
+        double m2   = 0.0;   // sum of squared deviations from the mean
+        float  normal[3] = {}, albedo[3] = {}, depth = 0.0f;
+        std::uint32_t object_id = 0;
+
+        void add(const color& c) {
+            sum += c;
+            ++n;
+            const double y = 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+            const double d = y - mean;
+            mean += d / n;
+            m2   += d * (y - mean);
+        }
+
+        void add(const color& c, const sample_features& f) {
+            if (n == 0) object_id = f.object_id;
+            add(c);
+            for (int k = 0; k < 3; ++k) {
+                normal[k] += static_cast<float>(f.normal[k]);
+                albedo[k] += static_cast<float>(f.albedo[k]);
+            }
+            depth += static_cast<float>(f.depth);
+        }
+    };
+
+    // Whether pixel `e` needs another sample in a pass that ends at `limit` samples.
+    bool wants_sample(const pixel_estimate& e, int limit) const
+    {
+        if (e.n >= limit) return false;
+        if (adaptive_error <= 0.0 || e.n < std::max(min_samples, 2)) return true;
+        // standard error of the mean, against a floor so near-black pixels can stop too
+        const double std_error = std::sqrt(e.m2 / (e.n - 1) / e.n);
+        return std_error > adaptive_error * std::max(e.mean, 1e-3);
+    }
+
+    void store(Image& img, int i, int j, const pixel_estimate& e) const
+    {
+        // with a fixed count this is pixel_samples_scale * sum, as before adaptive sampling
+        img.at(i, j) = (e.n == samples_per_pixel ? pixel_samples_scale : 1.0 / e.n) * e.sum;
+        if (sample_counts) sample_counts->at(i, j) = color(1, 1, 1) * (double(e.n) / samples_per_pixel);
+        if (layers && e.n > 0) {
+            const std::size_t p = static_cast<std::size_t>(j) * image_width + i;
+            const float inv = 1.0f / e.n;
+            for (int k = 0; k < 3; ++k) {
+                layers->normal[3 * p + k] = e.normal[k] * inv;
+                layers->albedo[3 * p + k] = e.albedo[k] * inv;
+            }
+            layers->depth[p]     = e.depth * inv;
+            layers->variance[p]  = e.n > 1 ? static_cast<float>(e.m2 / (e.n - 1) / e.n) : 0.0f;
+            layers->object_id[p] = e.object_id;
+            layers->samples[p]   = static_cast<float>(e.n);
+        }
+    }
+
+    // Traces one camera sample and adds it to `e`.
+    void sample(pixel_estimate& e, const ray& r, const hittable& world, Sampler& sampler) const
+    {
+        hit_record rec;
+        const bool hit = world.hit(r, interval(0, infinity), rec);
+        add_sample(e, r, hit, rec, world, sampler);
+    }
+
+    // Shades a camera sample whose primary ray has been traced and adds it to `e`.
+    void add_sample(pixel_estimate& e, const ray& r, bool hit, const hit_record& rec,
+                    const hittable& world, Sampler& sampler) const
+    {
+        const color c = integrator == Integrator::Path ? shade_path(r, hit, rec, max_depth, world, sampler)
+                                                       : shade_normal(r, hit, rec);
+        if (layers) e.add(c, features_of(r, hit, rec));
+        else e.add(c);
+    }
+
+    sample_features features_of(const ray& r, bool hit, const hit_record& rec) const
+    {
+        sample_features f;
+        if (!hit) return f;
+        f.normal = rec.normal;
+        f.depth  = dot(rec.p - r.origin(), forward);
+        f.object_id = rec.prim ? rec.prim->object_of(rec.inst) : 0;
+        const material* mat = material_of(rec);
+        f.albedo = mat ? mat->get_albedo(rec) : color(0, 0, 0);
+        return f;
+    }
+
+    // One pass over a tile: samples the pixels of `acc` up to `limit` each. Returns the
+    // number of samples taken.
+    std::uint64_t render_tile(std::vector<pixel_estimate>& acc, const hittable& world, int limit,
+                              int x0, int y0, int x1, int y1) const
+    {
+        std::uint64_t taken = 0;
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                const std::uint32_t pixel = static_cast<std::uint32_t>(j * image_width + i);
+                pixel_estimate& e = acc[pixel];
+                const int before = e.n;
+                while (wants_sample(e, limit)) {
+                    Sampler sampler(pixel, static_cast<std::uint32_t>(e.n), static_cast<std::uint32_t>(frame),
+                                    sample_method, static_cast<std::uint32_t>(samples_per_pixel));
+                    ray r = get_ray(i, j, sampler);
+                    sample(e, r, world, sampler);
+                    //e.add(ray_color(r, max_depth, world, pl));
+                }
+                taken += static_cast<std::uint64_t>(e.n - before);
+            }
+        }
+        return taken;
+    }
+
+    // Same image as render_tile, but the primary rays of each pixel block are traced as one
+    // packet and shaded afterwards. Samples are still summed per pixel in sample order; with
+    // adaptive sampling only the block's pixels that still want a sample join the packet.
+    std::uint64_t render_tile_packets(std::vector<pixel_estimate>& acc, const hittable& world, int limit,
+                                      int x0, int y0, int x1, int y1) const
+    {
+        const int pw = packet_size >= 8 ? 4 : 2;
+        const int ph = packet_size >= 16 ? 4 : packet_size >= 4 ? 2 : 1;
+        std::uint64_t taken = 0;
+        for (int by = y0; by < y1; by += ph) {
+            for (int bx = x0; bx < x1; bx += pw) {
+                const int bw = std::min(pw, x1 - bx), bh = std::min(ph, y1 - by);
+                pixel_estimate* est[kMaxPacketSize];
+                int before[kMaxPacketSize];
+                for (int dy = 0; dy < bh; ++dy)
+                    for (int dx = 0; dx < bw; ++dx) {
+                        est[dy * bw + dx] = &acc[static_cast<std::size_t>(by + dy) * image_width + bx + dx];
+                        before[dy * bw + dx] = est[dy * bw + dx]->n;
+                    }
+                for (;;) {
+                    RayPacket packet;
+                    Sampler samplers[kMaxPacketSize];
+                    ray primary[kMaxPacketSize];
+                    int pixel_of[kMaxPacketSize];   // lane -> pixel of the block
+                    for (int dy = 0; dy < bh; ++dy) {
+                        for (int dx = 0; dx < bw; ++dx) {
+                            const int p = dy * bw + dx;
+                            if (!wants_sample(*est[p], limit)) continue;
+                            const std::uint32_t pixel = static_cast<std::uint32_t>((by + dy) * image_width + bx + dx);
+                            const int k = packet.size;
+                            samplers[k].start(pixel, static_cast<std::uint32_t>(est[p]->n),
+                                              static_cast<std::uint32_t>(frame), sample_method,
+                                              static_cast<std::uint32_t>(samples_per_pixel));
+                            primary[k] = get_ray(bx + dx, by + dy, samplers[k]);
+                            packet.add(primary[k], interval(0, infinity));
+                            pixel_of[k] = p;
+                        }
+                    }
+                    if (packet.size == 0) break;
+                    if (packet.size < 4) {
+                        // a few pixels left sampling on their own: not worth a packet traversal
+                        for (int k = 0; k < packet.size; ++k)
+                            sample(*est[pixel_of[k]], primary[k], world, samplers[k]);
+                        continue;
+                    }
+                    hit_record recs[kMaxPacketSize];
+                    const std::uint32_t hits = world.hit_packet(packet, recs);
+                    // Bounces after the primary hit diverge, so they go back to single rays.
+                    for (int k = 0; k < packet.size; ++k)
+                        add_sample(*est[pixel_of[k]], primary[k], (hits >> k & 1) != 0, recs[k], world, samplers[k]);
+                }
+                for (int p = 0; p < bw * bh; ++p) taken += static_cast<std::uint64_t>(est[p]->n - before[p]);
+            }
+        }
+        return taken;
+    }
+
     void initialize() 
     {
         image_height = static_cast<int>(image_width / aspect_ratio);
         image_height = (image_height < 1) ? 1 : image_height;
         vec3 fwd = unit_vector(gaze);
+        forward = fwd;
         up = unit_vector(up);
         vec3 u = unit_vector(cross(fwd, up));
         vec3 v = cross(u, fwd);
@@ -91,7 +425,14 @@ private:
     color ray_color_normal(const ray& r, const hittable& objects) const 
     {
         hit_record rec;
-        if (objects.hit(r, interval(1e-4, infinity), rec)) {
+        const bool hit = objects.hit(r, interval(0, infinity), rec);
+        return shade_normal(r, hit, rec);
+    }
+
+    // Normal visualisation for a primary hit that has already been traced.
+    color shade_normal(const ray& r, bool hit, const hit_record& rec) const
+    {
+        if (hit) {
             return 0.5 * (rec.normal + color(1,1,1));
         }
         vec3 unit_direction = unit_vector(r.direction());
@@ -99,22 +440,32 @@ private:
         return (1.0-a)*color(1.0, 1.0, 1.0) + a*color(0.5, 0.7, 1.0);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& objects) const //use for ray tracing without caring about the light
+    color ray_color(const ray& r, int depth, const hittable& objects, Sampler& sampler) const //use for ray tracing without caring about the light
     {
-        
         if (depth <= 0)
             return color(0,0,0);
 
         hit_record rec;
-        if (objects.hit(r, interval(0.001, infinity), rec)) {
-            if (!rec.mat) 
+        const bool hit = objects.hit(r, interval(0, infinity), rec);
+        return shade_path(r, hit, rec, depth, objects, sampler);
+    }
+
+    // ray_color for a ray that has already been traced.
+    color shade_path(const ray& r, bool hit, const hit_record& rec, int depth, const hittable& objects,
+                     Sampler& sampler) const
+    {
+        if (hit) {
+            const material* mat = material_of(rec);
+            if (!mat) 
             {                       // 关键：检查材质指针
-            std::clog << "ERROR: rec.mat is null\n";
+            std::clog << "ERROR: no material " << rec.mat_id << "\n";
+            return color(0,0,0);
             }
             ray scattered;
             color attenuation;
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
-                return attenuation * ray_color(scattered, depth-1, objects);
+            sampler.set_bounce(static_cast<std::uint32_t>(max_depth - depth + 1));
+            if (mat->scatter(r, rec, attenuation, scattered, sampler))
+                return attenuation * ray_color(scattered, depth-1, objects, sampler);
             return color(0,0,0);
         }
 
@@ -129,28 +480,29 @@ private:
         if (depth <= 0) return color(0,0,0);
 
         hit_record rec;
-        if (!world.hit(r, interval(0.001, infinity), rec)) {
+        if (!world.hit(r, interval(0, infinity), rec)) {
             return color(0.5,0.7,1.0);
         }
 
         vec3 wo = -unit_vector(r.direction());
 
-        if (auto L = std::dynamic_pointer_cast<const lambertian>(rec.mat)) {
+        const material* mat = material_of(rec);
+        if (auto L = dynamic_cast<const lambertian*>(mat)) {
             color kd = L->get_albedo(rec);
-            color Ld = BlinnPhongDiffuse(rec, world, lights);
-            color Ls = BlinnPhongSpec(rec, world, lights, wo, /*ks=*/color(0.6), /*shininess=*/24.0);
+            color Ld, Ls;
+            BlinnPhong(rec, world, lights, wo, /*ks=*/color(0.6), /*shininess=*/24.0, Ld, Ls);
             return kd * Ld + Ls;               // 漫反 * 直射 + 高光
         }
 
-        // if (auto M = dynamic_cast<const metal*>(rec.mat)) {
+        // if (auto M = dynamic_cast<const metal*>(mat)) {
         //     vec3 refl = reflect(wo, rec.normal);       // 完美镜面反射
-        //     ray  rr(rec.p + EPS * refl, refl);
+        //     ray  rr = rec.spawn(refl);
         //     color Lr = ray_color(rr, depth - 1, world, lights);
         //     // 你可以选择是否用金属 albedo 给反射上色
         //     return /*M->get_albedo() * */ Lr;
         // }
 
-        if (auto D = std::dynamic_pointer_cast<idealDielectric>(rec.mat)) {  // 若你用 raw* 就用 dynamic_cast
+        if (auto D = dynamic_cast<const idealDielectric*>(mat)) {
             const double ior = D->get_ior();
             const double eta = rec.front_face ? (1.0 / ior) : ior;
 
@@ -165,14 +517,14 @@ private:
 
             // 反射方向（总是可用）
             vec3 refl_dir = reflect(wi, rec.normal);
-            color Lr = ray_color(ray(rec.p + EPS * refl_dir, refl_dir), depth - 1, world, lights);
+            color Lr = ray_color(rec.spawn(refl_dir), depth - 1, world, lights);
 
             color Lt(0,0,0);
             // 先判断是否全内反射
             if (eta * eta * sin2_theta <= 1.0) {
                 // 非 TIR 才计算折射
                 vec3 refr_dir = refract(wi, rec.normal, eta);  // 你的 3 参数版本
-                Lt = ray_color(ray(rec.p + EPS * refr_dir, refr_dir), depth - 1, world, lights);
+                Lt = ray_color(rec.spawn(refr_dir), depth - 1, world, lights);
             } else {
                 // 全内反射：全部走反射
                 F = 1.0;
@@ -183,8 +535,23 @@ private:
         return BlinnPhongDiffuse(rec, world, lights);
     }
 
-    ray get_ray(int i, int j) const {
-        vec3 offset = sample_square();
+    // Everything a pixel's samples depend on besides the scene: a checkpoint made with
+    // other values is not resumed.
+    std::vector<double> checkpoint_params() const {
+        return {double(image_width), double(image_height), double(frame), double(samples_per_pixel),
+                adaptive_error, double(std::max(min_samples, 2)), double(max_depth), double(sizeof(real)),
+                double(static_cast<int>(sample_method)), double(static_cast<int>(integrator)),
+                double(layers != nullptr),
+                center.x(), center.y(), center.z(), gaze.x(), gaze.y(), gaze.z(), up.x(), up.y(), up.z(),
+                focal_mm, sensor_w_mm, sensor_h_mm, focus_dist};
+    }
+
+    const material* material_of(const hit_record& rec) const {
+        return materials && rec.mat_id < materials->size() ? (*materials)[rec.mat_id].get() : nullptr;
+    }
+
+    ray get_ray(int i, int j, Sampler& sampler) const {
+        vec3 offset = sample_square(sampler);
         point3 pixel_center = pixel00_loc
                           + ((i + offset.x()) * pixel_delta_u)
                           + ((j + offset.y()) * pixel_delta_v);
@@ -192,9 +559,10 @@ private:
         return ray{center, ray_direction};
     }
 
-    vec3 sample_square() const {
+    vec3 sample_square(Sampler& sampler) const {
         // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+        const auto [dx, dy] = sampler.get2D();
+        return vec3(dx - 0.5, dy - 0.5, 0);
     }
 };
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "color.h"
+#include "parallel.h"
+#include "tgaimage.h"
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double msSince(clock_type::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+// Rows are independent, so every encoder fills its output buffer a scanline per task.
+constexpr std::size_t kRowsPerTask = 8;
+
+ImageWriteStats writeBytes(const std::string& path, const std::string& header,
+                           const std::vector<std::uint8_t>& body, double encode_ms)
+{
+    ImageWriteStats st;
+    st.encode_ms = encode_ms;
+    auto t0 = clock_type::now();
+    std::ofstream out(path, std::ios::binary);
+    if (out) {
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(reinterpret_cast<const char*>(body.data()), static_cast<std::streamsize>(body.size()));
+        st.ok = out.good();
+    }
+    st.write_ms = msSince(t0);
+    st.bytes    = header.size() + body.size();
+    return st;
+}
+
+bool hasExtension(const std::string& path, const char* ext)
+{
+    const std::size_t n = std::strlen(ext);
+    if (path.size() < n) return false;
+    for (std::size_t i = 0; i < n; ++i) {
+        char c = path[path.size() - n + i];
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        if (c != ext[i]) return false;
+    }
+    return true;
+}
+
+// Next header token of a P6 / PF file; '#' starts a comment up to the end of the line.
+bool headerToken(std::istream& in, std::string& tok)
+{
+    tok.clear();
+    for (int c; (c = in.get()) != EOF;) {
+        if (c == '#' && tok.empty()) { while ((c = in.get()) != EOF && c != '\n') {} continue; }
+        if (std::isspace(c)) { if (!tok.empty()) return true; continue; }
+        tok += static_cast<char>(c);
+    }
+    return !tok.empty();
+}
+} // namespace
+
+ImageWriteStats Image::writePPM(const std::string& path) const
+{
+    auto t0 = clock_type::now();
+    std::ostringstream text;
+    text << "P3\n" << width_ << ' ' << height_ << "\n255\n";
+    for (const auto& c : pixels_) writeColor(text, c);
+    const std::string s = text.str();
+    double encode_ms = msSince(t0);
+    return writeBytes(path, s, {}, encode_ms);
+}
+
+ImageWriteStats Image::writeP6(const std::string& path) const
+{
+    auto t0 = clock_type::now();
+    const std::size_t row = static_cast<std::size_t>(width_) * 3;
+    std::vector<std::uint8_t> body(row * height_);
+    parallel_for(0, static_cast<std::size_t>(height_), kRowsPerTask, [&](std::size_t y) {
+        const color* src = pixels_.data() + y * width_;
+        std::uint8_t* dst = body.data() + y * row;
+        for (int x = 0; x < width_; ++x) {
+            dst[3 * x + 0] = toByte(src[x].x());
+            dst[3 * x + 1] = toByte(src[x].y());
+            dst[3 * x + 2] = toByte(src[x].z());
+        }
+    });
+    double encode_ms = msSince(t0);
+    std::string header = "P6\n" + std::to_string(width_) + ' ' + std::to_string(height_) + "\n255\n";
+    return writeBytes(path, header, body, encode_ms);
+}
+
+ImageWriteStats Image::writePFM(const std::string& path) const
+{
+    auto t0 = clock_type::now();
+    const std::size_t row = static_cast<std::size_t>(width_) * 3 * sizeof(float);
+    std::vector<std::uint8_t> body(row * height_);
+    parallel_for(0, static_cast<std::size_t>(height_), kRowsPerTask, [&](std::size_t y) {
+        const color* src = pixels_.data() + y * width_;
+        // PFM stores the bottom scanline first
+        std::uint8_t* dst = body.data() + (static_cast<std::size_t>(height_) - 1 - y) * row;
+        for (int x = 0; x < width_; ++x) {
+            const float rgb[3] = {float(src[x].x()), float(src[x].y()), float(src[x].z())};
+            std::memcpy(dst + x * sizeof(rgb), rgb, sizeof(rgb));
+        }
+    });
+    double encode_ms = msSince(t0);
+    // A negative scale marks little-endian data; every platform we build on is little-endian.
+    std::string header = "PF\n" + std::to_string(width_) + ' ' + std::to_string(height_) + "\n-1.0\n";
+    return writeBytes(path, header, body, encode_ms);
+}
+
+ImageWriteStats Image::writeTGA(const std::string& path, bool rle) const
+{
+    auto t0 = clock_type::now();
+    TGAImage tga(width_, height_, TGAImage::RGB);
+    parallel_for(0, static_cast<std::size_t>(height_), kRowsPerTask, [&](std::size_t y) {
+        for (int x = 0; x < width_; ++x) {
+            const color& c = pixels_[y * width_ + x];
+            TGAColor t;
+            t.bgra[0] = toByte(c.z());
+            t.bgra[1] = toByte(c.y());
+            t.bgra[2] = toByte(c.x());
+            t.bytespp = TGAImage::RGB;
+            tga.set(x, static_cast<int>(y), t);
+        }
+    });
+    std::vector<std::uint8_t> body;
+    tga.encode(body, /*vflip=*/false, rle);   // rows are stored top first
+    double encode_ms = msSince(t0);
+    return writeBytes(path, {}, body, encode_ms);
+}
+
+ImageWriteStats Image::write(const std::string& path) const
+{
+    if (hasExtension(path, ".pfm")) return writePFM(path);
+    if (hasExtension(path, ".tga")) return writeTGA(path);
+    return writeP6(path);
+}
+
+bool Image::read(const std::string& path, Image& out)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string magic, w, h, scale;
+    if (!in || !headerToken(in, magic) || !headerToken(in, w) || !headerToken(in, h) || !headerToken(in, scale))
+        return false;
+    const int width = std::atoi(w.c_str()), height = std::atoi(h.c_str());
+    if (width <= 0 || height <= 0) return false;
+    Image img(width, height);
+    const std::size_t n = static_cast<std::size_t>(width) * height;
+    if (magic == "P6" && scale == "255") {
+        std::vector<std::uint8_t> body(3 * n);
+        if (!in.read(reinterpret_cast<char*>(body.data()), static_cast<std::streamsize>(body.size()))) return false;
+        for (std::size_t i = 0; i < n; ++i)
+            img.pixels_[i] = color(body[3 * i] / 255.0, body[3 * i + 1] / 255.0, body[3 * i + 2] / 255.0);
+    } else if (magic == "PF" && std::atof(scale.c_str()) < 0) {   // little-endian only, as written
+        std::vector<float> body(3 * n);
+        if (!in.read(reinterpret_cast<char*>(body.data()), static_cast<std::streamsize>(body.size() * sizeof(float))))
+            return false;
+        for (int y = 0; y < height; ++y) {
+            const float* src = body.data() + static_cast<std::size_t>(height - 1 - y) * width * 3;
+            for (int x = 0; x < width; ++x)
+                img.at(x, y) = color(src[3 * x], src[3 * x + 1], src[3 * x + 2]);
+        }
+    } else {
+        return false;
+    }
+    out = std::move(img);
+    return true;
+}
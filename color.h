@@ -1,40 +1,67 @@
 #pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
 #include "vec3.h"
 #include "interval.h"
 using color = vec3;
 
-inline void writeColor(std::ostream& out, const color& c) {
-    auto r = c.x();
-    auto g = c.y();
-    auto b = c.z();
-
-    // Translate the [0,1] component values to the byte range [0,255].
+// Translate a [0,1] component value to the byte range [0,255].
+inline std::uint8_t toByte(double v) {
     static const interval intensity(0.000, 0.999);
-    int rbyte = int(256 * intensity.clamp(r));
-    int gbyte = int(256 * intensity.clamp(g));
-    int bbyte = int(256 * intensity.clamp(b));
+    return static_cast<std::uint8_t>(256 * intensity.clamp(v));
+}
 
+inline void writeColor(std::ostream& out, const color& c) {
     // Write out the pixel color components.
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+    out << int(toByte(c.x())) << ' ' << int(toByte(c.y())) << ' ' << int(toByte(c.z())) << '\n';
 }
 
+// Time spent turning the pixels into file bytes vs pushing those bytes to disk.
+struct ImageWriteStats {
+    double      encode_ms = 0.0;
+    double      write_ms  = 0.0;
+    std::size_t bytes     = 0;
+    bool        ok        = false;
+};
+
+// Linear-colour framebuffer, row-major with the top scanline first.
 class Image {
 public:
+    Image() = default;
+    Image(int width, int height)
+        : width_(width), height_(height),
+          pixels_(static_cast<std::size_t>(width) * height, color(0, 0, 0)) {}
     Image(int width, int height, const std::string& filename)
         : width_(width), height_(height), filename_(filename),
-          pixels_(width * height, color(0, 0, 0)) {}
+          pixels_(static_cast<std::size_t>(width) * height, color(0, 0, 0)) {}
+
+    int width()  const { return width_; }
+    int height() const { return height_; }
+    const std::vector<color>& pixels() const { return pixels_; }
+
+    color& at(int x, int y)             { return pixels_[static_cast<std::size_t>(y) * width_ + x]; }
+    const color& at(int x, int y) const { return pixels_[static_cast<std::size_t>(y) * width_ + x]; }
 
-    color& at(int x, int y)             { return pixels_[y * width_ + x]; }
-    const color& at(int x, int y) const { return pixels_[y * width_ + x]; }
+    // ASCII P3, kept for tools that only read text PPM.
+    void writePPM() const { writePPM(filename_); }
+    ImageWriteStats writePPM(const std::string& path) const;
+    // Binary P6 PPM, 8 bits per channel.
+    ImageWriteStats writeP6(const std::string& path) const;
+    // Portable float map: linear, unclamped 32-bit RGB, bottom scanline first.
+    ImageWriteStats writePFM(const std::string& path) const;
+    // Uncompressed or RLE truecolour TGA via TGAImage.
+    ImageWriteStats writeTGA(const std::string& path, bool rle = true) const;
+    // Picks the format from the extension (.ppm -> P6, .pfm, .tga).
+    ImageWriteStats write(const std::string& path) const;
 
-    void writePPM() const {
-        std::ofstream out(filename_);
-        out << "P3\n" << width_ << ' ' << height_ << "\n255\n";
-        for (const auto& c : pixels_) writeColor(out, c);
-    }
+    // Reads what writeP6 / writePFM produce (P6 bytes map back to [0,1]). False on a
+    // missing file or any other format.
+    static bool read(const std::string& path, Image& out);
 
 private:
-    int width_, height_;
+    int width_ = 0, height_ = 0;
     std::string filename_;
     std::vector<color> pixels_;
 };
@@ -1,80 +1,84 @@
 #pragma once
 #include "hittable.h"
+#include "intersect_kernels.h"
 #include "vec3.h"
 #include "mat3.h"
-#include "plane.h"
-#include <vector>
+#include <memory>
+class PrimitiveSoA;
 namespace rt {
+// An oriented box: a cube of half-extent `half` rotated by R and centred at `center`.
+// Rays are taken into the box's frame (R^T, no scaling, so t is unchanged) and
+// intersected with one slab test; the hit face is the axis of the entry (or, from inside,
+// exit) distance.
 class cube : public hittable
 {
 private:
-    std::vector<plane> planes;
-    point3 minV;
-    point3 maxV;
-    std::shared_ptr<material> mat;
+    point3 center;
+    mat3 to_local;   // R^T; row a is the world direction of local axis a
+    real half;
+    std::uint32_t mat_id;
+    friend class ::PrimitiveSoA;
 
 public:
-    cube(vec3 translation, vec3 rotation_euler_xyz_rad, double scale_1d, std::shared_ptr<material> mat) :mat(mat)
+    cube(vec3 translation, vec3 rotation_euler_xyz_rad, real scale_1d, std::uint32_t mat_id)
+        : center(translation), to_local(eulerXYZ_to_mat3(rotation_euler_xyz_rad).transpose()),
+          half(std::fabs(scale_1d)), mat_id(mat_id) {}
+
+    // Object -> world transform of a cube: rotate the scaled [-1, 1]^3 cube, then translate.
+    static mat3 object_to_world(vec3 rotation_euler_xyz_rad, real scale_1d)
     {
-        const double s = scale_1d;
-        std::vector<point3> P{point3(-s,-s,-s), point3( s,-s,-s),
-                              point3( s, s,-s), point3(-s, s,-s),
-                              point3(-s,-s, s), point3( s,-s, s),
-                              point3( s, s, s), point3(-s, s, s)};
-        mat3 R = eulerXYZ_to_mat3(rotation_euler_xyz_rad);
-        // rotate then translate
-        auto Xform = [&](point3 p){return translation + R * p; };
-        for (auto& p : P) p = Xform(p);
-        planes.reserve(6);
-        // Faces with CCW winding as seen from OUTSIDE
-        planes.emplace_back(P[0], P[1], P[2], P[3], mat);// -Z (back):   (0,1,2,3)
-        planes.emplace_back(P[4], P[5], P[6], P[7], mat);// +Z (front):  (4,5,6,7)
-        planes.emplace_back(P[0], P[1], P[5], P[4], mat);// -Y (bottom): (0,1,5,4)
-        planes.emplace_back(P[3], P[2], P[6], P[7], mat);// +Y (top):    (3,2,6,7)
-        planes.emplace_back(P[0], P[4], P[7], P[3], mat);// -X (left):   (0,4,7,3)
-        planes.emplace_back(P[1], P[2], P[6], P[5], mat);// +X (right):  (1,2,6,5)
+        return eulerXYZ_to_mat3(rotation_euler_xyz_rad) * scale_1d;
     }
 
-    bounds3 getBounds() const override 
+    // The [-1, 1]^3 box at the origin, for sharing between instances (instance_bvh.h): an
+    // instance's object-space ray goes straight into the slab test.
+    static std::shared_ptr<cube> unit()
     {
-        if (planes.empty()) return bounds3();
-        double min_x = planes[0].a().x(), min_y = planes[0].a().y(), min_z = planes[0].a().z();
-        double max_x = min_x, max_y = min_y, max_z = min_z;
-
-        auto acc = [&](const point3& p) {
-            min_x = std::min(min_x, p.x());  max_x = std::max(max_x, p.x());
-            min_y = std::min(min_y, p.y());  max_y = std::max(max_y, p.y());
-            min_z = std::min(min_z, p.z());  max_z = std::max(max_z, p.z());
-        };
+        return std::make_shared<cube>(vec3(0, 0, 0), vec3(0, 0, 0), 1.0, 0);
+    }
 
-        for (const auto& f : planes) {
-            acc(f.a()); acc(f.b()); acc(f.c()); acc(f.d());
-        }
+    bounds3 getBounds() const override
+    {
+        // half-extent along world axis i: half * sum_j |R_ij|, with R_ij = to_local[j][i]
+        vec3 e;
+        for (int i = 0; i < 3; ++i)
+            e[i] = half * (std::fabs(to_local.m[0][i]) + std::fabs(to_local.m[1][i]) + std::fabs(to_local.m[2][i]));
+        const real eps = 1e-6;
+        for (int i = 0; i < 3; ++i) e[i] = std::max(e[i], eps);
+        return bounds3(center - e, center + e);
+    }
 
-        const double eps = 1e-6;
-        if (max_x - min_x < eps) { min_x -= eps; max_x += eps; }
-        if (max_y - min_y < eps) { min_y -= eps; max_y += eps; }
-        if (max_z - min_z < eps) { min_z -= eps; max_z += eps; }
+    // h.id = 2 * face axis + 1 for the +half face, + 0 for the -half one.
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override
+    {
+        real t;
+        std::uint32_t face;
+        if (!intersect_box(center, to_local, half, r, ray_t, t, face)) return false;
+        h.t = t;
+        h.id = face;
+        h.prim = this;
+        return true;
+    }
 
-        return bounds3(point3(min_x,min_y,min_z), point3(max_x,max_y,max_z));
+    void surface(const ray& r, const hit_info& h, hit_record& rec) const override
+    {
+        const int axis = static_cast<int>(h.id >> 1);
+        const real sign = (h.id & 1) ? 1.0 : -1.0;
+        const vec3 outward(sign * to_local.m[axis][0], sign * to_local.m[axis][1], sign * to_local.m[axis][2]);
+        rec.p = r.at(h.t);
+        const vec3 local = to_local * (rec.p - center);
+        const int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+        const real inv = real(0.5) / half;
+        rec.uv = point2(float(local[a1] * inv + 0.5), float(local[a2] * inv + 0.5));
+        rec.set_face_normal(r, outward);
+        rec.mat_id = mat_id;
     }
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    bool occluded(const ray& r, interval ray_t) const override
     {
-        bool hit_any = false;
-        double closest = ray_t.max;
-        hit_record temp;
-        for (const auto& p : planes)
-        {
-            if (p.hit(r, {ray_t.min, closest}, temp)) 
-            {
-                hit_any = true;
-                closest = temp.t;
-                rec = temp;
-                rec.mat = mat;
-            }
-        }
-        return hit_any;
+        real t;
+        std::uint32_t face;
+        return intersect_box(center, to_local, half, r, ray_t, t, face);
     }
     };
 
@@ -2,31 +2,119 @@
 #include "ray.h"
 #include "interval.h"
 #include "bounds3.h"
+#include "packet.h"
 #include <memory>
 
 
 class material;
+class hittable;
 
+// What traversal keeps for a candidate hit: the distance and enough to find the surface
+// again. `prim` is the leaf primitive that was hit; `id`, `u` and `v` mean whatever that
+// primitive puts there (triangle index and barycentrics, cube face and face coordinates).
+struct hit_info {
+    real t = 0.0;
+    const hittable* prim = nullptr;
+    std::uint32_t id   = 0;
+    std::uint32_t inst = 0;   // instance index when prim is an rt::instance_bvh
+    real u = 0.0, v = 0.0;
+};
+
+// Shading data of the closest hit, built once by hittable::surface().
 class hit_record {
 public:
     point3 p;
-    vec3 normal;
-    double t;
+    vec3 normal;                // shading normal, on the incoming ray's side
+    vec3 ng;                    // geometric normal, same side; what spawn() offsets along
+    real t;
+    real p_error = 0;           // bound on the rounding error in p's coordinates (ray::at_error)
     point2 uv;
     bool front_face;
-    std::shared_ptr<material> mat;
+    std::uint32_t mat_id = 0;   // index into the scene's material table (hittable_list::materials)
+    const hittable* prim = nullptr;  // hit_info::prim and ::inst of the hit, for hittable::object_of()
+    std::uint32_t inst = 0;
     //Ensuring that the normal of the plain is always pointing outside the shape
     void set_face_normal(const ray& r, const vec3& outward_normal)
     {
       front_face = dot(r.direction(), outward_normal) < 0;
       normal = front_face ? outward_normal : -outward_normal;
+      ng = normal;
     }
+    // Secondary ray from this hit, offset off the surface so it can be traced from t = 0.
+    // The error bound only holds along the geometric normal: an interpolated normal can
+    // put `dir` on the other side of the true surface.
+    ray spawn(const vec3& dir) const { return ray(offset_ray_origin(p, p_error, ng, dir), dir); }
 };
 
 class hittable {
 public:
     virtual ~hittable() = default;
-    virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    // Object ID for the object-ID layer, assigned by hittable_list::add() (0 = unassigned).
+    // An aggregate of instances takes object_count() consecutive IDs.
+    std::uint32_t object_id = 0;
+    virtual std::uint32_t object_count() const { return 1; }
+    // ID of the object a hit on this leaf primitive belongs to; `inst` is hit_info::inst.
+    virtual std::uint32_t object_of(std::uint32_t inst) const { (void)inst; return object_id; }
+
+    // Closest hit inside ray_t. Only hit_info is written, so candidates that a closer hit
+    // replaces later cost nothing beyond their distance. `h` is left alone on a miss:
+    // aggregates pass the same one to every candidate.
+    virtual bool intersect(const ray& r, interval ray_t, hit_info& h) const = 0;
     virtual bounds3 getBounds() const = 0;
 
+    // Position, normal, UV and material of a hit this primitive reported through
+    // intersect(). Aggregates never get the call: their hits name the leaf primitive.
+    virtual void surface(const ray& r, const hit_info& h, hit_record& rec) const {
+        (void)r; (void)h; (void)rec;
+    }
+
+    // intersect() followed by surface() for the hit it found.
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+        hit_info h;
+        if (!intersect(r, ray_t, h)) return false;
+        h.prim->surface(r, h, rec);
+        rec.t = h.t;
+        rec.p_error = r.at_error(h.t);
+        rec.prim = h.prim;
+        rec.inst = h.inst;
+        return true;
+    }
+
+    // Any-hit query for shadow rays: true as soon as anything lies inside ray_t. The
+    // default looks for the closest hit; primitives should return at the first one.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_info h;
+        return intersect(r, ray_t, h);
+    }
+
+    // Closest hit for every active ray of the packet. Returns the mask of rays that hit;
+    // hits[k] is written for those only. By default the rays are traced one at a time.
+    virtual std::uint32_t intersect_packet(const RayPacket& packet, hit_info* hits) const {
+        std::uint32_t mask = 0;
+        for (int k = 0; k < packet.size; ++k) {
+            if (!(packet.active >> k & 1)) continue;
+            if (intersect(packet.get(k), interval(packet.tmin[k], packet.tmax[k]), hits[k])) mask |= 1u << k;
+        }
+        return mask;
+    }
+    // intersect_packet() followed by surface() for every ray that hit.
+    std::uint32_t hit_packet(const RayPacket& packet, hit_record* recs) const {
+        hit_info hits[kMaxPacketSize];
+        const std::uint32_t mask = intersect_packet(packet, hits);
+        for (int k = 0; k < packet.size; ++k) {
+            if (!(mask >> k & 1)) continue;
+            hits[k].prim->surface(packet.get(k), hits[k], recs[k]);
+            recs[k].t = hits[k].t;
+            recs[k].p_error = packet.get(k).at_error(hits[k].t);
+            recs[k].prim = hits[k].prim;
+            recs[k].inst = hits[k].inst;
+        }
+        return mask;
+    }
+    // True when intersect_packet() does better than one intersect() per ray (aggregates
+    // with their own packet traversal); BVH::intersect_packet then hands such a leaf the
+    // whole packet.
+    virtual bool traces_packets() const { return false; }
+
 };
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "hittable.h"
+#include <chrono>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <memory>
 #include "interval.h"
@@ -9,8 +11,14 @@
 #include "sphere.h"
 #include "plane.h"
 #include "cube.h"
+#include "triangle_mesh.h"
+#include "instance_bvh.h"
+#include "model.h"
 #include "BVH.h"
+#include "PrimitiveSoA.h"
+#include "simd.h"
 #include "lighting.h"
+#include "material.h"
 using std::shared_ptr;
 
 class hittable_list : public hittable
@@ -18,47 +26,87 @@ class hittable_list : public hittable
 public:
     std::vector<shared_ptr<hittable>> objects;
     std::vector<PointLightRT> pointLights;
+    // Every material of the scene; primitives and hit_record refer to them by index
+    material_table materials;
+    // Parallel to bd::Scene::meshes, null where a mesh had no triangles
+    std::vector<shared_ptr<rt::triangle_mesh>> meshes;
+    // Cubes as instances of one shared unit-cube mesh under their own top-level BVH,
+    // instead of one rt::cube per cube in the scene BVH
+    bool instance_cubes = true;
     hittable_list(){};
     std::unique_ptr<BVH> bvh;
     hittable_list(shared_ptr<hittable> object){add(object);}
-    void clear(){objects.clear(); bvh.reset();}
+    void clear(){objects.clear(); meshes.clear(); materials.clear(); bvh.reset();
+                 spheres.clear(); sphere_prims.clear(); others.clear(); next_object_id = 1;}
     void add(shared_ptr<hittable> object){
+        object->object_id = next_object_id;
+        next_object_id += object->object_count();
+        // 没有 BVH 时的逐个测试：球体另存一份 SoA，批量求交
+        if (auto s = dynamic_cast<const rt::sphere*>(object.get())) {
+            spheres.add(*s);
+            sphere_prims.push_back(s);
+        } else {
+            others.push_back(object.get());
+        }
         objects.push_back(std::move(object));
         bvh.reset();
     }
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override 
+    std::uint32_t add_material(shared_ptr<material> mat){
+        materials.push_back(std::move(mat));
+        return static_cast<std::uint32_t>(materials.size() - 1);
+    }
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override 
     {
         if (bvh) {
-            return bvh->hit(r, ray_t, rec);
+            return bvh->intersect(r, ray_t, h);
         }
-        //
-        hit_record best{};          // 保存目前为止最好的命中
         bool       found = false;   // 是否命中过任意物体
-        double     t_max = ray_t.max;
+        real       t_max = ray_t.max;
 
-        for (const shared_ptr<hittable>& obj : objects) {
-            hit_record h{};
-
-            // 发现更近的命中就收紧区间上界，确保最终是“最近命中”
-            if (obj->hit(r, interval(ray_t.min, t_max), h)) {
+        // spheres first, four at a time; an exactly equal t on a later object does not replace them
+        real t;
+        std::uint32_t which;
+        if (spheres.intersect(0, spheres.size(), r, ray_t, t, which, simdEnabled())) {
+            found  = true;
+            t_max  = t;
+            h.t    = t;
+            h.prim = sphere_prims[which];
+        }
+        for (const hittable* obj : others) {
+            // 发现更近的命中就收紧区间上界，确保最终是“最近命中”；h 只在命中时被改写
+            if (obj->intersect(r, interval(ray_t.min, t_max), h)) {
                 found = true;
                 t_max = h.t;        // 缩小搜索窗口
-                best  = h;
             }
         }
-
-        if (found) rec = best;
         return found;
     }
-    void loadScene(bd::Scene& scene) 
+    bool occluded(const ray& r, interval ray_t) const override
+    {
+        if (bvh) return bvh->occluded(r, ray_t);
+        real t;
+        std::uint32_t which;
+        if (spheres.intersect(0, spheres.size(), r, ray_t, t, which, simdEnabled())) return true;
+        for (const hittable* obj : others)
+            if (obj->occluded(r, ray_t)) return true;
+        return false;
+    }
+    std::uint32_t intersect_packet(const RayPacket& packet, hit_info* hits) const override
+    {
+        if (bvh) return bvh->intersect_packet(packet, hits);
+        return hittable::intersect_packet(packet, hits);
+    }
+    // `built_meshes` (from the scene cache) replaces loading and building the OBJ of each
+    // mesh; it is parallel to scene.meshes and entries without triangles are skipped.
+    void loadScene(bd::Scene& scene, std::vector<rt::triangle_mesh_data>* built_meshes = nullptr)
     {
         
         //temp
-        auto material_ground = std::make_shared<lambertian>(color(0.8, 0.8, 0.0));
-        auto material_center = std::make_shared<lambertian>(color(0.1, 0.2, 0.5));
-        auto material_left   = std::make_shared<dielectric>(1.00 / 1.33);
-        auto idealD   = std::make_shared<idealDielectric>(1.50);
-        auto material_right  = std::make_shared<metal>(color(0.8, 0.6, 0.2));
+        const std::uint32_t material_ground = add_material(std::make_shared<lambertian>(color(0.8, 0.8, 0.0)));
+        const std::uint32_t material_center = add_material(std::make_shared<lambertian>(color(0.1, 0.2, 0.5)));
+        const std::uint32_t idealD          = add_material(std::make_shared<idealDielectric>(1.50));
+        // auto material_left   = std::make_shared<dielectric>(1.00 / 1.33);
+        // auto material_right  = std::make_shared<metal>(color(0.8, 0.6, 0.2));
 
         //end
         if (scene.point_lights.empty()) std::clog << "No point lights\n";
@@ -71,6 +119,16 @@ public:
 
         // cubes
         if (scene.cubes.empty()) std::clog << "No cubes\n";
+        else if (instance_cubes) {
+            auto cubes = std::make_shared<rt::instance_bvh>();
+            const std::uint32_t unit = cubes->add_geometry(rt::cube::unit());
+            for (auto& c : scene.cubes)
+                cubes->add(unit, rt::cube::object_to_world(c.rotation_euler_xyz_rad, c.scale_1d), c.translation, material_center);
+            BVHBuildOptions tlas;
+            tlas.method = SplitMethod::SAH;
+            cubes->build(tlas);
+            add(cubes);
+        }
         else for (auto& c : scene.cubes)
             add(std::make_shared<rt::cube>(c.translation, c.rotation_euler_xyz_rad, c.scale_1d, material_center));
 
@@ -81,16 +139,52 @@ public:
             // // Codes for uv mapping
             // if (!p.texture.empty()) {
             //     ImageTexture t{p.texture};
-            //     auto textureMat = std::make_shared<lambertian>(t);
+            //     auto textureMat = add_material(std::make_shared<lambertian>(t));
             //     add(std::make_shared<rt::plane>(p.corners[0], p.corners[1], p.corners[2], p.corners[3], textureMat));
             // }
             // else add(std::make_shared<rt::plane>(p.corners[0], p.corners[1], p.corners[2], p.corners[3], material_ground));
+
+        // meshes: one hittable per mesh, with its own SAH BVH over the triangles
+        BVHBuildOptions mesh_bvh;
+        mesh_bvh.method        = SplitMethod::SAH;
+        mesh_bvh.max_leaf_size = 4;
+        mesh_bvh.sah_leaves    = true;
+        for (size_t i = 0; i < scene.meshes.size(); ++i) {
+            const bd::Mesh& m = scene.meshes[i];
+            shared_ptr<rt::triangle_mesh> mesh;
+            if (built_meshes && i < built_meshes->size()) {
+                rt::triangle_mesh_data& d = (*built_meshes)[i];
+                if (!d.indices.empty()) mesh = std::make_shared<rt::triangle_mesh>(std::move(d), material_center);
+            } else {
+                model obj(m.file);
+                if (obj.nfaces() > 0) mesh = std::make_shared<rt::triangle_mesh>(obj, material_center, mesh_bvh);
+            }
+            meshes.push_back(mesh);
+            if (!mesh) { std::clog << "Mesh " << m.name << ": no triangles in " << m.file << "\n"; continue; }
+            add(mesh);
+        }
     }
 
-    void buildBVH()
+    // `prebuilt` is a tree from the scene cache built over this same object list; it is
+    // ignored (and the BVH rebuilt) if it does not cover every object.
+    void buildBVH(const BVHBuildOptions& opts = {}, LinearBVH* prebuilt = nullptr)
     {
-        std::clog << "Generating BVH...\n\n" << std::endl;
-        this->bvh = std::make_unique<BVH>(objects);//BVHAccel::SplitMethod::NAIVE
+        if (prebuilt && (prebuilt->order.size() != objects.size() || prebuilt->nodes.empty())) prebuilt = nullptr;
+        std::clog << (prebuilt ? "Loading BVH from the scene cache...\n\n" : "Generating BVH...\n\n") << std::endl;
+        auto t0 = std::chrono::steady_clock::now();
+        this->bvh = prebuilt ? std::make_unique<BVH>(objects, std::move(*prebuilt), opts)
+                             : std::make_unique<BVH>(objects, opts);
+        auto t1 = std::chrono::steady_clock::now();
+        std::string method = opts.method == SplitMethod::SAH  ? "SAH, " + std::to_string(opts.sah_bins) + " bins"
+                           : opts.method == SplitMethod::LBVH ? std::string(opts.treelets ? "LBVH + treelets" : "LBVH")
+                           : std::string("median");
+        std::clog << "BVH (" << method
+                  << ", leaves " << (opts.sah_leaves ? "auto <= " : "<= ") << opts.max_leaf_size
+                  << (opts.width > 2 ? ", BVH" + std::to_string(opts.width) : std::string())
+                  << "): SAH cost " << bvh->sah_cost() << ", built in "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+        bvh->stats().print(std::clog);
+        bvh->build_times().print(std::clog);
     }
     bounds3 getBounds() const override
     {
@@ -102,4 +196,12 @@ public:
             b = Union(b, objects[i]->getBounds());
         return b;
     }
+
+private:
+    // The brute-force path without a BVH: `objects` split into spheres, held as a SoA
+    // for the batched kernel, and everything else.
+    SphereSoA spheres;
+    std::vector<const rt::sphere*> sphere_prims;
+    std::vector<const hittable*> others;
+    std::uint32_t next_object_id = 1;   // hittable::object_id of the next add()
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+// imgdiff a.ppm|a.pfm b.ppm|b.pfm: per-channel error between two renders of the same size,
+// e.g. the float and double builds (SOFTRT_FLOAT) of one scene.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include "color.h"
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) { std::clog << "Usage: " << argv[0] << " a.ppm|a.pfm b.ppm|b.pfm\n"; return 1; }
+    Image a, b;
+    if (!Image::read(argv[1], a)) { std::clog << "cannot read " << argv[1] << "\n"; return 1; }
+    if (!Image::read(argv[2], b)) { std::clog << "cannot read " << argv[2] << "\n"; return 1; }
+    if (a.width() != b.width() || a.height() != b.height()) {
+        std::clog << "size differs: " << a.width() << 'x' << a.height() << " vs "
+                  << b.width() << 'x' << b.height() << "\n";
+        return 1;
+    }
+
+    double sq = 0.0, max_diff = 0.0;
+    std::size_t over = 0;   // pixels with a channel more than one 8-bit step apart
+    for (std::size_t i = 0; i < a.pixels().size(); ++i) {
+        double pixel_max = 0.0;
+        for (int c = 0; c < 3; ++c) {
+            const double d = std::fabs(double(a.pixels()[i][c]) - double(b.pixels()[i][c]));
+            sq += d * d;
+            pixel_max = std::max(pixel_max, d);
+        }
+        max_diff = std::max(max_diff, pixel_max);
+        if (pixel_max > 1.0 / 255.0 + 1e-9) ++over;
+    }
+    const double n    = 3.0 * double(a.pixels().size());
+    const double rmse = std::sqrt(sq / n);
+    std::printf("%dx%d  rmse %.3g  max %.3g  psnr %s  pixels > 1/255: %zu (%.3f%%)\n",
+                a.width(), a.height(), rmse, max_diff,
+                rmse > 0.0 ? (std::to_string(20.0 * std::log10(1.0 / rmse)) + " dB").c_str() : "inf",
+                over, 100.0 * double(over) / double(a.pixels().size()));
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "instance_bvh.h"
+#include "PacketBVH.h"
+#include "parallel.h"
+
+namespace rt {
+
+std::uint32_t instance_bvh::add_geometry(std::shared_ptr<hittable> blas)
+{
+    geometries.push_back(std::move(blas));
+    return static_cast<std::uint32_t>(geometries.size() - 1);
+}
+
+bool instance_bvh::add(std::uint32_t blas, const mat3& linear, const vec3& translation, std::uint32_t material)
+{
+    if (std::fabs(linear.determinant()) < 1e-12) return false;
+    instance in;
+    in.to_object   = linear.inverse();
+    in.to_object_t = -(in.to_object * translation);
+    in.blas        = blas;
+    in.material    = material;
+    in.index       = static_cast<std::uint32_t>(instances.size());
+    instances.push_back(in);
+
+    // 物体空间包围盒的 8 个角变换到世界空间再求并
+    const bounds3 ob = geometries[blas]->getBounds();
+    bounds3 wb;
+    for (int k = 0; k < 8; ++k) {
+        const point3 p((k & 1) ? ob.pMax.x() : ob.pMin.x(),
+                       (k & 2) ? ob.pMax.y() : ob.pMin.y(),
+                       (k & 4) ? ob.pMax.z() : ob.pMin.z());
+        wb = Union(wb, linear * p + translation);
+    }
+    world_bounds.push_back(wb);
+    return true;
+}
+
+void instance_bvh::build(const BVHBuildOptions& opts)
+{
+    const size_t n = instances.size();
+    nodes.clear();
+    if (n == 0) return;
+
+    std::vector<BVHPrimitiveInfo> info(n);
+    parallel_for(0, n, 4096, [&](size_t i) {
+        info[i].box      = world_bounds[i];
+        info[i].centroid = world_bounds[i].Centroid();
+        info[i].index    = static_cast<std::uint32_t>(i);
+    }, opts.threads);
+
+    LinearBVH lin = BVH::buildLinear(std::move(info), opts);
+    nodes  = std::move(lin.nodes);
+    depth  = lin.depth;
+    bounds = lin.bounds;
+
+    // 实例按叶子顺序重排，叶子的 offset 直接就是实例下标
+    std::vector<instance> sorted(n);
+    for (size_t i = 0; i < n; ++i) sorted[i] = instances[lin.order[i]];
+    instances.swap(sorted);
+    world_bounds.clear();
+    world_bounds.shrink_to_fit();
+}
+
+size_t instance_bvh::bytes(size_t blas_bytes) const
+{
+    return instances.size() * sizeof(instance) + nodes.size() * sizeof(LinearBVHNode)
+         + geometries.size() * blas_bytes;
+}
+
+bool instance_bvh::intersect(const ray& r, interval ray_t, hit_info& h) const
+{
+    if (nodes.empty()) return false;
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, interval& t) {
+        bool found = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            const instance& in = instances[i];
+            // intersect() only writes h on a hit inside t, which is always the closest so far
+            if (geometries[in.blas]->intersect(in.to_object_ray(r), t, h)) { found = true; t.max = h.t; h.inst = i; }
+        }
+        return found;
+    };
+    if (!traverseLinearBVH(nodes.data(), depth, r, ray_t, leaf)) return false;
+    h.prim = this;
+    return true;
+}
+
+std::uint32_t instance_bvh::intersect_packet(const RayPacket& packet, hit_info* hits) const
+{
+    if (nodes.empty() || !packet.active) return 0;
+    if (!packet.coherent()) return hittable::intersect_packet(packet, hits);
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, std::uint32_t mask, real* tmax) {
+        std::uint32_t hit = 0;
+        for (int k = 0; k < packet.size; ++k) {
+            if (!(mask >> k & 1)) continue;
+            const ray r = packet.get(k);
+            for (std::uint32_t i = first; i < first + count; ++i) {
+                const instance& in = instances[i];
+                if (geometries[in.blas]->intersect(in.to_object_ray(r), interval(packet.tmin[k], tmax[k]), hits[k])) {
+                    tmax[k] = hits[k].t;
+                    hits[k].inst = i;
+                    hit |= 1u << k;
+                }
+            }
+        }
+        return hit;
+    };
+    const std::uint32_t mask = traversePacketBVH(nodes.data(), depth, packet, leaf);
+    for (int k = 0; k < packet.size; ++k)
+        if (mask >> k & 1) hits[k].prim = this;
+    return mask;
+}
+
+void instance_bvh::surface(const ray& r, const hit_info& h, hit_record& rec) const
+{
+    const instance& in = instances[h.inst];
+    const hittable& geometry = *geometries[in.blas];
+    hit_info local = h;
+    local.prim = &geometry;
+    geometry.surface(in.to_object_ray(r), local, rec);
+    // 法线用逆矩阵的转置变回世界空间；front_face 在仿射变换下不变
+    rec.p      = r.at(h.t);
+    rec.normal = unit_vector(in.normal_to_world(rec.normal));
+    rec.ng     = unit_vector(in.normal_to_world(rec.ng));
+    rec.mat_id = in.material;
+}
+
+bool instance_bvh::occluded(const ray& r, interval ray_t) const
+{
+    if (nodes.empty()) return false;
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, interval& t) {
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            const instance& in = instances[i];
+            if (geometries[in.blas]->occluded(in.to_object_ray(r), t)) return true;
+        }
+        return false;
+    };
+    return traverseLinearBVH<true>(nodes.data(), depth, r, ray_t, leaf);
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "hittable.h"
+#include "BVH.h"
+#include "mat3.h"
+#include "vec3.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace rt {
+// One placement of a shared geometry. Only the world-to-object transform is kept: it
+// takes rays into object space, and its transpose takes object-space normals back out.
+struct instance {
+    mat3 to_object;           // linear part of world -> object
+    vec3 to_object_t;         // translation part
+    std::uint32_t blas = 0;   // index into instance_bvh's geometries
+    std::uint32_t material = 0;   // scene material index
+    std::uint32_t index = 0;      // order of add(), which the object IDs follow
+
+    // Direction is not renormalised, so hit distances are the same in both spaces.
+    ray to_object_ray(const ray& r) const {
+        return ray(to_object * r.origin() + to_object_t, to_object * r.direction());
+    }
+    vec3 normal_to_world(const vec3& n) const {
+        const mat3& m = to_object;
+        return vec3(m.m[0][0] * n.x() + m.m[1][0] * n.y() + m.m[2][0] * n.z(),
+                    m.m[0][1] * n.x() + m.m[1][1] * n.y() + m.m[2][1] * n.z(),
+                    m.m[0][2] * n.x() + m.m[1][2] * n.y() + m.m[2][2] * n.z());
+    }
+};
+
+// Two-level acceleration structure. Each geometry (BLAS) is defined once in object space
+// and should carry its own BVH (e.g. triangle_mesh); instances refer to it with a
+// transform and a material ID, and the top-level BVH built here goes over the instances'
+// world bounds. Rays are moved into object space when a leaf instance is tested.
+// A geometry must be a leaf primitive: its hits are reported with prim = this instance_bvh
+// and inst = the instance, and surface() hands them back to the geometry.
+class instance_bvh : public hittable {
+public:
+    // Returns the geometry's index for add(). Its own material is ignored.
+    std::uint32_t add_geometry(std::shared_ptr<hittable> blas);
+    // Places geometry `blas` with object -> world transform p' = linear * p + translation.
+    // Singular transforms are skipped (returns false).
+    bool add(std::uint32_t blas, const mat3& linear, const vec3& translation, std::uint32_t material);
+
+    // Builds the top-level BVH; call after the last add() and before tracing.
+    void build(const BVHBuildOptions& opts = {});
+
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override;
+    void surface(const ray& r, const hit_info& h, hit_record& rec) const override;
+    bool occluded(const ray& r, interval ray_t) const override;
+    // Packet traversal of the top level; each ray enters the geometry on its own.
+    std::uint32_t intersect_packet(const RayPacket& packet, hit_info* hits) const override;
+    bool traces_packets() const override { return true; }
+    bounds3 getBounds() const override { return bounds; }
+
+    size_t instance_count() const { return instances.size(); }
+    // One object ID per instance, in the order they were added.
+    std::uint32_t object_count() const override { return static_cast<std::uint32_t>(instances.size()); }
+    std::uint32_t object_of(std::uint32_t inst) const override { return object_id + instances[inst].index; }
+    // Instances + top-level nodes + one copy of each geometry's memory (`blas_bytes` each)
+    size_t bytes(size_t blas_bytes) const;
+
+private:
+    std::vector<std::shared_ptr<hittable>> geometries;
+    std::vector<instance> instances;   // top-level BVH leaf order after build()
+    std::vector<bounds3> world_bounds; // parallel to instances until build()
+    std::vector<LinearBVHNode> nodes;
+    int depth = 0;
+    bounds3 bounds;
+};
+}
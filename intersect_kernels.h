@@ -0,0 +1,86 @@
+#pragma once
+// Ray tests of the analytic primitives on plain values, shared by rt::sphere / rt::plane /
+// rt::cube and by the per-kind arrays of BVH leaves (PrimitiveSoA.h), so both paths
+// produce the same hits bit for bit.
+#include "interval.h"
+#include "mat3.h"
+#include "ray.h"
+#include "vec3.h"
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace rt {
+
+// Nearest root of |o + t d - c|² = R² inside ray_t.
+inline bool intersect_sphere(const point3& center, real radius, const ray& r, interval ray_t, real& t)
+{
+    const vec3  d = r.direction();
+    const vec3  m = r.origin() - center;
+    const real a = dot(d, d);                   // d·d
+    const real b = dot(m, d);                   // m·d
+    const real c = dot(m, m) - radius * radius; // m·m - R²
+
+    const real disc = b * b + (-a) * c;         // b² - a·c
+    if (disc < 0.0) return false;
+
+    const real s = std::sqrt(disc);
+
+    t = (-b - s) / a;
+    if (!ray_t.surrounds(t)) {
+        t = (-b + s) / a;
+        if (!ray_t.surrounds(t)) return false;
+    }
+    return true;
+}
+
+// Parallelogram p0 + u e1 + v e2, (u, v) in [0, 1]^2, with n = cross(e1, e2) and
+// w = n / |n|^2: distance t inside ray_t and the edge coordinates of the hit.
+// dot(n, d) is the Möller–Trumbore determinant; as there, only an exactly parallel ray is
+// rejected, since a fixed cut-off would depend on the quad's size and the scalar type.
+inline bool intersect_parallelogram(const point3& p0, const vec3& e1, const vec3& e2, const vec3& n, const vec3& w,
+                                    const ray& r, interval ray_t, real& t, real& u, real& v)
+{
+    const real denom = dot(n, r.direction());
+    if (denom == 0) return false;
+    t = dot(n, p0 - r.origin()) / denom;
+    if (!ray_t.surrounds(t)) return false;
+
+    const vec3 q = r.at(t) - p0;
+    u = dot(w, cross(q, e2));
+    if (u < 0.0 || u > 1.0) return false;
+    v = dot(w, cross(e1, q));
+    return v >= 0.0 && v <= 1.0;
+}
+
+// Cube of half-extent `half` centred at `center`, whose frame is given by to_local = R^T.
+// Slab test in that frame (no scaling, so t is unchanged). On a hit returns the entry
+// distance, or the exit distance when the ray starts inside, and the face as
+// 2 * axis + 1 for the +half face, + 0 for the -half one.
+inline bool intersect_box(const point3& center, const mat3& to_local, real half,
+                          const ray& r, interval ray_t, real& t, std::uint32_t& face)
+{
+    const vec3 o = to_local * (r.origin() - center);
+    const vec3 d = to_local * r.direction();
+    real t_near = -infinity, t_far = infinity;
+    int near_axis = 0, far_axis = 0;
+    for (int a = 0; a < 3; ++a) {
+        const real inv = real(1) / d[a];
+        real ta = (-half - o[a]) * inv;
+        real tb = ( half - o[a]) * inv;
+        if (ta > tb) std::swap(ta, tb);
+        if (ta > t_near) { t_near = ta; near_axis = a; }
+        if (tb < t_far)  { t_far  = tb; far_axis  = a; }
+    }
+    if (t_near > t_far) return false;
+    int axis;
+    bool exiting;
+    if (ray_t.surrounds(t_near))     { t = t_near; axis = near_axis; exiting = false; }
+    else if (ray_t.surrounds(t_far)) { t = t_far;  axis = far_axis;  exiting = true; }
+    else return false;
+    // entering the -half face when d > 0, exiting through +half
+    face = static_cast<std::uint32_t>(2 * axis + ((d[axis] > 0.0) == exiting ? 1 : 0));
+    return true;
+}
+
+}
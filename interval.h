@@ -1,29 +1,30 @@
 #pragma once
 #include <limits>
+#include "utility.h"
 
-const double infinity = std::numeric_limits<double>::infinity();
+const real infinity = std::numeric_limits<real>::infinity();
 
 class interval {
   public:
-    double min, max;
+    real min, max;
 
     interval() : min(+infinity), max(-infinity) {} // Default interval is empty
 
-    interval(double min, double max) : min(min), max(max) {}
+    interval(real min, real max) : min(min), max(max) {}
 
-    double size() const {
+    real size() const {
         return max - min;
     }
 
-    bool contains(double x) const {
+    bool contains(real x) const {
         return min <= x && x <= max;
     }
 
-    bool surrounds(double x) const {
+    bool surrounds(real x) const {
         return min < x && x < max;
     }
 
-    double clamp(double x) const {
+    real clamp(real x) const {
         if (x < min) return min;
         if (x > max) return max;
         return x;
@@ -12,7 +12,43 @@ struct PointLightRT {
         : pos(p), intensity( (power_w / (4.0 * pi)) * color(1,1,1) ) {}
 };
 
-static constexpr double EPS = 1e-4;
+// Direction, distance and visibility of one light from a shading point. Lights behind the
+// surface (n·l <= 0) contribute nothing to either term, so they are not shadow-tested.
+struct LightSample {
+    vec3   wi;
+    double dist;
+    double ndotl;
+    bool   visible;
+};
+
+inline LightSample sampleLight(const hit_record& rec, const hittable& world, const PointLightRT& L)
+{
+    LightSample s;
+    vec3 toL = L.pos - rec.p;
+    s.dist  = toL.length();
+    s.wi    = toL / s.dist;
+    s.ndotl = std::max(0.0, double(dot(rec.normal, s.wi)));
+    // 阴影检测：长度限制在 dist，遇到第一个遮挡物即返回
+    s.visible = s.ndotl > 0.0 && !world.occluded(rec.spawn(s.wi), interval(0, s.dist));
+    return s;
+}
+
+inline color BlinnPhongDiffuseTerm(const LightSample& s, const PointLightRT& L)
+{
+    color Li = L.intensity / (s.dist * s.dist);
+    return s.ndotl * Li;
+}
+
+inline color BlinnPhongSpecTerm(const LightSample& s, const PointLightRT& L, const hit_record& rec,
+                                const vec3& wo, const color& ks, double shininess)
+{
+    vec3  h = unit_vector(s.wi + wo);
+    double ndoth = std::max(0.0, double(dot(rec.normal, h)));
+    color Li = L.intensity / (s.dist * s.dist);
+
+    // 经典做法常乘 ndotl 抑制“雾感”（可留可去）
+    return ks * std::pow(ndoth, shininess) * Li;
+}
 
 inline color BlinnPhongDiffuse(
     const hit_record& rec,
@@ -20,21 +56,9 @@ inline color BlinnPhongDiffuse(
     const std::vector<PointLightRT>& lights
 ){
     color Lo(0,0,0);
-    const vec3 n = rec.normal;
-
     for (const auto& L : lights) {
-        vec3  toL  = L.pos - rec.p;
-        double dist = toL.length();
-        vec3  wi   = toL / dist;
-
-        // 阴影检测：长度限制在 dist
-        hit_record tmp;
-        ray shadow(rec.p + EPS * wi, wi);
-        if (!world.hit(shadow, interval(EPS, dist - EPS), tmp)) {
-            double ndotl = std::max(0.0, dot(n, wi));
-            color Li = L.intensity / (dist * dist);
-            Lo += ndotl * Li;                      
-        }
+        const LightSample s = sampleLight(rec, world, L);
+        if (s.visible) Lo += BlinnPhongDiffuseTerm(s, L);
     }
     return Lo;
 }
@@ -45,25 +69,25 @@ inline color BlinnPhongSpec(
     const color& ks, double shininess
 ){
     color Ls(0);
-    const vec3 n = rec.normal;
-
     for (const auto& L : lights) {
-        vec3 toL = L.pos - rec.p;
-        double dist = toL.length();
-        vec3 wi = toL / dist;
-
-        hit_record tmp;
-        if (!world.hit(ray(rec.p + EPS*wi, wi), interval(EPS, dist-EPS), tmp)) {
-            double ndotl = std::max(0.0, dot(n, wi));
-            if (ndotl <= 0.0) continue;
-
-            vec3  h = unit_vector(wi + wo);
-            double ndoth = std::max(0.0, dot(n, h));
-            color Li = L.intensity / (dist*dist);
-
-            // 经典做法常乘 ndotl 抑制“雾感”（可留可去）
-            Ls += ks * std::pow(ndoth, shininess) * Li;
-        }
+        const LightSample s = sampleLight(rec, world, L);
+        if (s.visible) Ls += BlinnPhongSpecTerm(s, L, rec, wo, ks, shininess);
     }
     return Ls;
 }
+
+// Diffuse and specular together: one shadow ray per light instead of one per term.
+inline void BlinnPhong(
+    const hit_record& rec, const hittable& world,
+    const std::vector<PointLightRT>& lights, const vec3& wo,
+    const color& ks, double shininess, color& Ld, color& Ls
+){
+    Ld = color(0,0,0);
+    Ls = color(0,0,0);
+    for (const auto& L : lights) {
+        const LightSample s = sampleLight(rec, world, L);
+        if (!s.visible) continue;
+        Ld += BlinnPhongDiffuseTerm(s, L);
+        Ls += BlinnPhongSpecTerm(s, L, rec, wo, ks, shininess);
+    }
+}
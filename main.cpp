@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include "JSONReader.h"
@@ -6,25 +11,263 @@
 #include "camera.h"
 #include "hittable_list.h"
 #include "material.h"
-int main() {
+#include "SceneCache.h"
+#include "simd.h"
+
+struct Options {
+    std::string scene = "D:/Edin/rendering/scene_export2/scene_export.json";
+    int  threads = 0;      // 0 = all hardware threads
+    int  tile    = 16;
+    int  spp     = -1;     // -1 = keep the camera default
+    double adaptive = 0.0; // relative error at which a pixel stops sampling, 0 = fixed spp
+    int  min_spp = -1;     // adaptive: samples before the first stopping test, -1 = camera default
+    std::string spp_map;   // adaptive: image of samples per pixel, "" = none
+    int  pass    = 0;      // progressive: samples per pixel per pass, 0 = one pass
+    std::string checkpoint;        // accumulation buffer saved between passes, "" = none
+    double checkpoint_every = 60.0;  // seconds between checkpoints
+    std::string sampler = "random";  // random | stratified | halton | sobol
+    std::string integrator = "normals";  // normals | path
+    bool denoise = false;          // edge-avoiding filter over the image before it is written
+    std::string aovs;              // layers: FILE.exr (one multi-layer file) or a prefix for side-by-side files
+    std::string bvh = "median";    // none | median | sah | lbvh
+    int  sah_bins = 16;
+    int  leaf_size = 1;            // 1..8 primitives per leaf
+    bool leaf_auto = false;        // let SAH pick leaf sizes up to leaf_size
+    bool treelets  = false;        // LBVH treelet restructuring
+    int  bvh_width = 2;            // 2, 4 or 8 children per traversal node
+    bool simd      = true;         // AVX2 kernels when the CPU has them
+    int  packet    = 16;           // primary rays per packet: 1, 4, 8 or 16
+    bool soa       = true;         // type-sorted primitive arrays in BVH leaves
+    std::string out = "image.ppm"; // .ppm (binary P6), .pfm (linear float) or .tga
+    std::string cache;             // binary scene cache, "" = <scene>.cache
+    bool use_cache = true;
+    bool instancing = true;        // cubes as instances of one shared mesh (two-level BVH)
+    bool scaling = false;  // render at 1, 2, 4 ... N threads and print Mrays/s
+};
+
+static void printUsage(const char* exe)
+{
+    std::clog << "Usage: " << exe << " [scene.json] [--threads N] [--tile N] [--spp N] [--scaling]\n"
+              << "       [--bvh none|median|sah|lbvh] [--sah-bins N] [--leaf-size N|auto] [--treelets]\n"
+              << "       [--bvh-width 2|4|8] [--no-simd] [--packet 1|4|8|16]\n"
+              << "       [-o image.ppm|.pfm|.tga] [--cache FILE | --no-cache]\n"
+              << "       [--no-instancing] [--no-soa]\n"
+              << "       [--adaptive ERR] [--min-spp N] [--spp-map FILE]\n"
+              << "       [--pass N] [--checkpoint FILE] [--checkpoint-every SECONDS]\n"
+              << "       [--sampler random|stratified|halton|sobol] [--integrator normals|path] [--denoise]\n"
+              << "       [--aovs FILE.exr|PREFIX]\n";
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&](int& dst) {
+            if (i + 1 >= argc) return false;
+            dst = std::atoi(argv[++i]);
+            return true;
+        };
+        if      (a == "--threads") { if (!next(opt.threads)) return false; }
+        else if (a == "--tile")    { if (!next(opt.tile))    return false; }
+        else if (a == "--spp")     { if (!next(opt.spp))     return false; }
+        else if (a == "--scaling") { opt.scaling = true; }
+        else if (a == "--adaptive") { if (i + 1 >= argc) return false; opt.adaptive = std::atof(argv[++i]); }
+        else if (a == "--min-spp")  { if (!next(opt.min_spp)) return false; }
+        else if (a == "--spp-map")  { if (i + 1 >= argc) return false; opt.spp_map = argv[++i]; }
+        else if (a == "--pass")     { if (!next(opt.pass)) return false; }
+        else if (a == "--sampler")  { if (i + 1 >= argc) return false; opt.sampler = argv[++i]; }
+        else if (a == "--integrator") { if (i + 1 >= argc) return false; opt.integrator = argv[++i]; }
+        else if (a == "--denoise")  { opt.denoise = true; }
+        else if (a == "--aovs")     { if (i + 1 >= argc) return false; opt.aovs = argv[++i]; }
+        else if (a == "--checkpoint") { if (i + 1 >= argc) return false; opt.checkpoint = argv[++i]; }
+        else if (a == "--checkpoint-every") { if (i + 1 >= argc) return false; opt.checkpoint_every = std::atof(argv[++i]); }
+        else if (a == "--bvh")      { if (i + 1 >= argc) return false; opt.bvh = argv[++i]; }
+        else if (a == "--sah-bins") { if (!next(opt.sah_bins)) return false; }
+        else if (a == "--treelets") { opt.treelets = true; }
+        else if (a == "--bvh-width") { if (!next(opt.bvh_width)) return false; }
+        else if (a == "--no-simd")  { opt.simd = false; }
+        else if (a == "--packet")   { if (!next(opt.packet)) return false; }
+        else if (a == "--leaf-size") {
+            if (i + 1 >= argc) return false;
+            std::string v = argv[++i];
+            if (v == "auto") { opt.leaf_auto = true; opt.leaf_size = kBVHMaxLeafSize; }
+            else opt.leaf_size = std::atoi(v.c_str());
+        }
+        else if (a == "--cache")    { if (i + 1 >= argc) return false; opt.cache = argv[++i]; }
+        else if (a == "--no-cache") { opt.use_cache = false; }
+        else if (a == "--no-instancing") { opt.instancing = false; }
+        else if (a == "--no-soa")   { opt.soa = false; }
+        else if (a == "-o" || a == "--out") { if (i + 1 >= argc) return false; opt.out = argv[++i]; }
+        else if (a == "-h" || a == "--help") return false;
+        else if (!a.empty() && a[0] != '-') opt.scene = a;
+        else return false;
+    }
+    return true;
+}
+
+// Renders the same frame at 1, 2, 4 ... N threads, checks the images are bit-identical
+// and prints throughput per thread count. Returns the last image.
+static Image scalingReport(rt::camera& cam, const hittable_list& objects, int max_threads)
+{
+    std::vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+
+    Image reference, img;
+    std::vector<rt::camera::render_stats> runs;
+    for (int t : counts) {
+        cam.num_threads = t;
+        rt::camera::render_stats st;
+        img = cam.render(objects, objects.pointLights, &st);
+        if (runs.empty()) reference = img;
+        runs.push_back(st);
+        const auto& a = img.pixels();
+        const auto& b = reference.pixels();
+        bool same = a.size() == b.size() &&
+                    std::memcmp(a.data(), b.data(), a.size() * sizeof(color)) == 0;
+        if (!same) std::clog << "WARNING: image at " << t << " threads differs from the 1-thread image\n";
+    }
+
+    std::clog << "\nScaling report (" << runs.front().rays << " rays per frame)\n";
+    std::clog << " threads      ms    Mrays/s  speedup\n";
+    for (const auto& st : runs) {
+        std::clog << std::setw(8) << st.threads
+                  << std::setw(8) << static_cast<long long>(st.seconds * 1000.0)
+                  << std::setw(11) << std::fixed << std::setprecision(2) << st.mrays_per_sec()
+                  << std::setw(8) << std::setprecision(2) << runs.front().seconds / st.seconds << "x\n";
+    }
+    return img;
+}
+
+int main(int argc, char** argv) {
     using clock = std::chrono::steady_clock;
-    JSONReader reader{};
-    bd::Scene scene = reader.loadFromFile("D:/Edin/rendering/scene_export2/scene_export.json");
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) { printUsage(argv[0]); return 1; }
+    if (opt.bvh_width != 2 && opt.bvh_width != 4 && opt.bvh_width != 8) { printUsage(argv[0]); return 1; }
+    const SampleMethod sample_method = opt.sampler == "stratified" ? SampleMethod::Stratified
+                                     : opt.sampler == "halton"     ? SampleMethod::Halton
+                                     : opt.sampler == "sobol"      ? SampleMethod::Sobol : SampleMethod::Random;
+    if (sample_method == SampleMethod::Random && opt.sampler != "random") { printUsage(argv[0]); return 1; }
+    if (opt.integrator != "normals" && opt.integrator != "path") { printUsage(argv[0]); return 1; }
+    setSimdEnabled(opt.simd);
+    std::clog << "SIMD: " << (simdEnabled() ? "AVX2" : cpuHasAVX2() ? "off (--no-simd)" : "scalar (no AVX2)") << "\n";
+
+    // Startup: the binary scene cache if it matches the JSON, its files and the BVH
+    // options, otherwise the JSON path (and the cache is rewritten after the frame).
+    const bool use_bvh = opt.bvh == "median" || opt.bvh == "sah" || opt.bvh == "lbvh";
+    if (!use_bvh && opt.bvh != "none") { printUsage(argv[0]); return 1; }
+    if (opt.leaf_auto && opt.bvh != "sah" && opt.bvh != "lbvh") {
+        // only the SAH and LBVH builders weigh a leaf against a split
+        std::clog << "--leaf-size auto needs --bvh sah or lbvh\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    BVHBuildOptions bo;
+    bo.method   = opt.bvh == "sah"  ? SplitMethod::SAH
+                : opt.bvh == "lbvh" ? SplitMethod::LBVH : SplitMethod::MEDIAN;
+    bo.sah_bins = opt.sah_bins;
+    bo.max_leaf_size = opt.leaf_size;
+    bo.sah_leaves    = opt.leaf_auto;
+    bo.treelets      = opt.treelets;
+    bo.threads       = opt.threads;
+    bo.width         = opt.bvh_width;
+    bo.soa_leaves    = opt.soa;
+    const std::string cache_path = opt.cache.empty() ? opt.scene + ".cache" : opt.cache;
+
+    auto t_start = clock::now();
+    SceneCacheData cached;
+    SceneCacheStats cs;
+    const bool cache_hit = opt.use_cache && loadSceneCache(cache_path, opt.scene, use_bvh ? &bo : nullptr,
+                                                        opt.instancing, cached, &cs);
+    bd::Scene scene;
     hittable_list objects;
-    objects.loadScene(scene);
+    objects.instance_cubes = opt.instancing;
+    if (cache_hit) {
+        scene = std::move(cached.scene);
+        objects.loadScene(scene, &cached.meshes);
+    } else {
+        JSONReader reader{};
+        scene = reader.loadFromFile(opt.scene);
+        objects.loadScene(scene);
+    }
     //std::clog << "position of light 1: " << (*objects.pointLights[0]).pos << std::endl;
     rt::camera mainCamera(scene.cameras[0]);
+    mainCamera.num_threads = opt.threads;
+    mainCamera.tile_size   = opt.tile;
+    mainCamera.packet_size = opt.packet;
+    mainCamera.materials   = &objects.materials;
+    if (opt.spp > 0) mainCamera.samples_per_pixel = opt.spp;
+    mainCamera.adaptive_error = opt.adaptive;
+    if (opt.min_spp > 0) mainCamera.min_samples = opt.min_spp;
+    Image spp_map;
+    if (!opt.spp_map.empty()) mainCamera.sample_counts = &spp_map;
+    mainCamera.pass_samples = opt.pass;
+    mainCamera.sample_method = sample_method;
+    mainCamera.integrator = opt.integrator == "path" ? rt::Integrator::Path : rt::Integrator::Normals;
+    RenderLayers layers;
+    if (opt.denoise || !opt.aovs.empty()) mainCamera.layers = &layers;
+    if (!opt.checkpoint.empty() && !opt.scaling) {
+        // checkpoints only help when the frame is split into passes
+        if (mainCamera.pass_samples <= 0) mainCamera.pass_samples = std::max(1, mainCamera.samples_per_pixel / 16);
+        mainCamera.checkpoint_path     = opt.checkpoint;
+        mainCamera.checkpoint_interval = opt.checkpoint_every;
+        mainCamera.checkpoint_key      = sceneContentHash(opt.scene, scene);
+    }
 
     auto t0 = clock::now();
-    //objects.buildBVH();
-    mainCamera.render(objects, objects.pointLights);
+    if (use_bvh) objects.buildBVH(bo, cache_hit && cached.has_bvh ? &cached.bvh : nullptr);
+    auto t_first = clock::now();
+    std::clog << "Time to first ray: " << std::fixed << std::setprecision(2)
+              << std::chrono::duration<double, std::milli>(t_first - t_start).count() << " ms (scene cache "
+              << (!opt.use_cache ? std::string("off") : cache_hit
+                  ? "hit, " + std::to_string(cs.bytes >> 10) + " KiB, hashed in " + std::to_string(cs.hash_ms) + " ms"
+                  : "miss: " + cs.reason) << ")\n";
+    Image image = opt.scaling
+        ? scalingReport(mainCamera, objects, resolve_thread_count(opt.threads))
+        : mainCamera.render(objects, objects.pointLights);
     auto t1 = clock::now();
+    if (opt.denoise && !opt.scaling) {
+        DenoiseOptions dopt;
+        dopt.threads = opt.threads;
+        DenoiseStats ds;
+        image = denoise(image, layers, dopt, &ds);
+        std::clog << "Denoised in " << std::fixed << std::setprecision(2) << ds.setup_ms + ds.ms << " ms ("
+                  << ds.setup_ms << " ms setup)\n";
+    }
+
+    ImageWriteStats ws = image.write(opt.out);
+    if (!ws.ok) std::clog << "ERROR: could not write " << opt.out << "\n";
+    else if (!opt.checkpoint.empty() && !opt.scaling) std::remove(opt.checkpoint.c_str());   // the frame is done
+    std::clog << "Wrote " << opt.out << " (" << ws.bytes << " bytes) - encode: "
+              << std::fixed << std::setprecision(2) << ws.encode_ms << " ms, write: "
+              << ws.write_ms << " ms\n";
+
+    if (!opt.aovs.empty() && !opt.scaling) {
+        // beauty plus every layer of the same pass
+        const bool exr = opt.aovs.size() > 4 && opt.aovs.compare(opt.aovs.size() - 4, 4, ".exr") == 0;
+        const bool ok  = exr ? writeLayersEXR(opt.aovs, image, layers).ok : writeLayerFiles(opt.aovs, layers);
+        if (!ok) std::clog << "ERROR: could not write layers to " << opt.aovs << "\n";
+        else std::clog << "Wrote layers to " << opt.aovs << (exr ? "\n" : ".*\n");
+    }
+
+    if (!opt.spp_map.empty()) {
+        if (!spp_map.write(opt.spp_map).ok) std::clog << "ERROR: could not write " << opt.spp_map << "\n";
+        else std::clog << "Wrote samples per pixel to " << opt.spp_map << "\n";
+    }
 
     auto ms  = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
     auto us  = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
     auto ns  = std::chrono::duration_cast<std::chrono::nanoseconds >(t1 - t0).count();
-    std::clog << "With BVH - ";
+    std::clog << (objects.bvh ? "With BVH - " : "Without BVH - ");
     std::clog << "Elapsed: " << ms << " ms (" << us << " us, " << ns << " ns)\n";
+
+    if (opt.use_cache && !cache_hit) {
+        auto ts = clock::now();
+        if (saveSceneCache(cache_path, opt.scene, scene, objects, use_bvh ? &bo : nullptr))
+            std::clog << "Wrote scene cache " << cache_path << " in "
+                      << std::chrono::duration<double, std::milli>(clock::now() - ts).count() << " ms\n";
+        else
+            std::clog << "WARNING: could not write scene cache " << cache_path << "\n";
+    }
     return 0;
 }
-
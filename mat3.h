@@ -4,13 +4,13 @@
 class mat3 
 {
 public:
-    double m[3][3];
+    real m[3][3];
 
     // Constructors
     mat3() : m{{0,0,0},{0,0,0},{0,0,0}} {}
-    mat3(double m00, double m01, double m02,
-         double m10, double m11, double m12,
-         double m20, double m21, double m22)
+    mat3(real m00, real m01, real m02,
+         real m10, real m11, real m12,
+         real m20, real m21, real m22)
         : m{{m00,m01,m02},{m10,m11,m12},{m20,m21,m22}} {}
     
     static mat3 identity() {
@@ -18,8 +18,8 @@ public:
     }
 
     // Access
-    const double* operator[](int i) const { return m[i]; }
-    double*       operator[](int i) { return m[i]; }
+    const real* operator[](int i) const { return m[i]; }
+    real*       operator[](int i) { return m[i]; }
 
     mat3 operator+(const mat3& n) const {
         return mat3(
@@ -37,7 +37,7 @@ public:
         );
     }
 
-    mat3 operator*(double t) const {
+    mat3 operator*(real t) const {
         return mat3(
             m[0][0]*t, m[0][1]*t, m[0][2]*t,
             m[1][0]*t, m[1][1]*t, m[1][2]*t,
@@ -45,8 +45,8 @@ public:
         );
     }
 
-    mat3 operator/(double t) const {
-        return *this * (1.0/t);
+    mat3 operator/(real t) const {
+        return *this * (real(1)/t);
     }
 
     // Matrix-vector multiplication
@@ -76,7 +76,7 @@ public:
     }
 
     // Determinant
-    double determinant() const {
+    real determinant() const {
         return
             m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) -
             m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) +
@@ -85,11 +85,11 @@ public:
 
     // Inverse
     mat3 inverse() const {
-        double det = determinant();
+        real det = determinant();
         if (std::fabs(det) < 1e-12)
             return mat3(); // return zero matrix if singular
 
-        double invDet = 1.0 / det;
+        real invDet = real(1) / det;
         mat3 inv;
         inv.m[0][0] =  (m[1][1]*m[2][2] - m[1][2]*m[2][1]) * invDet;
         inv.m[0][1] = -(m[0][1]*m[2][2] - m[0][2]*m[2][1]) * invDet;
@@ -112,15 +112,15 @@ public:
     }
 };
 
-inline mat3 operator*(double t, const mat3& m) { return m * t; }
+inline mat3 operator*(real t, const mat3& m) { return m * t; }
 inline mat3 eulerXYZ_to_mat3(const vec3& euler_xyz_rad)
 {
-    double cx = std::cos(euler_xyz_rad.x());
-    double sx = std::sin(euler_xyz_rad.x());
-    double cy = std::cos(euler_xyz_rad.y());
-    double sy = std::sin(euler_xyz_rad.y());
-    double cz = std::cos(euler_xyz_rad.z());
-    double sz = std::sin(euler_xyz_rad.z());
+    real cx = std::cos(euler_xyz_rad.x());
+    real sx = std::sin(euler_xyz_rad.x());
+    real cy = std::cos(euler_xyz_rad.y());
+    real sy = std::sin(euler_xyz_rad.y());
+    real cz = std::cos(euler_xyz_rad.z());
+    real sz = std::sin(euler_xyz_rad.z());
 
     mat3 R;
     R.m[0][0] = cz*cy;              R.m[1][0] = sz*cy;              R.m[2][0] = -sy;
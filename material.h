@@ -2,31 +2,37 @@
 #include "hittable.h"
 #include "color.h"
 #include "texture.h"
+#include <memory>
+#include <vector>
 class material {
   public:
     virtual ~material() = default;
 
     virtual bool scatter(
-        const ray& /*r_in*/, const hit_record& /*rec*/, color& /*attenuation*/, ray& /*scattered*/
+        const ray& /*r_in*/, const hit_record& /*rec*/, color& /*attenuation*/, ray& /*scattered*/,
+        Sampler& /*sampler*/
     ) const {
         return false;
     }
+    // Reflectance at the hit for the albedo layer; white for materials that do not tint.
+    virtual color get_albedo(const hit_record& /*rec*/) const { return color(1, 1, 1); }
 };
 
 class lambertian : public material {
 public:
     lambertian(const color& albedo) : albedo(albedo) {}
     lambertian(std::shared_ptr<Texture> tex) : tex(tex) {}
-    const color& get_albedo(const hit_record& rec) const { 
+    color get_albedo(const hit_record& rec) const override { 
         if (tex) return tex->sample(rec.uv);
         return albedo; 
     }
-    bool scatter(const ray& , const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& , const hit_record& rec, color& attenuation, ray& scattered,
+                 Sampler& sampler)
     const override {
-        auto scatter_direction = rec.normal + random_unit_vector();
+        auto scatter_direction = rec.normal + random_unit_vector(sampler);
         if (scatter_direction.near_zero()) scatter_direction = rec.normal;
-        scattered = ray(rec.p, scatter_direction);
-        attenuation = albedo;
+        scattered = rec.spawn(scatter_direction);
+        attenuation = get_albedo(rec);
         return true;
     }
 
@@ -40,10 +46,12 @@ class metal : public material {
 public:
     metal(const color& albedo) : albedo(albedo) {}
     const color& get_albedo() const { return albedo; }
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    color get_albedo(const hit_record&) const override { return albedo; }
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered,
+                 Sampler&)
     const override {
         vec3 reflected = reflect(r_in.direction(), rec.normal);
-        scattered = ray(rec.p, reflected);
+        scattered = rec.spawn(reflected);
         attenuation = albedo;
         return true;
     }
@@ -56,7 +64,8 @@ class dielectric : public material {
   public:
     dielectric(double refraction_index) : refraction_index(refraction_index) {}
     double get_ior() const { return refraction_index; }
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered,
+                 Sampler& sampler)
     const override {
         attenuation = color(1.0, 1.0, 1.0);
         double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
@@ -68,12 +77,12 @@ class dielectric : public material {
         bool cannot_refract = ri * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > sampler.get1D())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, ri);
 
-        scattered = ray(rec.p, direction);
+        scattered = rec.spawn(direction);
         return true;
     }
 
@@ -88,10 +97,9 @@ public:
     explicit idealDielectric(double ior) : ior_(ior) {}
 
     bool scatter(const ray& r_in, const hit_record& rec,
-                 color& attenuation, ray& scattered) const override
+                 color& attenuation, ray& scattered, Sampler& sampler) const override
     {
         attenuation = color(1.0, 1.0, 1.0);   // 经典教材玻璃：无吸收
-        const double eps = 1e-4;
 
         // 规范化入射方向，并让法线朝“入射光的反向”
         vec3 n  = rec.front_face ? rec.normal : -rec.normal;
@@ -103,7 +111,7 @@ public:
         double eta  = etai / etat;
 
         // 计算入射角余弦 & 全反射判定
-        double cosTheta   = std::min(dot(-in, n), 1.0);
+        double cosTheta   = std::min(double(dot(-in, n)), 1.0);
         double sinTheta2  = std::max(0.0, 1.0 - cosTheta * cosTheta);
         bool   cannot_refract = (eta * eta * sinTheta2) > 1.0;   // eta*sinθ > 1
 
@@ -111,15 +119,11 @@ public:
         double Fr = reflectance(cosTheta, ior_);
         if (cannot_refract) Fr = 1.0;
 
-        // 按 Fresnel 概率选择反射/折射方向，并做起点偏移避免自相交
-        if (cannot_refract || random_double() < Fr) {
-            vec3 dir    = reflect(in, n);
-            vec3 origin = rec.p + n * eps;     // 反射：向法线方向偏移
-            scattered   = ray(origin, dir);
+        // 按 Fresnel 概率选择反射/折射方向；spawn 把起点偏移到出射方向一侧，避免自相交
+        if (cannot_refract || sampler.get1D() < Fr) {
+            scattered = rec.spawn(reflect(in, n));
         } else {
-            vec3 dir    = refract(in, n, eta); // 你的 refract 已经做了 clamp
-            vec3 origin = rec.p - n * eps;     // 折射：向内侧偏移
-            scattered   = ray(origin, dir);
+            scattered = rec.spawn(refract(in, n, eta)); // 你的 refract 已经做了 clamp
         }
         return true;
     }
@@ -128,4 +132,7 @@ public:
 
 private:
     double ior_; // 1.5 for glass
-};
\ No newline at end of file
+};
+
+// Scene-owned materials; hit_record::mat_id is an index into one of these.
+using material_table = std::vector<std::shared_ptr<material>>;
@@ -28,4 +28,11 @@
         point2 uv(const int iface, const int nthvert) const;
         const TGAImage& diffuse() const;
         const TGAImage& specular() const;
+        // Raw buffers; face arrays hold 3 zero-based indices per triangle
+        const std::vector<point3>& vertices() const { return verts; }
+        const std::vector<vec3>& normals() const { return norms; }
+        const std::vector<point2>& texcoords() const { return tex; }
+        const std::vector<int>& faceVertices() const { return facetVerts; }
+        const std::vector<int>& faceNormals() const { return faceNorms; }
+        const std::vector<int>& faceTexcoords() const { return faceTexs; }
     };
@@ -0,0 +1,66 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "interval.h"
+#include "ray.h"
+
+constexpr int kMaxPacketSize = 16;
+
+// Number of rays set in a lane mask.
+inline int laneCount(std::uint32_t mask)
+{
+    int n = 0;
+    for (; mask; mask &= mask - 1) ++n;
+    return n;
+}
+
+// Up to 16 rays in SoA layout (one array per component and axis) that share one BVH
+// traversal. Bit k of `active` says whether ray k takes part. Lanes past `size` are zero,
+// so code that copies or loads whole arrays (the AVX2 box test reads 4 at a time, 8 in
+// float) never touches indeterminate values.
+struct alignas(32) RayPacket {
+    real o[3][kMaxPacketSize] = {};
+    real d[3][kMaxPacketSize] = {};
+    real inv[3][kMaxPacketSize] = {};   // 1 / d
+    real tmin[kMaxPacketSize] = {};
+    real tmax[kMaxPacketSize] = {};
+    std::uint32_t active = 0;
+    int size = 0;
+
+    // Appends a ray and returns its lane, or -1 if the packet is full.
+    int add(const ray& r, const interval& t) {
+        if (size == kMaxPacketSize) return -1;
+        const int k = size++;
+        for (int a = 0; a < 3; ++a) {
+            o[a][k]   = r.origin()[a];
+            d[a][k]   = r.direction()[a];
+            inv[a][k] = real(1) / d[a][k];
+        }
+        tmin[k] = t.min;
+        tmax[k] = t.max;
+        active |= 1u << k;
+        return k;
+    }
+
+    ray get(int k) const {
+        return ray(point3(o[0][k], o[1][k], o[2][k]), vec3(d[0][k], d[1][k], d[2][k]));
+    }
+
+    // True when, on every axis, all active rays point the same way with a finite inverse
+    // direction. Only then do the rays agree on near/far planes and child order, and
+    // interval arithmetic over the packet gives useful bounds.
+    bool coherent() const {
+        if (!active) return false;
+        for (int a = 0; a < 3; ++a) {
+            int neg = -1;
+            for (int k = 0; k < size; ++k) {
+                if (!(active >> k & 1)) continue;
+                if (!std::isfinite(inv[a][k])) return false;
+                const int s = std::signbit(inv[a][k]) ? 1 : 0;
+                if (neg < 0) neg = s;
+                else if (neg != s) return false;
+            }
+        }
+        return true;
+    }
+};
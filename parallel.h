@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of workers to use when the caller passes 0 ("as many as the machine has").
+inline int resolve_thread_count(int requested)
+{
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? static_cast<int>(hw) : 1;
+}
+
+// Runs a fixed set of tasks [0, n) on a pool of threads.
+// Every worker owns a deque that is seeded with a contiguous block of tasks (keeps
+// neighbouring tiles on one core); the owner pops from the front, idle workers steal
+// from the back of someone else's deque. Tasks whose cost varies a lot (glass vs sky
+// tiles) therefore balance themselves without any static partitioning.
+class WorkStealingScheduler
+{
+public:
+    using Task = std::function<void(std::size_t task, int worker)>;
+
+    static void run(int num_threads, std::size_t num_tasks, const Task& fn)
+    {
+        if (num_tasks == 0) return;
+        const int workers = std::max(1, std::min<int>(resolve_thread_count(num_threads),
+                                                      static_cast<int>(num_tasks)));
+        if (workers == 1) {
+            for (std::size_t t = 0; t < num_tasks; ++t) fn(t, 0);
+            return;
+        }
+
+        std::vector<Queue> queues(static_cast<std::size_t>(workers));
+        for (int w = 0; w < workers; ++w) {
+            std::size_t begin = num_tasks *  w      / workers;
+            std::size_t end   = num_tasks * (w + 1) / workers;
+            for (std::size_t t = begin; t < end; ++t) queues[w].tasks.push_back(t);
+        }
+
+        auto worker_main = [&](int self) {
+            std::size_t task;
+            while (pop_or_steal(queues, self, task)) fn(task, self);
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(static_cast<std::size_t>(workers - 1));
+        for (int w = 1; w < workers; ++w) threads.emplace_back(worker_main, w);
+        worker_main(0);
+        for (auto& t : threads) t.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::size_t> tasks;
+    };
+
+    static bool pop_or_steal(std::vector<Queue>& queues, int self, std::size_t& task)
+    {
+        {
+            Queue& own = queues[static_cast<std::size_t>(self)];
+            std::lock_guard<std::mutex> lock(own.m);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        // Own deque is dry: walk the other workers and take from the far end.
+        const int n = static_cast<int>(queues.size());
+        for (int k = 1; k < n; ++k) {
+            Queue& victim = queues[static_cast<std::size_t>((self + k) % n)];
+            std::lock_guard<std::mutex> lock(victim.m);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        // No task is ever added after start, so every deque being empty means we are done.
+        return false;
+    }
+};
+
+// Splits [begin, end) into chunks of `grain` and runs fn(i) for every index.
+template <typename Fn>
+inline void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, Fn&& fn,
+                         int num_threads = 0)
+{
+    if (end <= begin) return;
+    grain = std::max<std::size_t>(1, grain);
+    const std::size_t chunks = (end - begin + grain - 1) / grain;
+    WorkStealingScheduler::run(num_threads, chunks, [&](std::size_t c, int) {
+        const std::size_t lo = begin + c * grain;
+        const std::size_t hi = std::min(end, lo + grain);
+        for (std::size_t i = lo; i < hi; ++i) fn(i);
+    });
+}
@@ -1,28 +1,49 @@
 #pragma once
 #include "hittable.h"
+#include "intersect_kernels.h"
 #include "vec3.h"
+class PrimitiveSoA;
 namespace rt {
+// A quad (v0, v1, v2, v3). When the corners form a parallelogram (v2 = v1 + v3 - v0, the
+// case for everything the exporter writes) it is intersected in one step: ray against
+// the supporting plane, then the hit point's coordinates along the two edges, which are
+// also its UVs. Other quads fall back to two Möller–Trumbore triangles.
 class plane : public hittable {
 private:
     point3 v0, v1, v2, v3;
-    std::shared_ptr<material> mat;
+    vec3 e1, e2;           // v1 - v0, v3 - v0
+    vec3 n;                // cross(e1, e2), not normalised
+    vec3 w;                // n / |n|^2: dot(w, cross(q, e2)) is q's coordinate along e1
+    vec3 unit_n;
+    bool parallelogram;
+    std::uint32_t mat_id;
+    friend class ::PrimitiveSoA;
 
 public:
-    plane(point3 a, point3 b, point3 c, point3 d, std::shared_ptr<material> mat) : v0(a), v1(b), v2(c), v3(d), mat(mat) {}
+    plane(point3 a, point3 b, point3 c, point3 d, std::uint32_t mat_id)
+        : v0(a), v1(b), v2(c), v3(d), e1(b - a), e2(d - a), mat_id(mat_id)
+    {
+        n = cross(e1, e2);
+        const real nn = n.length_squared();
+        const real scale = e1.length() + e2.length();
+        parallelogram = nn > 0.0 && (a + c - b - d).length() <= 1e-6 * scale;
+        w = parallelogram ? n / nn : vec3();
+        unit_n = parallelogram ? n / std::sqrt(nn) : vec3();
+    }
     const point3& a() const { return v0; }
     const point3& b() const { return v1; }
     const point3& c() const { return v2; }
     const point3& d() const { return v3; }
     bounds3 getBounds() const override
     {
-        double min_x = std::min(std::min(v0.x(), v1.x()), std::min(v2.x(), v3.x()));
-        double min_y = std::min(std::min(v0.y(), v1.y()), std::min(v2.y(), v3.y()));
-        double min_z = std::min(std::min(v0.z(), v1.z()), std::min(v2.z(), v3.z()));
-        double max_x = std::max(std::max(v0.x(), v1.x()), std::max(v2.x(), v3.x()));
-        double max_y = std::max(std::max(v0.y(), v1.y()), std::max(v2.y(), v3.y()));
-        double max_z = std::max(std::max(v0.z(), v1.z()), std::max(v2.z(), v3.z()));
+        real min_x = std::min(std::min(v0.x(), v1.x()), std::min(v2.x(), v3.x()));
+        real min_y = std::min(std::min(v0.y(), v1.y()), std::min(v2.y(), v3.y()));
+        real min_z = std::min(std::min(v0.z(), v1.z()), std::min(v2.z(), v3.z()));
+        real max_x = std::max(std::max(v0.x(), v1.x()), std::max(v2.x(), v3.x()));
+        real max_y = std::max(std::max(v0.y(), v1.y()), std::max(v2.y(), v3.y()));
+        real max_z = std::max(std::max(v0.z(), v1.z()), std::max(v2.z(), v3.z()));
 
-        const double eps = 1e-6;
+        const real eps = 1e-6;
         if (max_x - min_x < eps) { min_x -= eps; max_x += eps; }
         if (max_y - min_y < eps) { min_y -= eps; max_y += eps; }
         if (max_z - min_z < eps) { min_z -= eps; max_z += eps; }
@@ -30,51 +51,76 @@ public:
         return bounds3(point3{min_x, min_y, min_z}, point3{max_x, max_y, max_z});
     }
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    // h.id: 0 for the parallelogram test (u, v are then the edge coordinates), 1 / 2 for
+    // triangle (v0, v1, v2) / (v0, v2, v3) of the two-triangle path.
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override
     {
-        hit_record rec0, rec1;
-        bool h0 = hit_tri(v0, v1, v2, r, ray_t, rec0);
-        bool h1 = hit_tri(v0, v2, v3, r, ray_t, rec1);
-
-        if (!h0 && !h1) return false;
-        rec0.mat = mat, rec1.mat = mat;
-        // pick closer valid hit
-        if (h0 && (!h1 || rec0.t < rec1.t)) 
-        { rec = rec0; return true; }
-        rec = rec1; 
+        if (parallelogram) {
+            real t, u, v;
+            if (!intersect_parallelogram(v0, e1, e2, n, w, r, ray_t, t, u, v)) return false;
+            h.t = t; h.u = u; h.v = v; h.id = 0;
+        } else {
+            real t0, t1;
+            bool h0 = intersect_tri(v0, v1, v2, r, ray_t, t0);
+            bool h1 = intersect_tri(v0, v2, v3, r, ray_t, t1);
+            if (!h0 && !h1) return false;
+            // pick closer valid hit
+            if (h0 && (!h1 || t0 < t1)) { h.t = t0; h.id = 1; }
+            else                        { h.t = t1; h.id = 2; }
+        }
+        h.prim = this;
         return true;
     }
 
-    //MollerTrumbore
-    bool hit_tri(const point3& a, const point3& b, const point3& c, const ray& r, interval ray_t, hit_record& rec) const
+    void surface(const ray& r, const hit_info& h, hit_record& rec) const override
+    {
+        rec.mat_id = mat_id;
+        if (h.id == 0) {
+            rec.p = r.at(h.t);
+            rec.uv = point2(float(h.u), float(h.v));
+            rec.set_face_normal(r, unit_n);
+        }
+        else if (h.id == 1) fill(v0, v1, v2, r, h.t, rec);
+        else                fill(v0, v2, v3, r, h.t, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override
+    {
+        real t, u, v;
+        if (parallelogram) return intersect_parallelogram(v0, e1, e2, n, w, r, ray_t, t, u, v);
+        return intersect_tri(v0, v1, v2, r, ray_t, t) || intersect_tri(v0, v2, v3, r, ray_t, t);
+    }
+
+    // Shading data for a hit at distance t on triangle (a, b, c).
+    static void fill(const point3& a, const point3& b, const point3& c, const ray& r, real t, hit_record& rec)
+    {
+        rec.p = r.at(t);
+        vec3 n = cross(b - a, c - a);
+        rec.set_face_normal(r, unit_vector(n));
+        //rec.u = u; rec.v = v;
+    }
+
+    //MollerTrumbore: distance to triangle (a, b, c) if it lies inside ray_t
+    static bool intersect_tri(const point3& a, const point3& b, const point3& c, const ray& r, interval ray_t, real& t)
     {
-        const double EPS = 1e-9;
         vec3 e1 = b - a;
         vec3 e2 = c - a;
         vec3 p  = cross(r.direction(), e2);
-        double det = dot(e1, p);
+        real det = dot(e1, p);
 
-        if (std::fabs(det) < EPS) return false; // nearly parallel
-        double invDet = 1.0 / det;
+        if (det == 0) return false; // parallel; grazing rays miss on u, v
+        real invDet = real(1) / det;
 
         vec3 tvec = r.origin() - a;
-        double u = dot(tvec, p) * invDet;
+        real u = dot(tvec, p) * invDet;
         if (u < 0.0 || u > 1.0) return false;
 
         vec3 q = cross(tvec, e1);
-        double v = dot(r.direction(), q) * invDet;
+        real v = dot(r.direction(), q) * invDet;
         if (v < 0.0 || u + v > 1.0) return false;
 
-        double t = dot(e2, q) * invDet;
-        if (!ray_t.surrounds(t)) return false;
-
-        rec.t = t;
-        rec.p = r.at(t);
-        vec3 n = cross(e1, e2);
-        rec.set_face_normal(r, unit_vector(n));
-        //rec.u = u; rec.v = v;
-        //rec.mat = material;
-        return true;
+        t = dot(e2, q) * invDet;
+        return ray_t.surrounds(t);
     }
 };
-}
\ No newline at end of file
+}
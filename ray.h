@@ -1,17 +1,49 @@
 #pragma once
 #include "vec3.h"
+#include <cmath>
+#include <limits>
 class ray {
 public:
     ray(){}
     ray(const point3 orig, const vec3 dir): orig(orig), dir(dir){}
     const point3& origin() const{return orig;}
     const vec3& direction() const{return dir;}
-    point3 at(double t) const 
+    point3 at(real t) const 
     {
         return orig + t * dir;
     }
+    // Bound on the rounding error in each coordinate of at(t) for a t returned by one of
+    // the intersection tests, which carries tens of ulps of error itself.
+    real at_error(real t) const
+    {
+        const real scale = max_abs(orig) + std::abs(t) * max_abs(dir);
+        return 128 * std::numeric_limits<real>::epsilon() * scale;
+    }
 
 private:
+    static real max_abs(const vec3& v)
+    {
+        return std::fmax(std::fabs(v.x()), std::fmax(std::fabs(v.y()), std::fabs(v.z())));
+    }
+
     point3 orig; vec3 dir;
 
 };
+
+// Origin for a ray leaving a surface in direction w from p, whose coordinates are off by
+// up to `err`: p moved along the normal n to w's side just past that error, then rounded
+// one more ulp away from the surface. The new ray cannot hit the surface it starts on
+// again, so it needs no minimum distance (Physically Based Rendering, 3rd ed., 3.9.5).
+// The error scales with the coordinates, so the same code holds in float and double.
+inline point3 offset_ray_origin(const point3& p, real err, const vec3& n, const vec3& w)
+{
+    const real d = err * (std::fabs(n.x()) + std::fabs(n.y()) + std::fabs(n.z()));
+    vec3 offset = d * n;
+    if (dot(w, n) < 0) offset = -offset;
+    point3 po = p + offset;
+    for (int i = 0; i < 3; ++i) {
+        if (offset[i] > 0)      po[i] = std::nextafter(po[i],  std::numeric_limits<real>::infinity());
+        else if (offset[i] < 0) po[i] = std::nextafter(po[i], -std::numeric_limits<real>::infinity());
+    }
+    return po;
+}
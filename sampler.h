@@ -0,0 +1,256 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+
+// PCG32 (O'Neill 2014, pcg32_random_r): 64-bit LCG state with a permuted 32-bit output.
+// Each (state, stream) pair is an independent sequence, which is what Sampler uses
+// to give every bounce of every camera sample its own stream.
+class pcg32 {
+public:
+    pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+    pcg32(std::uint64_t initstate, std::uint64_t initseq) { seed(initstate, initseq); }
+
+    void seed(std::uint64_t initstate, std::uint64_t initseq) {
+        state = 0u;
+        inc   = (initseq << 1u) | 1u;
+        next_u32();
+        state += initstate;
+        next_u32();
+    }
+
+    std::uint32_t next_u32() {
+        std::uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        std::uint32_t xorshifted = static_cast<std::uint32_t>(((old >> 18u) ^ old) >> 27u);
+        std::uint32_t rot = static_cast<std::uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31u));
+    }
+
+    // Uniform in [0,1); 32 bits of mantissa is plenty for sample positions.
+    double next_double() { return next_u32() * 0x1p-32; }
+
+private:
+    std::uint64_t state = 0;
+    std::uint64_t inc   = 1;
+};
+
+// splitmix64 finaliser, used to turn sample coordinates into well-spread seeds.
+inline std::uint64_t mix64(std::uint64_t z) {
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Sequence a Sampler draws its numbers from. Random is the PCG stream above; the others
+// spread the samples of a pixel more evenly over [0,1)^d, so that pixel estimates converge
+// faster for the same number of samples.
+enum class SampleMethod {
+    Random,      // independent PCG32 numbers
+    Stratified,  // one jittered stratum per sample, strata shuffled per pixel and dimension
+    Halton,      // Halton sequence (prime bases), rotated per pixel (Cranley-Patterson)
+    Sobol        // Owen-scrambled Sobol in 4D sets, shuffled per pixel (Burley 2020)
+};
+
+namespace sampling {
+
+inline std::uint32_t hash32(std::uint32_t a, std::uint32_t b) {
+    return static_cast<std::uint32_t>(mix64((std::uint64_t(a) << 32) | b) >> 32);
+}
+
+inline std::uint32_t reverseBits(std::uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Owen scrambling of a 32-bit fraction whose first digit is the top bit, by the hash-based
+// Laine-Karras permutation (Burley, "Practical Hash-based Owen Scrambling", JCGT 2020).
+inline std::uint32_t nestedUniformScramble(std::uint32_t x, std::uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// Direction numbers of the first four Sobol dimensions (Joe & Kuo, new-joe-kuo-6.21201),
+// and their XOR over every value of each byte of the index. Scrambled indices use all 32
+// bits, so four lookups beat a loop over the set bits.
+struct SobolTable {
+    std::uint32_t v[4][32];
+    std::uint32_t bytes[4][4][256];
+    SobolTable() {
+        const unsigned s[4] = {0, 1, 2, 3}, a[4] = {0, 0, 1, 1};
+        const std::uint32_t m[4][3] = {{1, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+        for (int j = 0; j < 32; ++j) v[0][j] = 0x80000000u >> j;   // van der Corput
+        for (int d = 1; d < 4; ++d) {
+            for (unsigned j = 0; j < 32; ++j) {
+                if (j < s[d]) { v[d][j] = m[d][j] << (31 - j); continue; }
+                std::uint32_t x = v[d][j - s[d]] ^ (v[d][j - s[d]] >> s[d]);
+                for (unsigned k = 1; k < s[d]; ++k)
+                    if ((a[d] >> (s[d] - 1 - k)) & 1) x ^= v[d][j - k];
+                v[d][j] = x;
+            }
+        }
+        for (int d = 0; d < 4; ++d)
+            for (int b = 0; b < 4; ++b)
+                for (std::uint32_t k = 0; k < 256; ++k) {
+                    std::uint32_t x = 0;
+                    for (int j = 0; j < 8; ++j)
+                        if (k >> j & 1) x ^= v[d][8 * b + j];
+                    bytes[d][b][k] = x;
+                }
+    }
+};
+
+// Sobol point i, dimension 0..3, as a 32-bit fraction.
+inline std::uint32_t sobol(std::uint32_t i, int dim) {
+    static const SobolTable table;
+    const auto& t = table.bytes[dim];
+    return t[0][i & 0xff] ^ t[1][(i >> 8) & 0xff] ^ t[2][(i >> 16) & 0xff] ^ t[3][i >> 24];
+}
+
+// Radical inverse of i in `base`: the digits of i mirrored about the radix point.
+inline double radicalInverse(std::uint32_t i, std::uint32_t base) {
+    const double inv = 1.0 / base;
+    double f = inv, r = 0.0;
+    for (; i; i /= base, f *= inv) r += (i % base) * f;
+    return r;
+}
+
+constexpr std::uint32_t kPrimes[32] = {2,  3,  5,  7,  11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+                                       59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+
+// Element i of a pseudo-random permutation of [0, n) chosen by `seed` (Kensler,
+// "Correlated Multi-Jittered Sampling", 2013).
+inline std::uint32_t permute(std::uint32_t i, std::uint32_t n, std::uint32_t seed) {
+    std::uint32_t w = n - 1;
+    w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+    do {
+        i ^= seed; i *= 0xe170893du; i ^= seed >> 16; i ^= (i & w) >> 4;
+        i ^= seed >> 8; i *= 0x0929eb3fu; i ^= seed >> 23; i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27; i *= 0x6935fa69u; i ^= (i & w) >> 11; i *= 0x74dcb303u;
+        i ^= (i & w) >> 2; i *= 0x9e501cc3u; i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+        i &= w; i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+} // namespace sampling
+
+// Random numbers for one camera sample.
+// The sequence is a pure function of (pixel, sample index, bounce, frame): call start()
+// once per camera sample and set_bounce() at every path vertex, and any sample can be
+// replayed on its own, on any thread, in any order.
+//
+// With a low-discrepancy method, draw k of bounce b is dimension 8 b + k of the pixel's
+// point set (get2D takes two at once; the pixel offset is the camera's first draw), and
+// draws past the 8th of a bounce, e.g. rejection-sampling retries, fall back to the PCG
+// stream. `spp` is the number of samples per pixel the Stratified method divides into.
+class Sampler {
+public:
+    static constexpr std::uint32_t kBounceDims = 8;
+
+    Sampler() = default;
+    Sampler(std::uint32_t pixel, std::uint32_t sample, std::uint32_t frame = 0,
+            SampleMethod method = SampleMethod::Random, std::uint32_t spp = 1) {
+        start(pixel, sample, frame, method, spp);
+    }
+
+    void start(std::uint32_t pixel, std::uint32_t sample, std::uint32_t frame = 0,
+               SampleMethod method = SampleMethod::Random, std::uint32_t spp = 1) {
+        key = mix64(mix64((std::uint64_t(sample) << 32) | pixel) ^ frame);
+        method_ = method;
+        index_  = sample;
+        spp_    = spp > 0 ? spp : 1;
+        seed_   = method == SampleMethod::Random ? 0 : sampling::hash32(pixel, frame);
+        set_bounce(0);
+    }
+
+    void set_bounce(std::uint32_t bounce) {
+        bounce_ = bounce;
+        rng.seed(key, bounce);
+        dim_ = bounce * kBounceDims;
+    }
+    std::uint32_t bounce() const { return bounce_; }
+
+    // Returns a random real in [0,1).
+    double get1D() {
+        if (method_ == SampleMethod::Random || dim_ >= (bounce_ + 1) * kBounceDims) return rng.next_double();
+        return sample(dim_++);
+    }
+    // Returns a random real in [min,max).
+    double get1D(double min, double max) { return min + (max - min) * get1D(); }
+
+    // Two coordinates stratified together (pixel offsets, lens or light positions).
+    std::pair<double, double> get2D() {
+        if (method_ == SampleMethod::Random) return {get1D(), get1D()};
+        dim_ += dim_ & 1;   // an even pair stays inside one Sobol 4D set
+        if (dim_ + 2 > (bounce_ + 1) * kBounceDims) return {rng.next_double(), rng.next_double()};
+        const std::uint32_t d = dim_;
+        dim_ += 2;
+        if (method_ == SampleMethod::Stratified) return stratified2D(d);
+        if (method_ == SampleMethod::Sobol) {
+            // both coordinates come from the same shuffled point of the 4D set
+            const std::uint32_t set_seed = sampling::hash32(seed_, d / 4);
+            const std::uint32_t i = sampling::nestedUniformScramble(index_, set_seed);
+            return {sobolCoordinate(i, set_seed, d % 4), sobolCoordinate(i, set_seed, d % 4 + 1)};
+        }
+        return {sample(d), sample(d + 1)};
+    }
+
+private:
+    // 32 bits of hash for the jitter of (dimension, sample).
+    double jitter(std::uint32_t dim) const {
+        return sampling::hash32(seed_ ^ dim * 0x9e3779b9u, index_) * 0x1p-32;
+    }
+
+    double sample(std::uint32_t dim) const {
+        switch (method_) {
+        case SampleMethod::Stratified: {
+            const std::uint32_t stratum = sampling::permute(index_ % spp_, spp_, sampling::hash32(seed_, dim));
+            return (stratum + jitter(dim)) / spp_;
+        }
+        case SampleMethod::Halton: {
+            if (dim >= 32) return jitter(dim);
+            double x = sampling::radicalInverse(index_, sampling::kPrimes[dim]) + sampling::hash32(seed_, dim) * 0x1p-32;
+            return x >= 1.0 ? x - 1.0 : x;
+        }
+        case SampleMethod::Sobol: {
+            const std::uint32_t set_seed = sampling::hash32(seed_, dim / 4);
+            return sobolCoordinate(sampling::nestedUniformScramble(index_, set_seed), set_seed, dim % 4);
+        }
+        default:
+            return jitter(dim);
+        }
+    }
+
+    // Coordinate c of shuffled Sobol point i, Owen-scrambled per coordinate.
+    static double sobolCoordinate(std::uint32_t i, std::uint32_t set_seed, std::uint32_t c) {
+        const std::uint32_t x = sampling::sobol(i, static_cast<int>(c));
+        return sampling::nestedUniformScramble(x, sampling::hash32(set_seed, c)) * 0x1p-32;
+    }
+
+    // nx * ny jittered cells with nx = floor(sqrt(spp)), visited in a per-pixel order;
+    // sample indices past the last cell are uniform.
+    std::pair<double, double> stratified2D(std::uint32_t dim) const {
+        std::uint32_t nx = 1;
+        while ((nx + 1) * (nx + 1) <= spp_) ++nx;
+        const std::uint32_t ny = spp_ / nx;
+        const std::uint32_t cell = sampling::permute(index_ % spp_, spp_, sampling::hash32(seed_, dim));
+        if (cell >= nx * ny) return {jitter(dim), jitter(dim + 1)};
+        return {(cell % nx + jitter(dim)) / nx, (cell / nx + jitter(dim + 1)) / ny};
+    }
+
+    std::uint64_t key = 0;
+    std::uint32_t bounce_ = 0;
+    pcg32 rng;
+    SampleMethod  method_ = SampleMethod::Random;
+    std::uint32_t index_ = 0, spp_ = 1, seed_ = 0, dim_ = 0;
+};
@@ -51,6 +51,11 @@ struct Plane {
     vec2 uv_offset{};
 };
 
+struct Mesh {
+    std::string name;
+    std::string file;   // triangulated OBJ (f v/vt/vn)
+};
+
 struct SceneMeta {
     int frame = 0;
     double unit_scale_length = 1.0;
@@ -76,5 +81,6 @@ struct Scene {
     std::vector<Sphere> spheres;
     std::vector<Cube> cubes;
     std::vector<Plane> planes;
+    std::vector<Mesh> meshes;
 };
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "simd.h"
+#include <atomic>
+#if RT_X86_SIMD && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+bool detectAVX2()
+{
+#if !RT_X86_SIMD
+    return false;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    const bool fma     = (info[2] & (1 << 12)) != 0;
+    if (!osxsave || !avx || !fma) return false;
+    // The OS must save the YMM registers on context switches.
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+std::atomic<bool> g_simd_enabled{true};
+} // namespace
+
+bool cpuHasAVX2()
+{
+    static const bool has = detectAVX2();
+    return has;
+}
+
+bool simdEnabled()
+{
+    return g_simd_enabled.load(std::memory_order_relaxed) && cpuHasAVX2();
+}
+
+void setSimdEnabled(bool enabled)
+{
+    g_simd_enabled.store(enabled, std::memory_order_relaxed);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Hand-vectorised kernels are compiled per function with a target attribute, so the rest
+// of the program keeps the baseline instruction set and runs on any x86-64 CPU. Callers
+// pick the kernel at run time with simdEnabled().
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RT_X86_SIMD 1
+#else
+#define RT_X86_SIMD 0
+#endif
+
+#if RT_X86_SIMD && (defined(__GNUC__) || defined(__clang__))
+#define RT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+// Without FMA, so a * b + c is never fused and rounds exactly like the scalar code.
+#define RT_TARGET_AVX2_EXACT __attribute__((target("avx2")))
+#else
+#define RT_TARGET_AVX2
+#define RT_TARGET_AVX2_EXACT
+#endif
+
+// CPU and OS both support AVX2 (checked once).
+bool cpuHasAVX2();
+// cpuHasAVX2() unless the SIMD paths were switched off with setSimdEnabled(false).
+bool simdEnabled();
+// Forces the scalar fallbacks, e.g. for --no-simd or to benchmark both paths.
+void setSimdEnabled(bool enabled);
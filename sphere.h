@@ -1,16 +1,21 @@
 #pragma once
 #include "hittable.h"
+#include "intersect_kernels.h"
 #include "vec3.h"
+class PrimitiveSoA;
+class SphereSoA;
 namespace rt {
 class sphere : public hittable {
 private:
 point3 center{};
-double radius;
-std::shared_ptr<material> mat;
+real radius;
+std::uint32_t mat_id;
+friend class ::PrimitiveSoA;
+friend class ::SphereSoA;
 
 public: 
-    sphere(const point3& center, double radius, std::shared_ptr<material> mat) 
-    : center(center), radius(std::fmax(0,radius)), mat(mat){}
+    sphere(const point3& center, real radius, std::uint32_t mat_id) 
+    : center(center), radius(std::fmax(0,radius)), mat_id(mat_id){}
 
     bounds3 getBounds() const override 
     {
@@ -18,31 +23,27 @@ public:
         return bounds3(center - e, center + e);
     }
     
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override
     {
-        const vec3  d = r.direction();
-        const vec3  m = r.origin() - center;
-        const double a = dot(d, d);                   // d·d
-        const double b = dot(m, d);                   // m·d 
-        const double c = dot(m, m) - radius * radius; // m·m - R²
-
-        const double disc = b * b + (-a) * c;         // b² - a·c
-        if (disc < 0.0) return false;
-
-        const double s = std::sqrt(disc);
-
-        double t = (-b - s) / a;
-        if (!ray_t.surrounds(t)) {
-            t = (-b + s) / a;
-            if (!ray_t.surrounds(t)) return false;
-        }
+        real t;
+        if (!intersect_sphere(center, radius, r, ray_t, t)) return false;
+        h.t    = t;
+        h.prim = this;
+        return true;
+    }
 
-        rec.t = t;
-        rec.p = r.at(t);
-        rec.mat = mat;
+    void surface(const ray& r, const hit_info& h, hit_record& rec) const override
+    {
+        rec.p = r.at(h.t);
+        rec.mat_id = mat_id;
         const vec3 outward = (rec.p - center) / radius;
         rec.set_face_normal(r, outward);
-        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override
+    {
+        real t;
+        return intersect_sphere(center, radius, r, ray_t, t);
     }
 };
 
@@ -0,0 +1,200 @@
+#include "tgaimage.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+TGAImage::TGAImage(const int w, const int h, const int bpp)
+    : w(w), h(h), bpp(static_cast<std::uint8_t>(bpp)),
+      data(static_cast<std::size_t>(w) * h * bpp, 0) {}
+
+bool TGAImage::read_tga_file(const std::string filename)
+{
+    std::ifstream in;
+    in.open(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    TGAHeader header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in.good()) {
+        std::cerr << "an error occured while reading the header\n";
+        return false;
+    }
+    w   = header.width;
+    h   = header.height;
+    bpp = header.bitsperpixel >> 3;
+    if (w <= 0 || h <= 0 || (bpp != GRAYSCALE && bpp != RGB && bpp != RGBA)) {
+        std::cerr << "bad bpp (or width/height) value\n";
+        return false;
+    }
+    std::size_t nbytes = static_cast<std::size_t>(bpp) * w * h;
+    data = std::vector<std::uint8_t>(nbytes, 0);
+    if (3 == header.datatypecode || 2 == header.datatypecode) {
+        in.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(nbytes));
+        if (!in.good()) {
+            std::cerr << "an error occured while reading the data\n";
+            return false;
+        }
+    } else if (10 == header.datatypecode || 11 == header.datatypecode) {
+        if (!load_rle_data(in)) {
+            std::cerr << "an error occured while reading the data\n";
+            return false;
+        }
+    } else {
+        std::cerr << "unknown file format " << static_cast<int>(header.datatypecode) << "\n";
+        return false;
+    }
+    if (!(header.imagedescriptor & 0x20))
+        flip_vertically();
+    if (header.imagedescriptor & 0x10)
+        flip_horizontally();
+    return true;
+}
+
+bool TGAImage::load_rle_data(std::ifstream &in)
+{
+    std::size_t pixelcount   = static_cast<std::size_t>(w) * h;
+    std::size_t currentpixel = 0;
+    std::size_t currentbyte  = 0;
+    TGAColor colorbuffer;
+    do {
+        std::uint8_t chunkheader = static_cast<std::uint8_t>(in.get());
+        if (!in.good()) return false;
+        if (chunkheader < 128) {
+            chunkheader++;
+            for (int i = 0; i < chunkheader; i++) {
+                in.read(reinterpret_cast<char *>(colorbuffer.bgra), bpp);
+                if (!in.good()) return false;
+                for (int t = 0; t < bpp; t++) data[currentbyte++] = colorbuffer.bgra[t];
+                if (++currentpixel > pixelcount) return false;
+            }
+        } else {
+            chunkheader -= 127;
+            in.read(reinterpret_cast<char *>(colorbuffer.bgra), bpp);
+            if (!in.good()) return false;
+            for (int i = 0; i < chunkheader; i++) {
+                for (int t = 0; t < bpp; t++) data[currentbyte++] = colorbuffer.bgra[t];
+                if (++currentpixel > pixelcount) return false;
+            }
+        }
+    } while (currentpixel < pixelcount);
+    return true;
+}
+
+void TGAImage::encode(std::vector<std::uint8_t>& out, const bool vflip, const bool rle) const
+{
+    constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
+    constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
+    constexpr char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+
+    TGAHeader header;
+    header.bitsperpixel    = static_cast<std::uint8_t>(bpp << 3);
+    header.width           = static_cast<std::uint16_t>(w);
+    header.height          = static_cast<std::uint16_t>(h);
+    header.datatypecode    = (bpp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
+    header.imagedescriptor = vflip ? 0x00 : 0x20; // bottom-left or top-left origin
+
+    out.clear();
+    auto append = [&out](const void* p, std::size_t n) {
+        const auto* b = static_cast<const std::uint8_t*>(p);
+        out.insert(out.end(), b, b + n);
+    };
+    append(&header, sizeof(header));
+
+    const std::size_t row_bytes = static_cast<std::size_t>(w) * bpp;
+    if (!rle) {
+        append(data.data(), data.size());
+    } else {
+        std::vector<std::vector<std::uint8_t>> rows(static_cast<std::size_t>(h));
+        parallel_for(0, rows.size(), 16, [&](std::size_t y) {
+            unload_rle_row(data.data() + y * row_bytes, rows[y]);
+        });
+        std::size_t total = 0;
+        for (const auto& r : rows) total += r.size();
+        out.reserve(out.size() + total + 26);
+        for (const auto& r : rows) append(r.data(), r.size());
+    }
+    append(developer_area_ref, sizeof(developer_area_ref));
+    append(extension_area_ref, sizeof(extension_area_ref));
+    append(footer, sizeof(footer));
+}
+
+bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const
+{
+    std::vector<std::uint8_t> bytes;
+    encode(bytes, vflip, rle);
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return out.good();
+}
+
+void TGAImage::unload_rle_row(const std::uint8_t* row, std::vector<std::uint8_t>& out) const
+{
+    const std::uint8_t max_chunk_length = 128;
+    const int npixels = w;
+    int curpix = 0;
+    while (curpix < npixels) {
+        const std::size_t chunkstart = static_cast<std::size_t>(curpix) * bpp;
+        std::size_t curbyte = chunkstart;
+        std::uint8_t run_length = 1;
+        bool raw = true;
+        while (curpix + run_length < npixels && run_length < max_chunk_length) {
+            bool succ_eq = std::memcmp(row + curbyte, row + curbyte + bpp, bpp) == 0;
+            curbyte += bpp;
+            if (1 == run_length) raw = !succ_eq;
+            if (raw && succ_eq) { run_length--; break; }
+            if (!raw && !succ_eq) break;
+            run_length++;
+        }
+        curpix += run_length;
+        out.push_back(raw ? static_cast<std::uint8_t>(run_length - 1)
+                          : static_cast<std::uint8_t>(run_length + 127));
+        const std::size_t n = raw ? static_cast<std::size_t>(run_length) * bpp : bpp;
+        out.insert(out.end(), row + chunkstart, row + chunkstart + n);
+    }
+}
+
+TGAColor TGAImage::get(const int x, const int y) const
+{
+    if (!data.size() || x < 0 || y < 0 || x >= w || y >= h) return {};
+    TGAColor ret;
+    ret.bytespp = bpp;
+    const std::uint8_t *p = data.data() + (static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * w) * bpp;
+    for (int i = bpp; i--; ret.bgra[i] = p[i]);
+    return ret;
+}
+
+void TGAImage::set(int x, int y, const TGAColor &c)
+{
+    if (!data.size() || x < 0 || y < 0 || x >= w || y >= h) return;
+    std::memcpy(data.data() + (static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * w) * bpp, c.bgra, bpp);
+}
+
+void TGAImage::flip_horizontally()
+{
+    int half = w >> 1;
+    for (int i = 0; i < half; i++)
+        for (int j = 0; j < h; j++)
+            for (int b = 0; b < bpp; b++)
+                std::swap(data[(static_cast<std::size_t>(i)         + static_cast<std::size_t>(j) * w) * bpp + b],
+                          data[(static_cast<std::size_t>(w - 1 - i) + static_cast<std::size_t>(j) * w) * bpp + b]);
+}
+
+void TGAImage::flip_vertically()
+{
+    std::size_t row_bytes = static_cast<std::size_t>(w) * bpp;
+    int half = h >> 1;
+    for (int j = 0; j < half; j++)
+        std::swap_ranges(data.begin() + static_cast<std::ptrdiff_t>(j * row_bytes),
+                         data.begin() + static_cast<std::ptrdiff_t>((j + 1) * row_bytes),
+                         data.begin() + static_cast<std::ptrdiff_t>((h - 1 - j) * row_bytes));
+}
+
+int TGAImage::width() const { return w; }
+int TGAImage::height() const { return h; }
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <fstream>
+#include <string>
 #include <vector>
 
 #pragma pack(push,1)
@@ -32,6 +33,9 @@ struct TGAImage {
     TGAImage(const int w, const int h, const int bpp);
     bool  read_tga_file(const std::string filename);
     bool write_tga_file(const std::string filename, const bool vflip=true, const bool rle=true) const;
+    // Builds the complete file (header, pixel data, footer) in memory. RLE scanlines are
+    // packed in parallel; packets never cross a scanline, as the TGA spec recommends.
+    void encode(std::vector<std::uint8_t>& out, const bool vflip=true, const bool rle=true) const;
     void flip_horizontally();
     void flip_vertically();
     TGAColor get(const int x, const int y) const;
@@ -40,9 +44,8 @@ struct TGAImage {
     int height() const;
 private:
     bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out) const;
+    void unload_rle_row(const std::uint8_t* row, std::vector<std::uint8_t>& out) const;
     int w = 0, h = 0;
     std::uint8_t bpp = 0;
     std::vector<std::uint8_t> data = {};
 };
-
@@ -0,0 +1,169 @@
+#include "triangle_mesh.h"
+#include "model.h"
+#include "parallel.h"
+#include <algorithm>
+
+namespace rt {
+
+triangle_mesh::triangle_mesh(std::vector<point3> positions, std::vector<std::uint32_t> indices,
+                             std::vector<vec3> normals, std::vector<std::uint32_t> normal_indices,
+                             std::vector<point2> uvs, std::vector<std::uint32_t> uv_indices,
+                             std::uint32_t mat_id, const BVHBuildOptions& opts)
+    : pos(std::move(positions)), nrm(std::move(normals)), uv(std::move(uvs)),
+      vi(std::move(indices)), ni(std::move(normal_indices)), ti(std::move(uv_indices)), mat_id(mat_id)
+{
+    if (ni.size() != vi.size() || nrm.empty()) { ni.clear(); nrm.clear(); }
+    if (ti.size() != vi.size() || uv.empty())  { ti.clear(); uv.clear(); }
+    build(opts);
+}
+
+triangle_mesh::triangle_mesh(const model& m, std::uint32_t mat_id, const BVHBuildOptions& opts)
+    : pos(m.vertices()), nrm(m.normals()), uv(m.texcoords()), mat_id(mat_id)
+{
+    auto toIndices = [](const std::vector<int>& src) {
+        return std::vector<std::uint32_t>(src.begin(), src.end());
+    };
+    vi = toIndices(m.faceVertices());
+    ni = toIndices(m.faceNormals());
+    ti = toIndices(m.faceTexcoords());
+    if (ni.size() != vi.size() || nrm.empty()) { ni.clear(); nrm.clear(); }
+    if (ti.size() != vi.size() || uv.empty())  { ti.clear(); uv.clear(); }
+    build(opts);
+}
+
+triangle_mesh::triangle_mesh(triangle_mesh_data built, std::uint32_t mat_id)
+    : pos(std::move(built.positions)), nrm(std::move(built.normals)), uv(std::move(built.uvs)),
+      vi(std::move(built.indices)), ni(std::move(built.normal_indices)), ti(std::move(built.uv_indices)),
+      nodes(std::move(built.nodes)), depth(built.depth), bounds(built.bounds), mat_id(mat_id)
+{
+}
+
+triangle_mesh_data triangle_mesh::data() const
+{
+    triangle_mesh_data d;
+    d.positions = pos;  d.normals = nrm;  d.uvs = uv;
+    d.indices = vi;     d.normal_indices = ni;  d.uv_indices = ti;
+    d.nodes  = nodes;
+    d.depth  = depth;
+    d.bounds = bounds;
+    return d;
+}
+
+void triangle_mesh::build(const BVHBuildOptions& opts)
+{
+    const size_t n = vi.size() / 3;
+    vi.resize(n * 3);
+    if (n == 0) return;
+
+    std::vector<BVHPrimitiveInfo> info(n);
+    parallel_for(0, n, 4096, [&](size_t i) {
+        bounds3 b(pos[vi[3 * i]]);
+        b = Union(b, pos[vi[3 * i + 1]]);
+        b = Union(b, pos[vi[3 * i + 2]]);
+        info[i].box      = b;
+        info[i].centroid = b.Centroid();
+        info[i].index    = static_cast<std::uint32_t>(i);
+    }, opts.threads);
+
+    LinearBVH lin = BVH::buildLinear(std::move(info), opts);
+    nodes  = std::move(lin.nodes);
+    depth  = lin.depth;
+    bounds = lin.bounds;
+
+    // 把索引三元组按叶子顺序重排，叶子的 offset 直接就是三角形下标
+    auto reorder = [&](std::vector<std::uint32_t>& idx) {
+        if (idx.empty()) return;
+        std::vector<std::uint32_t> sorted(idx.size());
+        for (size_t i = 0; i < n; ++i)
+            std::copy_n(idx.begin() + 3 * lin.order[i], 3, sorted.begin() + 3 * i);
+        idx.swap(sorted);
+    };
+    reorder(vi);
+    reorder(ni);
+    reorder(ti);
+}
+
+size_t triangle_mesh::bytes() const
+{
+    return pos.size() * sizeof(point3) + nrm.size() * sizeof(vec3) + uv.size() * sizeof(point2)
+         + (vi.size() + ni.size() + ti.size()) * sizeof(std::uint32_t)
+         + nodes.size() * sizeof(LinearBVHNode);
+}
+
+bool triangle_mesh::intersect(std::uint32_t tri, const ray& r, interval ray_t,
+                              real& t, real& b1, real& b2) const
+{
+    
+    const point3& v0 = pos[vi[3 * tri]];
+    const vec3 e1 = pos[vi[3 * tri + 1]] - v0;
+    const vec3 e2 = pos[vi[3 * tri + 2]] - v0;
+    const vec3 p  = cross(r.direction(), e2);
+    const real det = dot(e1, p);
+    if (det == 0) return false; // parallel; grazing rays miss on b1, b2
+    const real invDet = real(1) / det;
+
+    const vec3 tvec = r.origin() - v0;
+    b1 = dot(tvec, p) * invDet;
+    if (b1 < 0.0 || b1 > 1.0) return false;
+
+    const vec3 q = cross(tvec, e1);
+    b2 = dot(r.direction(), q) * invDet;
+    if (b2 < 0.0 || b1 + b2 > 1.0) return false;
+
+    t = dot(e2, q) * invDet;
+    return ray_t.surrounds(t);
+}
+
+bool triangle_mesh::intersect(const ray& r, interval ray_t, hit_info& h) const
+{
+    if (nodes.empty()) return false;
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, interval& t) {
+        bool found = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            real th, u, v;
+            if (intersect(i, r, t, th, u, v)) { found = true; t.max = th; h.id = i; h.u = u; h.v = v; }
+        }
+        return found;
+    };
+    if (!traverseLinearBVH(nodes.data(), depth, r, ray_t, leaf)) return false;
+    h.t    = ray_t.max;
+    h.prim = this;
+    return true;
+}
+
+void triangle_mesh::surface(const ray& r, const hit_info& h, hit_record& rec) const
+{
+    const std::uint32_t* v = &vi[3 * h.id];
+    const real b1 = h.u, b2 = h.v;
+    const real b0 = 1 - b1 - b2;
+    rec.p      = r.at(h.t);
+    rec.mat_id = mat_id;
+    const vec3 ng = cross(pos[v[1]] - pos[v[0]], pos[v[2]] - pos[v[0]]);
+    rec.set_face_normal(r, unit_vector(ng));
+    if (!ni.empty()) {
+        const std::uint32_t* n = &ni[3 * h.id];
+        const vec3 ns = unit_vector(b0 * nrm[n[0]] + b1 * nrm[n[1]] + b2 * nrm[n[2]]);
+        // 插值法线跟几何法线保持在同一侧
+        rec.normal = rec.front_face ? ns : -ns;
+    }
+    if (!ti.empty()) {
+        const std::uint32_t* w = &ti[3 * h.id];
+        rec.uv = float(b0) * uv[w[0]] + float(b1) * uv[w[1]] + float(b2) * uv[w[2]];
+    } else {
+        rec.uv = point2(float(b1), float(b2));
+    }
+}
+
+bool triangle_mesh::occluded(const ray& r, interval ray_t) const
+{
+    if (nodes.empty()) return false;
+    auto leaf = [&](std::uint32_t first, std::uint32_t count, interval& t) {
+        real th, u, v;
+        for (std::uint32_t i = first; i < first + count; ++i)
+            if (intersect(i, r, t, th, u, v)) return true;
+        return false;
+    };
+    return traverseLinearBVH<true>(nodes.data(), depth, r, ray_t, leaf);
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "hittable.h"
+#include "BVH.h"
+#include "vec3.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class model;
+
+namespace rt {
+// Everything a built triangle_mesh owns: the vertex buffers, the index triples in BVH
+// leaf order and that BVH. The scene cache stores meshes in this form so that they come
+// back without touching the OBJ or the builder.
+struct triangle_mesh_data {
+    std::vector<point3> positions;
+    std::vector<vec3>   normals;
+    std::vector<point2> uvs;
+    std::vector<std::uint32_t> indices, normal_indices, uv_indices;
+    std::vector<LinearBVHNode> nodes;
+    int depth = 0;
+    bounds3 bounds;
+};
+
+// Indexed triangle mesh as a single hittable. Positions, normals and UVs live in shared
+// buffers and every triangle is three 32-bit indices into each, so a mesh costs one
+// object in the scene BVH however many triangles it has. Its own BVH over the triangles
+// is built at construction; index triples are stored in that BVH's leaf order.
+class triangle_mesh : public hittable {
+public:
+    // `indices` holds 3 position indices per triangle. `normal_indices` / `uv_indices` are
+    // either empty or parallel to it; without normals the geometric normal is used and
+    // without UVs rec.uv gets the barycentric (u, v) of the hit.
+    triangle_mesh(std::vector<point3> positions, std::vector<std::uint32_t> indices,
+                  std::vector<vec3> normals, std::vector<std::uint32_t> normal_indices,
+                  std::vector<point2> uvs, std::vector<std::uint32_t> uv_indices,
+                  std::uint32_t mat_id, const BVHBuildOptions& opts = {});
+    // Copies the buffers of an OBJ loaded by `model`.
+    triangle_mesh(const model& m, std::uint32_t mat_id, const BVHBuildOptions& opts = {});
+    // Takes a mesh that is already built (see data()); nothing is rebuilt.
+    triangle_mesh(triangle_mesh_data built, std::uint32_t mat_id);
+
+    // h.id is the triangle (in leaf order), h.u / h.v its barycentrics b1 / b2.
+    bool intersect(const ray& r, interval ray_t, hit_info& h) const override;
+    void surface(const ray& r, const hit_info& h, hit_record& rec) const override;
+    bool occluded(const ray& r, interval ray_t) const override;
+    bounds3 getBounds() const override { return bounds; }
+
+    size_t triangle_count() const { return vi.size() / 3; }
+    size_t vertex_count() const { return pos.size(); }
+    // Vertex buffers + index triples + BVH nodes
+    size_t bytes() const;
+    const std::vector<LinearBVHNode>& linear_nodes() const { return nodes; }
+    // Copy of the built buffers, for the scene cache.
+    triangle_mesh_data data() const;
+
+private:
+    void build(const BVHBuildOptions& opts);
+    // Möller–Trumbore, two-sided: distance and barycentrics (b1, b2) of triangle `tri`.
+    bool intersect(std::uint32_t tri, const ray& r, interval ray_t, real& t, real& b1, real& b2) const;
+
+    std::vector<point3> pos;
+    std::vector<vec3>   nrm;
+    std::vector<point2> uv;
+    std::vector<std::uint32_t> vi, ni, ti;  // 3 per triangle
+    std::vector<LinearBVHNode> nodes;
+    int depth = 0;
+    bounds3 bounds;
+    std::uint32_t mat_id;
+};
+}
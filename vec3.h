@@ -4,6 +4,7 @@
 #include <ostream>
 #include <algorithm>
 #include "utility.h"
+#include "sampler.h"
 
 class vec2 {
 public:
@@ -63,18 +64,18 @@ inline vec2 unit_vector(const vec2& v) noexcept {
 class vec3 {
 public:
     // 构造
-    constexpr vec3() noexcept : d_{0.0, 0.0, 0.0} {}
-    constexpr vec3(double x) noexcept : d_{x, x, x} {}
-    constexpr vec3(double x, double y, double z) noexcept : d_{x, y, z} {}
+    constexpr vec3() noexcept : d_{0, 0, 0} {}
+    constexpr vec3(real x) noexcept : d_{x, x, x} {}
+    constexpr vec3(real x, real y, real z) noexcept : d_{x, y, z} {}
 
     // 访问器（保留原名）
-    [[nodiscard]] constexpr double x() const noexcept { return d_[0]; }
-    [[nodiscard]] constexpr double y() const noexcept { return d_[1]; }
-    [[nodiscard]] constexpr double z() const noexcept { return d_[2]; }
+    [[nodiscard]] constexpr real x() const noexcept { return d_[0]; }
+    [[nodiscard]] constexpr real y() const noexcept { return d_[1]; }
+    [[nodiscard]] constexpr real z() const noexcept { return d_[2]; }
 
     // 下标
-    [[nodiscard]] constexpr double  operator[](int i) const noexcept { return d_[static_cast<std::size_t>(i)]; }
-    constexpr double&               operator[](int i)       noexcept { return d_[static_cast<std::size_t>(i)]; }
+    [[nodiscard]] constexpr real  operator[](int i) const noexcept { return d_[static_cast<std::size_t>(i)]; }
+    constexpr real&               operator[](int i)       noexcept { return d_[static_cast<std::size_t>(i)]; }
 
     // 一元负号
     [[nodiscard]] constexpr vec3 operator-() const noexcept { return vec3{-d_[0], -d_[1], -d_[2]}; }
@@ -88,23 +89,23 @@ public:
         for (int i = 0; i < 3; ++i) d_[i] -= v.d_[static_cast<std::size_t>(i)];
         return *this;
     }
-    vec3& operator*=(double s) noexcept {
-        for (double& c : d_) c *= s;
+    vec3& operator*=(real s) noexcept {
+        for (real& c : d_) c *= s;
         return *this;
     }
-    vec3& operator/=(double s) noexcept {
-        const double inv = 1.0 / s;
+    vec3& operator/=(real s) noexcept {
+        const real inv = real(1) / s;
         return (*this *= inv);
     }
 
     // 长度
-    [[nodiscard]] double length_squared() const noexcept {
+    [[nodiscard]] real length_squared() const noexcept {
         // 写法变化：避免重复展开，减少与常见实现的重合
-        double acc = 0.0;
-        for (double c : d_) acc += c * c;
+        real acc = 0;
+        for (real c : d_) acc += c * c;
         return acc;
     }
-    [[nodiscard]] double length() const noexcept { return std::sqrt(length_squared()); }
+    [[nodiscard]] real length() const noexcept { return std::sqrt(length_squared()); }
 
     // 输出
     friend std::ostream& operator<<(std::ostream& os, const vec3& v) {
@@ -112,12 +113,14 @@ public:
     }
 
     //---------------newly added 
-    static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+    static vec3 random(Sampler& s) {
+        real x = s.get1D(), y = s.get1D();
+        return vec3(x, y, s.get1D());
     }
 
-    static vec3 random(double min, double max) {
-        return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+    static vec3 random(Sampler& s, real min, real max) {
+        real x = s.get1D(min, max), y = s.get1D(min, max);
+        return vec3(x, y, s.get1D(min, max));
     }
 
     bool near_zero() const {
@@ -128,7 +131,7 @@ public:
 //---------------
 
 private:
-    std::array<double, 3> d_;
+    std::array<real, 3> d_;
 };
 
 // ====== 保留“旧风格”的自由函数与运算符 ======
@@ -144,12 +147,12 @@ inline vec3 operator*(const vec3& a, const vec3& b) noexcept {
     return vec3{a[0] * b[0], a[1] * b[1], a[2] * b[2]};
 }
 // 标量乘除（双边）
-inline vec3 operator*(double s, const vec3& v) noexcept { return vec3{s * v[0], s * v[1], s * v[2]}; }
-inline vec3 operator*(const vec3& v, double s) noexcept { return s * v; }
-inline vec3 operator/(const vec3& v, double s) noexcept { return (1.0 / s) * v; }
+inline vec3 operator*(real s, const vec3& v) noexcept { return vec3{s * v[0], s * v[1], s * v[2]}; }
+inline vec3 operator*(const vec3& v, real s) noexcept { return s * v; }
+inline vec3 operator/(const vec3& v, real s) noexcept { return (real(1) / s) * v; }
 
 // 点积 / 叉积（名称不变）
-inline double dot(const vec3& a, const vec3& b) noexcept {
+inline real dot(const vec3& a, const vec3& b) noexcept {
     // 写法变化：不直接展开，便于与常见模板拉开差异
     return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
 }
@@ -162,16 +165,16 @@ inline vec3 cross(const vec3& a, const vec3& b) noexcept {
 }
 
 inline vec3 unit_vector(const vec3& v) noexcept {
-    const double len2 = v.length_squared();
-    if (len2 == 0.0) return v;  // 防止除以零
-    const double inv_len = 1.0 / std::sqrt(len2);
+    const real len2 = v.length_squared();
+    if (len2 == 0) return v;  // 防止除以零
+    const real inv_len = real(1) / std::sqrt(len2);
     return v * inv_len;
 }
 
 //Newly Added -------------------------------------
-inline vec3 random_unit_vector() {
+inline vec3 random_unit_vector(Sampler& s) {
     while (true) {
-        auto p = vec3::random(-1,1);
+        auto p = vec3::random(s, -1,1);
         auto lensq = p.length_squared();
         if (1e-160 < lensq && lensq <= 1)
             return p / sqrt(lensq);